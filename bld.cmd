@@ -22,17 +22,27 @@ ENDLOCAL
 rem
 rem ---------------------------------------------------------------------------
 rem GCC: OMF format, Optimized, No-strict-aliasing (to suppress a warning msg),
+rem      Multithreaded runtime (-Zmt, required because mapxqs starts threads),
 rem      Link in libiberty (the gcc3 demangler), Output mapxqs.exe
+rem      xqssrv.exe (the symbol server) & xqsload.exe (its load generator)
+rem      only need the reader, so they're built with GCC alone.  xqsload
+rem      also links xqsseek.o so 'xqsload -s' can test xqs_seeklookup().
+rem      Add -msse2 or -mavx2 to let mapxqs_scan.c use vector instructions
+rem      (the exe will then require a CPU that supports them).
 rem
 SET BEGINLIBPATH=%BEGINSAVE%
 SETLOCAL
 call G:\MOZTOOLS\setmozenv.cmd > nul
 @echo on
-gcc -c -Wall -Zomf -O2 -fno-strict-aliasing mapxqs.c
+gcc -c -Wall -Zomf -Zmt -O2 -fno-strict-aliasing mapxqs.c mapxqs_scan.c xqszip.c xqsread.c xqsseek.c xqssrv.c xqsload.c
 @IF ERRORLEVEL 1 goto end
-g++ -o mapxqs.exe -s -Zomf -Zmap -Zlinker /EXEPACK:2 mapxqs.o mapxqs_vac.o -llibiberty mapxqs.def
+g++ -o mapxqs.exe -s -Zomf -Zmt -Zmap -Zlinker /EXEPACK:2 mapxqs.o mapxqs_scan.o xqszip.o xqsread.o mapxqs_vac.o -llibiberty mapxqs.def
 @IF ERRORLEVEL 1 goto end
 mapxqs mapxqs
+gcc -o xqssrv.exe -s -Zomf -Zmt xqssrv.o xqsread.o xqszip.o
+@IF ERRORLEVEL 1 goto end
+gcc -o xqsload.exe -s -Zomf -Zmt xqsload.o xqsread.o xqsseek.o xqszip.o
+@IF ERRORLEVEL 1 goto end
 @rem
 @rem --------------------------------------------------------------------------
 :end
@@ -26,7 +26,8 @@
 /*  mapxqs.c - v1.04a
  *
  *  MapXQS creates symbol files in the XQS format using mapfiles created
- *  by IBM, GCC, OpenWatcom, and Borland linkers.  By default, XQS files
+ *  by IBM, GCC, OpenWatcom, Borland, and GNU ld linkers, or directly from
+ *  the symbol table of an ELF executable or object.  By default, XQS files
  *  identify which module contains a given symbol (assuming the mapfile
  *  provided that info);  the 'M' commandline option will omit this info.
  *
@@ -56,15 +57,20 @@
 #include <io.h>
 #include <sys\types.h>
 #include <sys\stat.h>
+#include <process.h>
+#include <assert.h>
 
 #define INCL_DOS
 #include <os2.h>
 
 #include "mapxqs_demangle.h"
+#include "mapxqs_scan.h"
 
 #define INCL_LOADEXCEPTQ
 #include "exceptq.h"
 #include "xqs.h"
+#include "xqszip.h"
+#include "xqsread.h"
 
 /*****************************************************************************/
 
@@ -77,6 +83,18 @@
 #define OPT_DUMP          0x08
 #define OPT_GCC           0x10
 #define OPT_VAC           0x20
+#define OPT_THREADS       0x40
+#define OPT_STATS         0x80
+#define OPT_CACHE         0x100
+#define OPT_ZIP           0x200
+#define OPT_FRONT         0x400
+#define OPT_POOL          0x800
+#define OPT_PACK          0x1000
+#define OPT_INDEX         0x2000
+#define OPT_NAMEHASH      0x4000
+#define OPT_QUERY         0x8000
+#define OPT_RESOLVE       0x10000
+#define OPT_SEGDIR        0x20000
 
 #define REMAP_END         0
 #define REMAP_MOD         0x0001
@@ -100,16 +118,213 @@
 #define REMAP_DUP2        0x40000000
 #define REMAP_DUP         0x80000000
 
+#define PUBS_IBM          1
+#define PUBS_WAT          2
+#define PUBS_BOR          3
+
+#define GNU_NONE          0
+#define GNU_OUTPUT        1
+#define GNU_INPUT         2
+
+#define ELF_SHT_SYMTAB    2
+#define ELF_SHT_DYNSYM    11
+#define ELF_SHN_LORESERVE 0xFF00
+#define ELF_STT_NOTYPE    0
+#define ELF_STT_OBJECT    1
+#define ELF_STT_FUNC      2
+#define ELF_STT_IFUNC     10
+
+#define MAX_THREADS       16
+#define MIN_CHUNK         0x10000
+#define CB_THREADSTACK    0x100000
+#define CB_ARENABLK       0x100000
+#define CB_FLAGNAME       32
+#define CB_MAPBUF         0x400000
+#define CB_MAPPAD         64
+#define CB_DMCACHE        0x400000
+#define CB_DMCACHEMIN     0x1000
+#define MAX_SORTRUNS      16
+#define CNT_ZIPBLKSYM     128
+#define CNT_PACKBLKSYM    32
+#define INDEX_SHIFT       12
+
+#ifndef QSV_NUMPROCESSORS
+#define QSV_NUMPROCESSORS 26
+#endif
+
+/* A symbol or module parsed from the map.  hash is only set for IBM
+ * publics, which are checked for duplicates:  it's the hash of the name
+ * as it appears in the mapfile, before demangling.  offsPool is the
+ * offset of a symbol's name in the string pool and is set by PoolNames().
+ */
+
 typedef struct _remap {
     struct _remap*  next;
     ULONG   type;
     ULONG   seg;
     ULONG   offs;
     struct _remap*  mod;
+    ULONG   hash;
+    ULONG   offsPool;
     ULONG   lth;
     char    text[1];
 } REMAP;
 
+/* An open-addressing hash set of IBM publics keyed on seg, offs, type,
+ * & name.  Entries are located using a hash of the mapfile's name, so a
+ * symbol can be probed for before it's demangled;  the demangled names
+ * are only compared when seg, offs, & that hash all match.  The nbr of slots is a power of 2
+ * and is kept at least twice the nbr of entries.
+ */
+
+typedef struct _pubset {
+    ULONG   mask;
+    ULONG   cnt;
+    REMAP** aRec;
+} PUBSET;
+
+/* Demangled names are cached by each thread in a single block whose size
+ * is fixed when it's first used.  The start of the block holds the hash
+ * buckets, the rest holds entries, each of which contains the mangled
+ * name followed by its demangled text.  When the block is full, the
+ * cache is emptied & refilled.  cbText is zero if the name couldn't be
+ * demangled.
+ */
+
+typedef struct _dmentry {
+    struct _dmentry*  next;
+    ULONG   hash;
+    ULONG   flags;
+    ULONG   cbKey;
+    ULONG   cbText;
+    char    data[1];
+} DMENTRY;
+
+typedef struct _dmcache {
+    ULONG   cbMax;
+    ULONG   mask;
+    DMENTRY** aBucket;
+    char *  pBuf;
+    char *  pCur;
+    char *  pEnd;
+    ULONG   cntHit;
+    ULONG   cntMiss;
+    ULONG   cntFlush;
+} DMCACHE;
+
+/* SortByAddress() sorts these rather than the entries themselves.  The
+ * key packs an entry's seg, offs, & type (8, 32, & 4 bits) so one
+ * comparison replaces three;  'ndx' is the entry's original position.
+ */
+
+typedef struct _sortkey {
+    unsigned long long  key;
+    REMAP * pRec;
+    ULONG   ndx;
+} SORTKEY;
+
+/* WriteSegs() computes the position of everything in each segment before
+ * any of it is stored, so the segments can be stored in any order.
+ */
+
+typedef struct _seglayout {
+    REMAP** pStart;
+    REMAP** pStop;
+    ULONG   offsSeg;
+    ULONG   offsHdr;
+    ULONG   offsStrings;
+    ULONG   padSym;
+    ULONG   padStrings;
+    ULONG   cbStrings;
+    char *  pData;
+    ULONG   cbData;
+    ULONG   cbNames;
+    int     fFront;
+    int     fPack;
+    ULONG   cbIndex;
+    XQINDEX xqIndex;
+    XQSEG   xqSeg;
+} SEGLAYOUT;
+
+/* ResolveXQS() sorts the addresses it reads by seg & offs;  'ndx' is
+ * an address's position in the input.
+ */
+
+typedef struct _addrq {
+    ULONG   offs;
+    USHORT  seg;
+    USHORT  unused;
+    ULONG   ndx;
+} ADDRQ;
+
+/* a range of segments stored (or compressed) by one thread */
+
+typedef struct _segwork {
+    int     tid;
+    void    (*pfn)(struct _seglayout*);
+    SEGLAYOUT*  pFirst;
+    SEGLAYOUT*  pStop;
+} SEGWORK;
+
+/* The output buffer that the GCC demangler's callback appends to. */
+
+typedef struct _dmout {
+    char *  pBuf;
+    ULONG   cbBuf;
+    ULONG   cb;
+} DMOUT;
+
+/* Entries are stored in a chain of blocks that are allocated as needed.
+ * The first bytes of each block point at the next block.  pFirst is the
+ * start of the list:  if nothing has been stored yet, it's the end marker.
+ */
+
+typedef struct _arena {
+    char *  pFirstBlk;
+    char *  pBlk;
+    char *  pCur;
+    char *  pEnd;
+    REMAP * pFirst;
+    REMAP * pLast;
+    ULONG   cntBlk;
+    ULONG   cbAlloc;
+    ULONG   cbUsed;
+} ARENA;
+
+/* ParseElf() reads the entire file, then locates its sections using
+ * the header table.  'fBE' identifies big-endian files.
+ */
+
+typedef struct _elffile {
+    char *  pData;
+    ULONG   cbData;
+    int     f64;
+    int     fBE;
+    char *  pShdr;
+    ULONG   cbShdr;
+    ULONG   cntShdr;
+} ELFFILE;
+
+/* Each thread used by StorePublicsMT() parses one chunk of a publics
+ * listing into its own arena.  'line' is the nbr of the line that
+ * precedes the chunk.  'rMod' is the Watcom module in effect, if any.
+ */
+
+typedef struct _chunk {
+    int     fmt;
+    int     tid;
+    char *  pStart;
+    char *  pEnd;
+    int     line;
+    int     recCnt;
+    int     modCnt;
+    int     failed;
+    REMAP * rMod;
+    DMCACHE*  pCache;
+    ARENA   arena;
+    char    workBuf[1024];
+} CHUNK;
+
 /*****************************************************************************/
 
 int     ParseArgs(int argc, char* argv[]);
@@ -117,51 +332,143 @@ int     Init(void);
 int     LoadVacDemangler(void);
 
 int     ParseInput(void);
+int     OpenMap(char* pszFile);
+void    CloseMap(void);
+int     FillMap(void);
+char *  GetLine(void);
+char *  NextLine(char** ppCur, char* pEnd);
 char*   ParseModules(void);
 int     ParseWatcom(void);
 int     WatStorePublics(void);
+int     WatParseLine(char* pLine, REMAP* r, REMAP** prMod, char* pWork,
+                     int line, DMCACHE* pdc);
+int     WatParsePublic(char* pAddr, char* pSym, REMAP* r, REMAP* rMod,
+                       char* pWork, int line, DMCACHE* pdc);
 int     WatParseModule(char* pData, REMAP* r);
 int     ParseBorland(void);
 int     BorStoreModules(void);
 int     BorStorePublics(void);
+int     BorParsePublic(char* ptr, REMAP* r, int line);
 int     ParseSyn(void);
+int     ParseGnu(void);
+int     GnuParseSection(char* ptr, ULONG* pSeg, int* pfUsed);
+int     GnuStoreModule(char* ptr, ULONG seg);
+int     GnuParsePublic(char* ptr, REMAP* r, ULONG seg, ULONG* pcntSkip);
+int     ParseElf(void);
+int     ElfReadAll(void);
+int     ElfSection(ELFFILE* pef, ULONG ndx, ULONG* pType, char** ppSec,
+                   ULONG* pcbSec, ULONG* pLink, ULONG* pcbEntry);
+unsigned long long  ElfGet(ELFFILE* pef, char* ptr, int cb);
 int     ParseIBM(void);
 int     IbmParseSegment(char* pData, ULONG* pSeg, ULONG* pOffs);
 int     IbmStoreModule(char* pData, ULONG ulSeg, ULONG ulOffs);
 int     IbmStorePublics(void);
-int     IbmMarkDuplicateMods(char* pMods, int modCnt);
+int     IbmParsePublic(char* ptr, REMAP* r, char* pWork, int line,
+                       PUBSET* pSet, DMCACHE* pdc);
+int     IbmMarkDuplicateMods(REMAP* pMods, int modCnt);
 int     IbmDuplicateModSorter(const void* key, const void* element);
-int     IbmMarkDuplicatePubs(char* pPublics, int pubCnt);
-int     IbmDuplicatePubSorter(const void* key, const void* element);
-
-char ** SeekToHdr(char** pSeek, char** pStop);
+int     IbmMarkDuplicatePubs(REMAP* pPublics, int pubCnt);
+REMAP** IbmFindPub(PUBSET* ps, REMAP* r);
+int     IbmProbePub(PUBSET* ps, REMAP* r);
+int     IbmAddPub(PUBSET* ps, REMAP* r);
+int     IbmSizePubSet(PUBSET* ps, ULONG cnt);
+void    IbmFreePubSet(PUBSET* ps);
+
+int     StorePublicsMT(int fmt);
+int     ParseChunks(int fmt, char* pStart, char* pEnd, int cntChunk,
+                    int line, REMAP** prMod);
+char *  ScanPublics(int fmt, int fFirst, char** ppStart, int* pSkip, int* pCnt);
+char *  SplitPublics(int fmt, char* ptr, char* pEnd);
+void    ParseChunk(void* pv);
+
+int     InitArena(ARENA* pa);
+int     NewBlock(ARENA* pa, ULONG cbNeed);
+REMAP * NewRec(ARENA* pa, ULONG cbLine);
+void    AddRec(ARENA* pa, REMAP* r);
+void    JoinArena(ARENA* pa, ARENA* pAdd);
+void    FreeArena(ARENA* pa);
+
+char ** SeekToHdr(char** pSeek, char** pStop, char** pStop2);
 int     MatchArray(char** pArray, char* pText);
 char *  Trim(char* pTrim, char** ppNext);
 char *  TrimLine(char* pTrim);
 char *  DecodeFlagName(ULONG flags);
-char *  Demangle(char* pIn, char* pOut, ULONG cbOut, ULONG* pFlags);
+ULONG   HashName(char* pName, int cb);
+char *  Demangle(char* pIn, char* pOut, ULONG cbOut, ULONG* pFlags,
+                 DMCACHE* pdc);
+char *  DemangleGCC(char* pIn, char* pOut, ULONG cbOut, ULONG* pFlags);
+void    ConvertDemangled(char* pOut, ULONG cb, ULONG* pFlags);
+void    StripTemplateArgs(char* pOut, char* pSrc);
+int     StripArgs(char* pName);
+void    StripReturnType(char* pName);
+DMENTRY * FindDemangled(DMCACHE* pdc, char* pKey, ULONG cbKey, ULONG hash);
+void    CacheDemangled(DMCACHE* pdc, char* pKey, ULONG cbKey, ULONG hash,
+                       char* pText, ULONG flags);
+int     InitDemangleCache(DMCACHE* pdc);
+void    FreeDemangleCache(DMCACHE* pdc);
 void    DemangleCallback(const char* pSrc, size_t cbSrc, void* pv);
 char*   DemangleVAC(char* pIn, char* pOut, ULONG* pFlags);
 
 int     WriteOutput(void);
 REMAP** SortByAddress(void);
 int     AddressSorter(const void *key, const void *element);
+int     SortKeysByAddress(REMAP** pr, int cnt);
+SORTKEY * MergeKeyRuns(SORTKEY* pSrc, SORTKEY* pDst, int* aRun, int cntRun);
+SORTKEY * RadixSortKeys(SORTKEY* pSrc, SORTKEY* pDst, int cnt);
+int     NameSorter(const void *key, const void *element);
 int     PrintListing(REMAP** pr);
+int     PoolNames(REMAP** pArr);
+int     AllocImage(REMAP** pArr);
+ULONG   PutImage(ULONG offs, void* pData, ULONG cb);
 int     WriteHeader(REMAP** pArr);
-int     WriteMods(REMAP** pArr, ULONG offs, ULONG offsEnd, ULONG padMods);
+void    WriteMods(REMAP** pArr, ULONG offs, ULONG offsEnd, ULONG padMods);
+void    WritePool(REMAP** pArr);
+ULONG   ZipMods(REMAP** pArr, ULONG offsMod);
 int     WriteSegs(REMAP** pArr);
-int     WriteSyms(REMAP** pStart, REMAP** pStop, ULONG offsStrings,
-                  ULONG padSym, ULONG padStrings);
-
+int     LayoutSegs(REMAP** pArr);
+ULONG   LayoutDir(REMAP** pArr);
+ULONG   LayoutIndex(SEGLAYOUT* pl);
+void    WriteSegsMT(int cntSeg, void (*pfn)(SEGLAYOUT*));
+void    WriteSegRange(void* pv);
+void    WriteSyms(SEGLAYOUT* pl);
+ULONG   MaxSymBlock(ULONG cntSym, ULONG cbStrings);
+ULONG   FrontSize(REMAP** pStart, REMAP** pStop);
+ULONG   StoreSymBlock(REMAP** pStart, REMAP** pStop, ULONG cntSym,
+                      int fFront, char* pOut, ULONG* pcbNames);
+void    FrontSyms(SEGLAYOUT* pl);
+void    PackSyms(SEGLAYOUT* pl);
+void    ZipSyms(SEGLAYOUT* pl);
+void    ZipSymBlocks(SEGLAYOUT* pl, int fFront);
+int     PlaceSegs(int cntSeg);
+ULONG   StoreIndex(SEGLAYOUT* pl);
+int     WriteNameIndex(int cntSeg);
+int     NameIndexSorter(const void *key, const void *element);
+
+int     ReadXQS(void);
 int     DumpXQS(void);
+ULONG   CheckSegDir(XQFILE* xqFile);
+int     DumpZipSeg(FILE* fl, XQSEG* xqSeg, char* pMods, ULONG offsMods,
+                   ULONG cbMods, ULONG* pLastMod, ULONG* pMaxMod);
+int     DumpPackSeg(FILE* fl, XQSEG* xqSeg, char* pMods, ULONG offsMods,
+                    ULONG cbMods, ULONG* pLastMod, ULONG* pMaxMod);
+void    DumpSyms(FILE* fl, XQSEG* xqSeg, char* pSym, ULONG cntSym,
+                 char* pNames, ULONG cbNames, char* pMods, ULONG offsMods,
+                 ULONG cbMods, ULONG* pLastMod, ULONG* pMaxMod);
+int     CheckIndex(XQSEG* xqSeg);
+XQZIP * GetZipHdr(XQSEG* xqSeg);
+XQPACK* GetPackHdr(XQSEG* xqSeg);
+int     OpenXQS(XQSREAD* pxr);
+int     QueryXQS(void);
+int     ResolveXQS(void);
+int     ResolveSorter(const void *key, const void *element);
+int     ParseAddr(char* pLine, USHORT* pSeg, ULONG* pOffs);
+void    PrintStats(void);
 
 /*****************************************************************************/
 
 /** globals **/
-FILE *  fi = 0;
-FILE *  fo = 0;
+int     hOut = -1;
 char *  buffer = 0;
-ULONG   cbBuffer = 0;
 ULONG   cbFile = 0;
 
 int     opts = 0;
@@ -170,17 +477,55 @@ int     isIbm = 0;
 int     isWat = 0;
 int     isBor = 0;
 int     isSyn = 0;
+int     isElf = 0;
+int     isGnu = 0;
 int     cntMods = 0;
 int     cbXQSYM = 0;
+int     cntThreads = 1;
 
-char *  pCur = 0;
+ARENA   arena;
 int     recCnt = 0;
+PUBSET  pubSet;
+ULONG   cbDmCache = CB_DMCACHE;
+DMCACHE aDmCache[MAX_THREADS];
+int     cntSortRuns = 0;
+
+char *  pImg = 0;
+ULONG   cbImg = 0;
+ULONG   offsImg = 0;
+SEGLAYOUT aLayout[256];
+ULONG   cbZipRaw = 0;
+ULONG   cbZipStored = 0;
+ULONG   cbNamesRaw = 0;
+ULONG   cbNamesStored = 0;
+ULONG   offsPool = 0;
+ULONG   cbPool = 0;
+XQSEGDIR  xqDir;
+ULONG   cbDir = 0;
+ULONG   offsDirSeg = 0;
+ULONG   cbPoolRaw = 0;
+ULONG   cntPoolNames = 0;
+ULONG   cbPackRaw = 0;
+ULONG   cbPackStored = 0;
+ULONG * aDumpAddr = 0;
+ULONG   cntDumpAddr = 0;
+
+int     hMap = -1;
+int     fMapEOF = 0;
+int     fMapErr = 0;
+ULONG   cbMap = 0;
+char *  pMap = 0;
+char *  pMapCur = 0;
+char *  pMapLast = 0;
+char *  pMapEnd = 0;
+char *  pszMapFile = 0;
 
 char    fIn[CCHMAXPATH] = "";
 char    fOut[CCHMAXPATH] = "";
 char    fList[CCHMAXPATH] = "";
+char    fAddr[CCHMAXPATH] = "";
+char    szQuery[1024] = "";
 
-char    bufIn[1024];
 char    workBuf[1024];
 
 /* these pointers are declared in remap_vac.c */
@@ -199,8 +544,6 @@ char *  pszWS = " \t\r\n";
 char *  pszTrouble = "$w$";
 char *  pszModule = "Module:";
 
-char    aPad[16] = {0};
-
 char    szAtOffset[] = "at offset ";
 int     cbAtOffset = sizeof(szAtOffset) - 1;
 
@@ -234,6 +577,9 @@ char *  apszWatMemMap[] = {"Address", "Symbol", ""};
 
 char *  apszBorSegments[] = {"Detailed map of segments", ""};
 
+char *  apszGnuMemMap[] = {"Linker script and memory map", ""};
+char *  apszGnuCref[] = {"Cross Reference Table", ""};
+
 char *  pszSrcExt  = ".map";
 char *  pszOutExt  = ".xqs";
 char *  pszListExt = ".xql";
@@ -252,19 +598,37 @@ char *  pszColumnHdr =
 
 char *  pszHelp =
       "\n mapxqs v1.04a - (C)2010-2011  R L Walsh\n"
-        " Creates .xqs symbol files from IBM, Watcom, and Borland .map files.\n\n"
+        " Creates .xqs symbol files from IBM, Watcom, Borland, and GNU ld .map files\n"
+        " or from the symbol table of an ELF executable or object.\n\n"
         " Usage:  mapxqs [-options] [optional_files] mapfile[.map]\n"
+        "         if -o is used, mapfile can be '-' (stdin) or a named pipe\n"
         " General options:\n"
         "   -o  specify output file             (default: *.xqs)\n"
         "   -l  create a listing of symbols     (default: *.xql)\n"
         "   -m  omit module file names          (default: include module info)\n"
+        "   -t  parse using multiple threads    (GCC demangler only)\n"
+        "   -s  show statistics\n"
+        "   -z  compress symbols & module names\n"
+        "   -f  front-code symbol names\n"
+        "   -p  store identical symbol names once\n"
+        "   -k  pack symbol tables\n"
+        "   -i  add an address index to each segment\n"
+        "   -a  add a name index (see -q)\n"
+        "   -x  put segment headers in a directory at the start of the file\n"
         " Demangler options:\n"
         "   -g  use builtin GCC demangler       (default)\n"
         "   -v  use VAC demangler               (requires demangl.dll)\n"
         "   -n  don't demangle symbols\n"
+        "   -c  GCC demangler cache size in KB  (default: -c4096  none: -c0)\n"
         " Other options:\n"
         "   -d  dump symbols in *.xqs to *.xql  (example: mapxqs -d file.xqs)\n"
         "       note: -o is the only option that can be used with -d\n"
+        "   -q  find a symbol by name           (example: mapxqs -q name file.xqs)\n"
+        "       note: the .xqs file must have been created using -a\n"
+        "   -r  find the symbols for a list of seg:offset addresses\n"
+        "       (example: mapxqs -r trap.txt file.xqs)\n"
+        "       note: the list can be '-' (stdin);  the first address on\n"
+        "       each line is used\n"
         "\n";
 
 /*****************************************************************************/
@@ -273,6 +637,7 @@ int     main(int argc, char* argv[])
 {
   EXCEPTIONREGISTRATIONRECORD ExRegRec;
   int     xq;
+  int     ctr;
   int     rtn = 1;
 
 do {
@@ -286,6 +651,18 @@ do {
     break;
   }
 
+  if (opts & OPT_QUERY) {
+    if (QueryXQS())
+      rtn = 0;
+    break;
+  }
+
+  if (opts & OPT_RESOLVE) {
+    if (ResolveXQS())
+      rtn = 0;
+    break;
+  }
+
   if (opts & OPT_DUMP) {
     if (DumpXQS())
       rtn = 0;
@@ -298,11 +675,19 @@ do {
   if (WriteOutput())
     rtn = 0;
 
+  if (opts & OPT_STATS)
+    PrintStats();
+
 } while (0);
 
   if (buffer)
     free(buffer);
 
+  FreeArena(&arena);
+
+  for (ctr = 0; ctr < MAX_THREADS; ctr++)
+    FreeDemangleCache(&aDmCache[ctr]);
+
   if (xq)
     UninstallExceptq(&ExRegRec);
 
@@ -320,6 +705,8 @@ int     ParseArgs(int argc, char* argv[])
   int     ctr;
   int     needInfile = 1;
   int     needOutfile = 0;
+  int     needQuery = 0;
+  int     needAddr = 0;
   char *  ptr;
 
   if (argc < 2) {
@@ -329,7 +716,8 @@ int     ParseArgs(int argc, char* argv[])
 
   for (ctr = 1; ctr < argc; ctr++) {
 
-    if (*argv[ctr] == '-' || *argv[ctr] == '/') {
+    /* a lone '-' is stdin, not an option */
+    if ((*argv[ctr] == '-' || *argv[ctr] == '/') && argv[ctr][1]) {
       ptr = argv[ctr];
 
       while (*(++ptr)) {
@@ -366,6 +754,77 @@ int     ParseArgs(int argc, char* argv[])
             opts |= OPT_VAC;
             break;
 
+          case 't':
+          case 'T':
+            opts |= OPT_THREADS;
+            break;
+
+          case 's':
+          case 'S':
+            opts |= OPT_STATS;
+            break;
+
+          case 'z':
+          case 'Z':
+            opts |= OPT_ZIP;
+            break;
+
+          case 'f':
+          case 'F':
+            opts |= OPT_FRONT;
+            break;
+
+          case 'p':
+          case 'P':
+            opts |= OPT_POOL;
+            break;
+
+          case 'k':
+          case 'K':
+            opts |= OPT_PACK;
+            break;
+
+          case 'i':
+          case 'I':
+            opts |= OPT_INDEX;
+            break;
+
+          case 'a':
+          case 'A':
+            opts |= OPT_NAMEHASH;
+            break;
+
+          case 'x':
+          case 'X':
+            opts |= OPT_SEGDIR;
+            break;
+
+          case 'q':
+          case 'Q':
+            opts |= OPT_QUERY;
+            needQuery = 1;
+            break;
+
+          case 'r':
+          case 'R':
+            opts |= OPT_RESOLVE;
+            needAddr = 1;
+            break;
+
+          /* the size immediately follows the option;  it's required
+           * so a bare '-c' can't turn the cache off by accident
+           */
+          case 'c':
+          case 'C':
+            if (!isdigit((UCHAR)ptr[1])) {
+              fprintf(stderr, "Option '-c' requires a size in KB (example: -c4096, or -c0 for none)\n");
+              return 0;
+            }
+            opts |= OPT_CACHE;
+            cbDmCache = strtoul(ptr + 1, &ptr, 10) * 1024;
+            ptr--;
+            break;
+
           case 'o':
           case 'O':
             needOutfile = 1;
@@ -391,6 +850,14 @@ int     ParseArgs(int argc, char* argv[])
       strcpy(fOut, argv[ctr]);
       needOutfile = 0;
     } else
+    if (needQuery) {
+      strncpy(szQuery, argv[ctr], sizeof(szQuery) - 1);
+      needQuery = 0;
+    } else
+    if (needAddr) {
+      strcpy(fAddr, argv[ctr]);
+      needAddr = 0;
+    } else
     if (needInfile) {
       strcpy(fIn, argv[ctr]);
       needInfile = 0;
@@ -401,20 +868,58 @@ int     ParseArgs(int argc, char* argv[])
   } /* for */
 
   if ((opts & OPT_DUMP) &&
-      (opts & (OPT_LIST | OPT_NOMOD | OPT_NO_DEMANGLE | OPT_GCC | OPT_VAC))) {
+      (opts & (OPT_LIST | OPT_NOMOD | OPT_NO_DEMANGLE | OPT_GCC | OPT_VAC |
+               OPT_THREADS | OPT_STATS | OPT_CACHE | OPT_ZIP | OPT_FRONT |
+               OPT_POOL | OPT_PACK | OPT_INDEX | OPT_NAMEHASH | OPT_QUERY |
+               OPT_RESOLVE | OPT_SEGDIR))) {
     fprintf(stderr, "Option '-d' (dump) may only be combined with '-o' (output file)\n");
     return 0;
   }
 
-  if (needInfile || needOutfile) {
+  if ((opts & OPT_QUERY) && (opts & ~OPT_QUERY)) {
+    fprintf(stderr, "Option '-q' (query) can't be combined with other options\n");
+    return 0;
+  }
+
+  if ((opts & OPT_RESOLVE) && (opts & ~OPT_RESOLVE)) {
+    fprintf(stderr, "Option '-r' (resolve) can't be combined with other options\n");
+    return 0;
+  }
+
+  if (needInfile || needOutfile || needQuery || needAddr) {
     fprintf(stderr, "Missing argument for %s\n",
-            (needOutfile ? "output file" : ((opts & OPT_DUMP) ? "xqs file" : "map file")));
+            (needOutfile ? "output file" : (needQuery ? "symbol name" :
+            (needAddr ? "address list" :
+            ((opts & (OPT_DUMP | OPT_QUERY | OPT_RESOLVE)) ?
+             "xqs file" : "map file")))));
     return 0;
   }
 
+  /* queries read the .xqs file the same way a dump does */
+  if (opts & (OPT_QUERY | OPT_RESOLVE))
+    opts |= OPT_DUMP;
+
   if (!(opts & (OPT_GCC | OPT_VAC | OPT_DUMP)))
     opts |= OPT_GCC;
 
+  /* demangl.dll may not be reentrant, so it's only used from one thread */
+  if ((opts & (OPT_THREADS | OPT_VAC)) == (OPT_THREADS | OPT_VAC)) {
+    fprintf(stderr, "Option '-t' can't be used with '-v' - ignored...\n");
+    opts &= ~OPT_THREADS;
+  }
+
+  /* pooled names are outside the segments, so they can't be coded with them */
+  if ((opts & OPT_POOL) && (opts & (OPT_ZIP | OPT_FRONT))) {
+    fprintf(stderr, "Option '-p' can't be used with '-z' or '-f' - ignored...\n");
+    opts &= ~OPT_POOL;
+  }
+
+  /* compressed blocks have their own layout */
+  if ((opts & (OPT_PACK | OPT_ZIP)) == (OPT_PACK | OPT_ZIP)) {
+    fprintf(stderr, "Option '-k' can't be used with '-z' - ignored...\n");
+    opts &= ~OPT_PACK;
+  }
+
   return 1;
 }
 
@@ -422,6 +927,7 @@ int     ParseArgs(int argc, char* argv[])
 
 int     Init(void)
 {
+  int     fStream = 0;
   char *  ptr;
   char    szFile[CCHMAXPATH];
 
@@ -432,19 +938,40 @@ int     Init(void)
     return 0;
   }
 
-  /* Add the appropriate extension if needed. */
-  ptr = strrchr(fIn, '.');
-  if (!ptr) {
-    ptr = strchr(fIn, 0);
-    strcpy(ptr, (opts & OPT_DUMP) ? pszOutExt : pszSrcExt);
+  /* A mapfile read from stdin or a named pipe has no size or path,
+   * and it can't supply a name for the output file.
+   */
+  if (!strcmp(fIn, "-") || !strnicmp(fIn, "\\PIPE\\", 6)) {
+    if (opts & OPT_DUMP) {
+      fprintf(stderr, "option '-d' requires an .xqs file, not a pipe\n");
+      return 0;
+    }
+    if (!*fOut) {
+      fprintf(stderr, "an output file must be specified when reading from a pipe\n");
+      return 0;
+    }
+    fStream = 1;
   }
 
-  /* Fully qualify the input file name. */
-  if (DosQueryPathInfo(fIn, FIL_QUERYFULLNAME, szFile, sizeof(szFile))) {
-    fprintf(stderr, "invalid input filename or path - '%s'\n", fIn);
-    return 0;
+  if (!fStream) {
+    /* Add the appropriate extension if needed.  ELF executables usually
+     * don't have one, so if there's no mapfile, use the name as-is.
+     */
+    ptr = strrchr(fIn, '.');
+    if (!ptr) {
+      ptr = strchr(fIn, 0);
+      strcpy(ptr, (opts & OPT_DUMP) ? pszOutExt : pszSrcExt);
+      if (!(opts & OPT_DUMP) && access(fIn, 0))
+        *ptr = 0;
+    }
+
+    /* Fully qualify the input file name. */
+    if (DosQueryPathInfo(fIn, FIL_QUERYFULLNAME, szFile, sizeof(szFile))) {
+      fprintf(stderr, "invalid input filename or path - '%s'\n", fIn);
+      return 0;
+    }
+    strcpy(fIn, szFile);
   }
-  strcpy(fIn, szFile);
 
   /* Create/validate output filename */
   if (!*fOut) {
@@ -496,22 +1023,35 @@ int     Init(void)
     }
   }
 
-  /* confirm the input file exists & get its size */
-  if (DosQueryPathInfo(fIn, FIL_STANDARD, szFile, sizeof(szFile))) {
-    fprintf(stderr, "unable to find input file '%s'\n", fIn);
-    return 0;
+  /* confirm the input file exists & get its size (only -d needs it) */
+  if (!fStream) {
+    if (DosQueryPathInfo(fIn, FIL_STANDARD, szFile, sizeof(szFile))) {
+      fprintf(stderr, "unable to find input file '%s'\n", fIn);
+      return 0;
+    }
+    cbFile = ((FILESTATUS3*)szFile)->cbFile;
   }
-  cbFile = ((FILESTATUS3*)szFile)->cbFile;
-  cbBuffer = (cbFile * 3) / 2;
 
-  /* allocate a buffer as large as the file to store entries */
-  buffer = malloc(cbBuffer);
-  if (!buffer) {
-    fprintf(stderr, "malloc for main buffer failed - size= %ld\n", cbBuffer);
+  /* entries are stored in blocks that are added as needed */
+  if (!(opts & OPT_DUMP) && !InitArena(&arena))
     return 0;
+
+  /* use one thread per processor to parse symbols if requested */
+  if (opts & OPT_THREADS) {
+    ULONG   cnt;
+
+    if (!DosQuerySysInfo(QSV_NUMPROCESSORS, QSV_NUMPROCESSORS,
+                         &cnt, sizeof(cnt)) && cnt > 1)
+      cntThreads = (cnt > MAX_THREADS) ? MAX_THREADS : cnt;
+  }
+
+  /* each thread gets an equal share of the demangler cache */
+  if (!(opts & (OPT_NO_DEMANGLE | OPT_VAC))) {
+    ULONG   ctr;
+
+    for (ctr = 0; ctr < cntThreads; ctr++)
+      aDmCache[ctr].cbMax = cbDmCache / cntThreads;
   }
-  memset(buffer, 0, cbBuffer);
-  pCur = buffer;
 
   return 1;
 }
@@ -565,15 +1105,22 @@ int     ParseInput(void)
   char *  ptr;
   char ** pSeek;
 
-  fi = fopen(fIn, "r");
-  if (!fi) {
-    fprintf(stderr, "unable to open input file '%s'\n", fIn);
+  if (!OpenMap(fIn))
     return 0;
-  }
 
 do {
-  /* Look for either an IBM-style Modules header or Watcom's Segment header. */
-  pSeek = SeekToHdr(apszModules, apszWatSegments);
+  /* An ELF executable or object is identified by its signature. */
+  if (FillMap() && pMapEnd - pMapCur >= 4 &&
+      !memcmp(pMapCur, "\177ELF", 4)) {
+    isElf = 1;
+    rtn = ParseElf();
+    break;
+  }
+
+  /* Look for an IBM-style Modules header, Watcom's Segment header,
+   * or the start of GNU ld's memory map.
+   */
+  pSeek = SeekToHdr(apszModules, apszWatSegments, apszGnuMemMap);
 
   /* Found Watcom */
   if (pSeek == apszWatSegments) {
@@ -582,6 +1129,13 @@ do {
     break;
   }
 
+  /* Found GNU ld */
+  if (pSeek == apszGnuMemMap) {
+    isGnu = 1;
+    rtn = ParseGnu();
+    break;
+  }
+
   /* If the Modules header wasn't found, we can't identify the format. */
   if (pSeek != apszModules) {
     fprintf(stderr, "Unable to identify mapfile format (missing modules header)\n");
@@ -635,11 +1189,195 @@ do {
 
 } while (0);
 
-  fclose(fi);
+  /* a read error may have looked like the end of the file */
+  if (fMapErr)
+    rtn = 0;
+
+  CloseMap();
 
   return rtn;
 }
 
+/*****************************************************************************/
+/* The mapfile is read through a fixed-size buffer, so its size needn't
+ * be known & it can come from stdin or a pipe.  GetLine() hands out each
+ * line in-place:  the newline (and any preceding CR) is replaced with a
+ * null, so the parsers see the same text fgets() used to give them
+ * without it having to be copied into a line buffer first.  The parsers
+ * are free to trim or modify the line since it's our copy, but it's only
+ * valid until the buffer is refilled.  Nothing that's stored refers to it.
+ */
+
+int     OpenMap(char* pszFile)
+{
+  /* The pad lets a line be null-terminated past the end of the data
+   * and keeps fixed-offset peeks at short lines inside the buffer.
+   */
+  cbMap = CB_MAPBUF;
+  pMap = malloc(cbMap + CB_MAPPAD);
+  if (!pMap) {
+    fprintf(stderr, "malloc for mapfile buffer failed - size= %ld\n",
+            cbMap + CB_MAPPAD);
+    return 0;
+  }
+  memset(&pMap[cbMap], 0, CB_MAPPAD);
+
+  pszMapFile = pszFile;
+  if (!strcmp(pszFile, "-")) {
+    hMap = 0;
+    setmode(hMap, O_BINARY);
+  }
+  else {
+    hMap = open(pszFile, O_RDONLY | O_BINARY, 0);
+    if (hMap < 0) {
+      fprintf(stderr, "unable to open input file '%s'\n", pszFile);
+      CloseMap();
+      return 0;
+    }
+  }
+
+  fMapEOF  = 0;
+  fMapErr  = 0;
+  pMapCur  = pMap;
+  pMapLast = pMap;
+  pMapEnd  = pMap;
+
+  return 1;
+}
+
+/*****************************************************************************/
+
+void    CloseMap(void)
+{
+  if (hMap > 0)
+    close(hMap);
+
+  if (pMap)
+    free(pMap);
+
+  hMap = -1;
+  cbMap = 0;
+  pMap = 0;
+  pMapCur = 0;
+  pMapLast = 0;
+  pMapEnd = 0;
+
+  return;
+}
+
+/*****************************************************************************/
+/* Move whatever hasn't been processed to the start of the buffer, then
+ * fill the rest of it.  pMapLast is set to the end of the last complete
+ * line;  the buffer is only enlarged if it can't hold a single line.  At
+ * the end of the file, the final line is complete whether or not it has
+ * a newline.  This returns zero if there's nothing left to process.
+ */
+
+int     FillMap(void)
+{
+  int     cnt;
+  ULONG   cb;
+  char *  ptr;
+
+  cb = pMapEnd - pMapCur;
+  if (cb && pMapCur != pMap)
+    memmove(pMap, pMapCur, cb);
+  pMapCur = pMap;
+  pMapEnd = pMap + cb;
+
+  while (1) {
+    while (!fMapEOF && pMapEnd < pMap + cbMap) {
+      cnt = read(hMap, pMapEnd, (pMap + cbMap) - pMapEnd);
+      if (cnt <= 0) {
+        if (cnt < 0) {
+          fprintf(stderr, "error reading input file '%s'\n", pszMapFile);
+          fMapErr = 1;
+        }
+        fMapEOF = 1;
+        break;
+      }
+      pMapEnd += cnt;
+    }
+
+    if (fMapEOF) {
+      pMapLast = pMapEnd;
+      break;
+    }
+
+    for (ptr = pMapEnd; ptr > pMapCur && ptr[-1] != '\n'; ptr--)
+      ;
+    if (ptr > pMapCur) {
+      pMapLast = ptr;
+      break;
+    }
+
+    /* A single line fills the buffer, so double its size. */
+    cb = pMapEnd - pMap;
+    ptr = realloc(pMap, cbMap * 2 + CB_MAPPAD);
+    if (!ptr) {
+      fprintf(stderr, "realloc for mapfile buffer failed - size= %ld\n",
+              cbMap * 2 + CB_MAPPAD);
+      fMapErr = 1;
+      fMapEOF = 1;
+      pMapLast = pMapCur = pMapEnd = pMap;
+      return 0;
+    }
+    cbMap *= 2;
+    pMap = ptr;
+    pMapCur = pMap;
+    pMapEnd = pMap + cb;
+    memset(&pMap[cbMap], 0, CB_MAPPAD);
+  }
+
+  return (pMapCur < pMapLast);
+}
+
+/*****************************************************************************/
+/* Return the next line of the mapfile or null at the end of the file. */
+
+char *  GetLine(void)
+{
+  char *  pLine;
+
+  if (pMapCur >= pMapLast && !FillMap())
+    return 0;
+
+  pLine = NextLine(&pMapCur, pMapLast);
+  if (pLine)
+    lineNbr++;
+
+  return pLine;
+}
+
+/*****************************************************************************/
+/* This does the actual work for GetLine() and for the threads that parse
+ * chunks of the file, each of which has its own current position & end.
+ * Note that the character at pEnd is overwritten if the last line doesn't
+ * end with a newline.
+ */
+
+char *  NextLine(char** ppCur, char* pEnd)
+{
+  char *  pLine;
+  char *  ptr;
+
+  pLine = *ppCur;
+  if (pLine >= pEnd)
+    return 0;
+
+  ptr = ScanNewline(pLine, pEnd);
+  if (ptr < pEnd)
+    *ppCur = ptr + 1;
+  else
+    *ppCur = ptr;
+
+  if (ptr > pLine && ptr[-1] == '\r')
+    ptr--;
+  *ptr = 0;
+
+  return pLine;
+}
+
 /*****************************************************************************/
 /* This parses segment info and saves module info */
 
@@ -648,12 +1386,12 @@ char*   ParseModules(void)
   ULONG   seg = 0;
   ULONG   offs = 0;
   char *  ptr;
+  char *  pLine;
   char *  pErr = "unexpected end of file";
 
-  while (fgets(bufIn, sizeof(bufIn), fi)) {
-    lineNbr++;
+  while ((pLine = GetLine()) != 0) {
 
-    ptr = bufIn + strspn(bufIn, pszWS);
+    ptr = ScanSpace(pLine);
 
     if (!*ptr)
       continue;
@@ -691,7 +1429,7 @@ char*   ParseModules(void)
 
 int     ParseWatcom(void)
 {
-  if (!SeekToHdr(apszWatMemMap, 0)) {
+  if (!SeekToHdr(apszWatMemMap, 0, 0)) {
     fprintf(stderr, "Watcom memory map header not found\n");
     return 0;
   }
@@ -708,78 +1446,131 @@ int     WatStorePublics(void)
 {
   int     startCnt = recCnt;
   int     blankOK = 1;
-  char *  ptr;
-  char *  pAddr;
-  char *  pSym;
+  int     rc;
+  char *  pLine;
   REMAP * r;
   REMAP * rMod = 0;
 
-  while (fgets(bufIn, sizeof(bufIn), fi)) {
-    lineNbr++;
+  if (cntThreads > 1 && (rc = StorePublicsMT(PUBS_WAT)) != 0)
+    return (rc > 0 && recCnt > startCnt);
 
-    r = (REMAP*)pCur;
+  while ((pLine = GetLine()) != 0) {
+
+    r = NewRec(&arena, pMapCur - pLine);
+    if (!r)
+      return 0;
 
-    pAddr = Trim(bufIn, &pSym);
-    if (!pAddr || *pAddr == '=') {
+    rc = WatParseLine(pLine, r, &rMod, workBuf, lineNbr, &aDmCache[0]);
+    if (rc < 0) {
       if (blankOK)
         continue;
       break;
     }
     blankOK = 0;
 
-    if (!strcmp(pAddr, "Module:")) {
-      rMod = r;
-      WatParseModule(pSym, r);
+    if (!rc)
       continue;
-    }
+    if (rc == 2)
+      cntMods++;
 
-    r->seg = strtoul(pAddr, &ptr, 16);
-    if (r->seg > 255 || *ptr != ':') {
-      fprintf(stderr, "line %d:  invalid seg address\n", lineNbr);
-      continue;
-    }
+    AddRec(&arena, r);
+    recCnt++;
+  }
 
-    ptr++;
-    ptr[8] = 0;
-    r->offs = strtoul(ptr, 0, 16);
+  return (recCnt > startCnt);
+}
 
-    if (!r->seg && !r->offs)
-      continue;
+/*****************************************************************************/
+/* This parses a single line from the memory map;  it's also used by
+ * StorePublicsMT()'s threads, so it stores nothing in any global.  It
+ * returns -1 for a blank line or underline, 0 if the line should be
+ * skipped, 1 for a symbol, and 2 for a module (which becomes *prMod).
+ */
 
-    if (rMod && !rMod->seg && !rMod->offs) {
-      rMod->seg  = r->seg;
-      rMod->offs = r->offs;
-    }
+int     WatParseLine(char* pLine, REMAP* r, REMAP** prMod, char* pWork,
+                     int line, DMCACHE* pdc)
+{
+  int     cnt;
+  char *  pAddr;
+  char *  pSym = 0;
+  COLSPAN aCol[2];
 
-    pSym = Trim(pSym, 0);
-    if (!pSym) {
-      fprintf(stderr, "line %d:  symbol name not found\n", lineNbr);
-      continue;
-    }
+  cnt = ScanColumns(pLine, aCol, 2);
+  if (!cnt || *aCol[0].ptr == '=')
+    return -1;
 
-    pSym = Demangle(pSym, workBuf, sizeof(workBuf), &r->type);
-    if (!pSym) {
-      fprintf(stderr, "line %d:  demangle failed for symbol name\n", lineNbr);
-      continue;
-    }
+  pAddr = aCol[0].ptr;
+  pAddr[aCol[0].cb] = 0;
 
-    strcpy(r->text, pSym);
-    ptr = DecodeFlagName(r->type);
-    if (*ptr)
-      strcat(r->text, ptr);
-    r->lth = strlen(r->text) + 1;
-    pCur = &r->text[r->lth];
+  /* The module's name is extracted from the rest of the line. */
+  if (!strcmp(pAddr, pszModule)) {
+    *prMod = r;
+    return (WatParseModule((cnt > 1) ? aCol[1].ptr : "", r) ? 2 : 0);
+  }
 
-    r->mod = rMod;
-    r->type |= REMAP_OBJ;
-    r->next = (REMAP*)pCur;
-    recCnt++;
+  if (cnt > 1) {
+    pSym = aCol[1].ptr;
+    pSym[aCol[1].cb] = 0;
   }
 
-  return (recCnt > startCnt);
+  return WatParsePublic(pAddr, pSym, r, *prMod, pWork, line, pdc);
+}
+
+/*****************************************************************************/
+/* This parses a symbol's address & name (which may be null).  If the
+ * current module's address isn't known yet, this symbol's address is
+ * used for it.
+ */
+
+int     WatParsePublic(char* pAddr, char* pSym, REMAP* r, REMAP* rMod,
+                       char* pWork, int line, DMCACHE* pdc)
+{
+  char *  ptr;
+
+  r->seg = strtoul(pAddr, &ptr, 16);
+  if (r->seg > 255 || *ptr != ':') {
+    fprintf(stderr, "line %d:  invalid seg address\n", line);
+    return 0;
+  }
+
+  ptr++;
+  if (strlen(ptr) > 8)
+    ptr[8] = 0;
+  r->offs = strtoul(ptr, 0, 16);
+
+  if (!r->seg && !r->offs)
+    return 0;
+
+  if (rMod && !rMod->seg && !rMod->offs) {
+    rMod->seg  = r->seg;
+    rMod->offs = r->offs;
+  }
+
+  if (!pSym) {
+    fprintf(stderr, "line %d:  symbol name not found\n", line);
+    return 0;
+  }
+
+  pSym = Demangle(pSym, pWork, sizeof(workBuf), &r->type, pdc);
+  if (!pSym) {
+    fprintf(stderr, "line %d:  demangle failed for symbol name\n", line);
+    return 0;
+  }
+
+  strcpy(r->text, pSym);
+  ptr = DecodeFlagName(r->type);
+  if (*ptr)
+    strcat(r->text, ptr);
+  r->lth = strlen(r->text) + 1;
+
+  r->mod = rMod;
+  r->type |= REMAP_OBJ;
+
+  return 1;
 }
 
 /*****************************************************************************/
+/* This fills in a module entry;  the caller has to store it. */
 
 int     WatParseModule(char* pData, REMAP* r)
 {
@@ -809,11 +1600,6 @@ int     WatParseModule(char* pData, REMAP* r)
 
   r->lth  = strlen(pSrc) + 1;
   memcpy(r->text, pSrc, r->lth);
-  pCur = &r->text[r->lth];
-
-  r->next = (REMAP*)pCur;
-  recCnt++;
-  cntMods++;
 
   return 1;
 }
@@ -831,7 +1617,7 @@ int     ParseBorland(void)
     }
     cntMods = recCnt;
 
-    if (!SeekToHdr(apszPubByName, 0)) {
+    if (!SeekToHdr(apszPubByName, 0, 0)) {
       fprintf(stderr, "Unable to find 'Publics by Name' header in Borland mapfile\n");
       return 0;
     }
@@ -842,7 +1628,7 @@ int     ParseBorland(void)
     return 0;
   }
 
-  if (cntMods && !IbmMarkDuplicateMods(buffer, cntMods)) {
+  if (cntMods && !IbmMarkDuplicateMods(arena.pFirst, cntMods)) {
     fprintf(stderr, "IbmMarkDuplicateMods failed\n");
     return 0;
   }
@@ -857,15 +1643,18 @@ int     BorStoreModules(void)
   int     blankOK = 1;
   int     ctr;
   char *  ptr;
+  char *  pLine;
   char *  pEnd;
   REMAP * r;
+  COLSPAN aCol[5];
 
-  while (fgets(bufIn, sizeof(bufIn), fi)) {
-    lineNbr++;
+  while ((pLine = GetLine()) != 0) {
 
-    r = (REMAP*)pCur;
+    r = NewRec(&arena, pMapCur - pLine);
+    if (!r)
+      return 0;
 
-    ptr = TrimLine(bufIn);
+    ptr = TrimLine(pLine);
     if (!ptr) {
       if (!blankOK)
         break;
@@ -887,18 +1676,22 @@ int     BorStoreModules(void)
     if (!r->seg && !r->offs)
       continue;
 
-    ptr = Trim(ptr, &pEnd);
-    if (!ptr) {
+    /* the length is followed by C=, S=, G=, M=, & ACBP= columns */
+    ctr = ScanColumns(ptr, aCol, 5);
+    if (!ctr) {
       fprintf(stderr, "line %d:  malformed/unexpected entry\n", lineNbr);
       continue;
     }
 
     /* Segment length is zero, so there's no associated code or data. */
-    if (!strtoul(ptr, 0, 16))
+    if (!strtoul(aCol[0].ptr, 0, 16))
       continue;
 
-    for (ctr = 0; ctr < 4 && ptr; ctr++)
-      ptr = Trim(pEnd, &pEnd);
+    ptr = 0;
+    if (ctr >= 5) {
+      ptr = aCol[4].ptr;
+      ptr[aCol[4].cb] = 0;
+    }
 
     if (!ptr || ptr[0] != 'M' || ptr[1] != '=') {
       fprintf(stderr, "line %d:  malformed/unexpected entry - %s\n",
@@ -916,9 +1709,8 @@ int     BorStoreModules(void)
 
     r->lth  = strlen(ptr) + 1;
     memcpy(r->text, ptr, r->lth);
-    pCur = &r->text[r->lth];
 
-    r->next = (REMAP*)pCur;
+    AddRec(&arena, r);
     recCnt++;
   }
 
@@ -930,17 +1722,21 @@ int     BorStoreModules(void)
 int     BorStorePublics(void)
 {
   int     blankOK = 1;
-  int     ctr;
   char *  ptr;
-  char *  pEnd;
+  char *  pLine;
+  int     rc;
   REMAP * r;
 
-  while (fgets(bufIn, sizeof(bufIn), fi)) {
-    lineNbr++;
+  if (cntThreads > 1 && (rc = StorePublicsMT(PUBS_BOR)) != 0)
+    return (rc > 0);
 
-    r = (REMAP*)pCur;
+  while ((pLine = GetLine()) != 0) {
 
-    ptr = TrimLine(bufIn);
+    r = NewRec(&arena, pMapCur - pLine);
+    if (!r)
+      return 0;
+
+    ptr = TrimLine(pLine);
     if (!ptr) {
       if (!blankOK)
         break;
@@ -950,59 +1746,342 @@ int     BorStorePublics(void)
     }
     blankOK = 0;
 
-    /* get the segment & offset*/
-    r->seg = strtoul(ptr, &pEnd, 16);
-    if (r->seg > 255 || *pEnd != ':') {
-      fprintf(stderr, "line %d:  invalid segment\n", lineNbr);
+    if (!BorParsePublic(ptr, r, lineNbr))
       continue;
+
+    AddRec(&arena, r);
+    recCnt++;
+  }
+
+  return 1;
+}
+
+/*****************************************************************************/
+/* This parses a single symbol entry that has already been trimmed.
+ * Like WatParsePublic(), it stores nothing in any global.
+ */
+
+int     BorParsePublic(char* ptr, REMAP* r, int line)
+{
+  int     ctr;
+  char *  pEnd;
+
+  /* get the segment & offset*/
+  r->seg = strtoul(ptr, &pEnd, 16);
+  if (r->seg > 255 || *pEnd != ':') {
+    fprintf(stderr, "line %d:  invalid segment\n", line);
+    return 0;
+  }
+  r->offs = strtoul(&pEnd[1], &ptr, 16);
+
+  /* ignore zero entries */
+  if (!r->seg && !r->offs)
+    return 0;
+
+  /* skip over the flags(?) column */
+  ptr = ScanSpace(ptr + 6);
+
+  /* remove 'const' or 'volatile' at the end of a line */
+  ctr = strlen(ptr);
+  if (ptr[ctr-1] == 't' && ctr > 6 && !strcmp(&ptr[ctr-6], " const")) {
+    ctr -= 6;
+    ptr[ctr] = 0;
+  }
+  else
+  if (ptr[ctr-1] == 'v' && ctr > 9 && !strcmp(&ptr[ctr-9], " volatile")) {
+    ctr -= 9;
+    ptr[ctr] = 0;
+  }
+
+  /* remove method arguments */
+  if (ptr[ctr-1] == ')') {
+    int cnt;
+    for (pEnd = &ptr[ctr-2], cnt = 1; pEnd > ptr; pEnd--) {
+      if (*pEnd == '(') {
+        if (!(--cnt)) {
+          *pEnd = 0;
+          break;
+        }
+      }
+      else
+      if (*pEnd == ')')
+        cnt++;
     }
-    r->offs = strtoul(&pEnd[1], &ptr, 16);
+  }
 
-    /* ignore zero entries */
-    if (!r->seg && !r->offs)
+  strcpy(r->text, ptr);
+  r->lth = strlen(r->text) + 1;
+
+  r->mod = 0;
+  r->type |= REMAP_OBJ;
+
+  return 1;
+}
+
+/*****************************************************************************/
+/*  GNU ld                                                                   */
+/*****************************************************************************/
+/* The memory map lists each output section, then the input sections it
+ * contains, each followed by the symbols it defines.  A name that's too
+ * long for its column is on a line by itself & the rest of the entry is
+ * on the next line.  Output sections are numbered in order, skipping
+ * empty ones (which aren't in the executable), so a seg nbr is usually
+ * the section's index in the executable.  As with ELF files, a symbol's
+ * offset is its address.  A module entry is stored for each input
+ * section;  since IbmMarkDuplicateMods() expects them to precede the
+ * publics, the publics are stored in their own arena & added afterward.
+ */
+
+int     ParseGnu(void)
+{
+  int     rtn = 0;
+  int     failed = 0;
+  int     pending = GNU_NONE;
+  int     fUsed = 0;
+  int     cntPub = 0;
+  ULONG   seg = 0;
+  ULONG   cntSkip = 0;
+  char *  ptr;
+  char *  pLine;
+  REMAP * r;
+  ARENA   arPub;
+
+  if (!InitArena(&arPub))
+    return 0;
+
+do {
+  while ((pLine = GetLine()) != 0) {
+
+    ptr = ScanSpace(pLine);
+    if (!*ptr) {
+      pending = GNU_NONE;
       continue;
+    }
 
-    /* skip over the flags(?) column */
-    ptr += 6;
-    ptr += strspn(ptr, pszWS);
+    /* An output section name or a command starts in the first column. */
+    if (ptr == pLine) {
+      if (MatchArray(apszGnuCref, ptr))
+        break;
 
-    /* remove 'const' or 'volatile' at the end of a line */
-    ctr = strlen(ptr);
-    if (ptr[ctr-1] == 't' && ctr > 6 && !strcmp(&ptr[ctr-6], " const")) {
-      ctr -= 6;
-      ptr[ctr] = 0;
+      pending = GNU_NONE;
+      ptr = ScanSpace(ScanWord(ptr));
+      if (!*ptr)
+        pending = GNU_OUTPUT;
+      else
+      if (ptr[0] == '0' && ptr[1] == 'x')
+        GnuParseSection(ptr, &seg, &fUsed);
+      continue;
     }
-    else
-    if (ptr[ctr-1] == 'v' && ctr > 9 && !strcmp(&ptr[ctr-9], " volatile")) {
-      ctr -= 9;
-      ptr[ctr] = 0;
+
+    /* An input section name is indented one column;  a line that starts
+     * with '*' is a pattern from the script or a fill.
+     */
+    if (ptr == pLine + 1) {
+      pending = GNU_NONE;
+      if (*ptr == '*')
+        continue;
+
+      ptr = ScanSpace(ScanWord(ptr));
+      if (!*ptr)
+        pending = GNU_INPUT;
+      else
+      if (ptr[0] == '0' && ptr[1] == 'x' && fUsed &&
+          !GnuStoreModule(ptr, seg)) {
+        failed = 1;
+        break;
+      }
+      continue;
     }
 
-    /* remove method arguments */
-    if (ptr[ctr-1] == ')') {
-      int cnt;
-      for (pEnd = &ptr[ctr-2], cnt = 1; pEnd > ptr; pEnd--) {
-        if (*pEnd == '(') {
-          if (!(--cnt)) {
-            *pEnd = 0;
-            break;
-          }
-        }
-        else
-        if (*pEnd == ')')
-          cnt++;
+    /* Anything else that doesn't start with an address is ignored. */
+    if (ptr[0] != '0' || ptr[1] != 'x') {
+      pending = GNU_NONE;
+      continue;
+    }
+
+    /* This is the rest of an entry whose name was on the previous line. */
+    if (pending == GNU_OUTPUT) {
+      pending = GNU_NONE;
+      GnuParseSection(ptr, &seg, &fUsed);
+      continue;
+    }
+
+    if (pending == GNU_INPUT) {
+      pending = GNU_NONE;
+      if (fUsed && !GnuStoreModule(ptr, seg)) {
+        failed = 1;
+        break;
       }
+      continue;
     }
 
-    strcpy(r->text, ptr);
-    r->lth = strlen(r->text) + 1;
-    pCur = &r->text[r->lth];
+    /* This is a symbol or an assignment. */
+    if (!fUsed)
+      continue;
 
-    r->mod = 0;
-    r->type |= REMAP_OBJ;
-    r->next = (REMAP*)pCur;
-    recCnt++;
+    r = NewRec(&arPub, pMapCur - pLine);
+    if (!r) {
+      failed = 1;
+      break;
+    }
+
+    if (!GnuParsePublic(ptr, r, seg, &cntSkip))
+      continue;
+
+    AddRec(&arPub, r);
+    cntPub++;
+  }
+  if (failed)
+    break;
+
+  if (cntSkip)
+    fprintf(stderr, "%ld symbols in sections above 255 or above 4GB were ignored\n",
+            cntSkip);
+
+  /* Everything stored so far is a module. */
+  cntMods = recCnt;
+  recCnt += cntPub;
+  JoinArena(&arena, &arPub);
+
+  if (cntMods && !IbmMarkDuplicateMods(arena.pFirst, cntMods)) {
+    fprintf(stderr, "IbmMarkDuplicateMods failed\n");
+    break;
+  }
+
+  rtn = 1;
+
+} while (0);
+
+  FreeArena(&arPub);
+
+  return rtn;
+}
+
+/*****************************************************************************/
+/* Get an output section's address & size.  Empty sections aren't given
+ * a seg nbr, and anything listed in them is ignored.
+ */
+
+int     GnuParseSection(char* ptr, ULONG* pSeg, int* pfUsed)
+{
+  char *  pEnd;
+
+  strtoull(ptr, &pEnd, 16);
+  ptr = ScanSpace(pEnd);
+  if (ptr[0] != '0' || ptr[1] != 'x')
+    return 0;
+
+  *pfUsed = 0;
+  if (strtoull(ptr, 0, 16)) {
+    (*pSeg)++;
+    *pfUsed = 1;
+  }
+
+  return 1;
+}
+
+/*****************************************************************************/
+/* Store a module entry for an input section that isn't empty.  ptr is at
+ * its address, which is followed by its size & the name of the file it
+ * came from.  Only the name of an archive member's library is trimmed.
+ */
+
+int     GnuStoreModule(char* ptr, ULONG seg)
+{
+  unsigned long long  addr;
+  char *  pEnd;
+  char *  pSrc;
+  REMAP * r;
+
+  addr = strtoull(ptr, &pEnd, 16);
+  ptr = ScanSpace(pEnd);
+  if (ptr[0] != '0' || ptr[1] != 'x' || !strtoull(ptr, &pEnd, 16) ||
+      !addr || addr > 0xFFFFFFFFUL || seg > 255)
+    return 1;
+
+  pSrc = ScanSpace(pEnd);
+  if (!*pSrc)
+    return 1;
+
+  /* remove the path, but not from an archive member's name */
+  pEnd = strchr(pSrc, '(');
+  if (!pEnd)
+    pEnd = strchr(pSrc, 0);
+  for (ptr = pEnd; ptr > pSrc; ptr--) {
+    if (ptr[-1] == '/' || ptr[-1] == '\\') {
+      pSrc = ptr;
+      break;
+    }
+  }
+
+  r = NewRec(&arena, strlen(pSrc));
+  if (!r)
+    return 0;
+
+  r->type |= REMAP_MOD;
+  r->seg  = seg;
+  r->offs = (ULONG)addr;
+  r->mod  = 0;
+
+  r->lth  = strlen(pSrc) + 1;
+  memcpy(r->text, pSrc, r->lth);
+
+  AddRec(&arena, r);
+  recCnt++;
+
+  return 1;
+}
+
+/*****************************************************************************/
+/* This parses a symbol, which is an address followed by a name.  Lines
+ * that assign a value to a symbol or to '.' have the same form, as do
+ * notes such as "(size before relaxing)", so they're skipped.  Names
+ * that are still mangled (ld --no-demangle) are demangled as usual.
+ * Otherwise, ld demangled them itself & included their argument lists,
+ * plus return types for template functions.  Those are removed so the
+ * result is what DemangleGCC() produces from the mangled name.
+ */
+
+int     GnuParsePublic(char* ptr, REMAP* r, ULONG seg, ULONG* pcntSkip)
+{
+  unsigned long long  addr;
+  char *  pEnd;
+  char *  pSymbol;
+
+  addr = strtoull(ptr, &pEnd, 16);
+  pSymbol = TrimLine(pEnd);
+  if (!pSymbol || *pSymbol == '(' || strstr(pSymbol, " = "))
+    return 0;
+
+  /* segs & offsets are limited to 8 & 32 bits */
+  if (seg > 255 || addr > 0xFFFFFFFFUL) {
+    (*pcntSkip)++;
+    return 0;
+  }
+
+  r->seg  = seg;
+  r->offs = (ULONG)addr;
+
+  ptr = Demangle(pSymbol, workBuf, sizeof(workBuf), &r->type, &aDmCache[0]);
+  if (!ptr) {
+    fprintf(stderr, "line %d:  demangle failed for symbol name\n", lineNbr);
+    return 0;
   }
+  if (ptr == pSymbol && !(opts & (OPT_NO_DEMANGLE | OPT_VAC))) {
+    if (StripArgs(pSymbol))
+      StripReturnType(pSymbol);
+    ConvertDemangled(pSymbol, strlen(pSymbol), &r->type);
+  }
+
+  /* append symbol type info, if any, to the demangled symbol */
+  strcpy(r->text, ptr);
+  ptr = DecodeFlagName(r->type);
+  if (*ptr)
+    strcat(r->text, ptr);
+  r->lth = strlen(r->text) + 1;
+
+  r->mod = 0;
+  r->type |= REMAP_OBJ;
 
   return 1;
 }
@@ -1013,10 +2092,11 @@ int     BorStorePublics(void)
 
 int     ParseIBM(void)
 {
-  int     rtn = 1;
-  char *  pPublics = pCur;
+  int     rtn = 0;
+  int     cnt;
+  REMAP * pLast = arena.pLast;
 
-  if (!SeekToHdr(apszPubByName, 0)) {
+  if (!SeekToHdr(apszPubByName, 0, 0)) {
     fprintf(stderr, "publics by name header not found\n");
     return 0;
   }
@@ -1026,35 +2106,55 @@ int     ParseIBM(void)
     return 0;
   }
 
+do {
   /*  This compensates for a bug in ilink's handling of very large files
    *  which causes it to omit different symbols from Publics by Name and
-   *  Publics by Value.  It reads both sections to create a listing of all
-   *  available symbols then removes the duplicates.
+   *  Publics by Value.  Every symbol from the first listing is put in a
+   *  hash set.  While the second listing is read, each symbol is looked
+   *  up before it's demangled & only the ones that are missing are
+   *  demangled & stored.
    */
   if (recCnt - cntMods > 40000) {
 
-    if (!SeekToHdr(apszPubByValue, 0)) {
+    /* the publics start after whatever was stored last before them */
+    if (!IbmMarkDuplicatePubs((pLast ? pLast->next : arena.pFirst),
+                              recCnt - cntMods)) {
+      fprintf(stderr, "IbmMarkDuplicatePubs (by name) failed\n");
+      break;
+    }
+
+    if (!SeekToHdr(apszPubByValue, 0, 0)) {
       fprintf(stderr, "publics by value header not found\n");
-      return 0;
+      break;
     }
 
+    pLast = arena.pLast;
+    cnt = recCnt;
+
     if (!IbmStorePublics()) {
       fprintf(stderr, "IbmStorePublics (by value) failed\n");
-      return 0;
+      break;
     }
 
-    if (!IbmMarkDuplicatePubs(pPublics, recCnt - cntMods)) {
-      fprintf(stderr, "IbmMarkDuplicatePubs failed\n");
-      return 0;
+    /* The symbols that were added may duplicate one another. */
+    if (recCnt > cnt && !IbmMarkDuplicatePubs(pLast->next, recCnt - cnt)) {
+      fprintf(stderr, "IbmMarkDuplicatePubs (by value) failed\n");
+      break;
     }
   }
 
   /* Mark duplicate entries for each module as such so only one is used. */
-  if (cntMods && !IbmMarkDuplicateMods(buffer, cntMods)) {
+  if (cntMods && !IbmMarkDuplicateMods(arena.pFirst, cntMods)) {
     fprintf(stderr, "IbmMarkDuplicateMods failed\n");
-    return 0;
+    break;
   }
 
+  rtn = 1;
+
+} while (0);
+
+  IbmFreePubSet(&pubSet);
+
   return rtn;
 }
 
@@ -1087,7 +2187,11 @@ int     IbmStoreModule(char* pData, ULONG ulSeg, ULONG ulOffs)
   ULONG   offs;
   char *  ptr;
   char *  pSrc;
-  REMAP * r = (REMAP*)pCur;
+  REMAP * r;
+
+  r = NewRec(&arena, strlen(pData));
+  if (!r)
+    return 0;
 
   /* get the offset within the current segment */
   offs = strtoul(pData, &ptr, 16);
@@ -1120,9 +2224,8 @@ int     IbmStoreModule(char* pData, ULONG ulSeg, ULONG ulOffs)
 
   r->lth  = strlen(pSrc) + 1;
   memcpy(r->text, pSrc, r->lth);
-  pCur = &r->text[r->lth];
 
-  r->next = (REMAP*)pCur;
+  AddRec(&arena, r);
   recCnt++;
 
   return 1;
@@ -1133,18 +2236,21 @@ int     IbmStoreModule(char* pData, ULONG ulSeg, ULONG ulOffs)
 int     IbmStorePublics(void)
 {
   int     blankOK = 1;
-  int     ctr;
   char *  ptr;
-  char *  pEnd;
-  char *  pSymbol;
+  char *  pLine;
+  int     rc;
   REMAP * r;
 
-  while (fgets(bufIn, sizeof(bufIn), fi)) {
-    lineNbr++;
+  if (cntThreads > 1 && (rc = StorePublicsMT(PUBS_IBM)) != 0)
+    return (rc > 0);
 
-    r = (REMAP*)pCur;
+  while ((pLine = GetLine()) != 0) {
 
-    ptr = bufIn + strspn(bufIn, pszWS);
+    r = NewRec(&arena, pMapCur - pLine);
+    if (!r)
+      return 0;
+
+    ptr = ScanSpace(pLine);
 
     /* Some IBM linkers have a blank line after the header, some don't.
      * Thereafter, there are no blank lines until the end of the listing.
@@ -1159,68 +2265,91 @@ int     IbmStorePublics(void)
     }
     blankOK = 0;
 
-    r->seg = strtoul(ptr, &pEnd, 16);
-    if (r->seg > 255 || *pEnd != ':') {
-      fprintf(stderr, "line %d:  invalid segment\n", lineNbr);
+    if (!IbmParsePublic(ptr, r, workBuf, lineNbr, &pubSet, &aDmCache[0]))
       continue;
-    }
 
-    r->offs = strtoul(&pEnd[1], &ptr, 16);
+    AddRec(&arena, r);
+    recCnt++;
+  }
 
-    /* skip entries whose seg & offset are both zero */
-    if (!r->seg && !r->offs)
-      continue;
+  return 1;
+}
 
-    /* count the nbr of columns */
-    for (pEnd = ptr, ctr = 0; pEnd && *pEnd; pEnd = strpbrk(pEnd, pszWS)) {
-      pEnd += strspn(pEnd, pszWS);
-      if (!*pEnd)
-        break;
-      ctr++;
-    }
+/*****************************************************************************/
+/* This parses a single symbol entry.  Like WatParsePublic(),
+ * it stores nothing in any global.  If pSet has any entries and the
+ * symbol is already in it, the symbol is skipped.  The set is probed
+ * using the mapfile's name, so a symbol that isn't there is never
+ * demangled twice & one that is only has to be demangled to confirm it.
+ */
 
-    /* skip over the flags column */
-    if (ctr == 2) {
-      pEnd = Trim(ptr, &ptr);
-      if (strlen(pEnd) == 3)
-        ctr--;
-    }
+int     IbmParsePublic(char* ptr, REMAP* r, char* pWork, int line,
+                       PUBSET* pSet, DMCACHE* pdc)
+{
+  int     ctr;
+  int     fProbe;
+  char *  pEnd;
+  char *  pSymbol;
+  COLSPAN aCol[2];
 
-    /* there should only be one column */
-    if (ctr != 1) {
-      fprintf(stderr, "line %d:  malformed/unexpected entry\n", lineNbr);
-      continue;
-    }
+  r->seg = strtoul(ptr, &pEnd, 16);
+  if (r->seg > 255 || *pEnd != ':') {
+    fprintf(stderr, "line %d:  invalid segment\n", line);
+    return 0;
+  }
 
-    pSymbol = Trim(ptr, 0);
-    if (!pSymbol) {
-      fprintf(stderr, "line %d:  symbol name not found\n", lineNbr);
-      continue;
-    }
+  r->offs = strtoul(&pEnd[1], &ptr, 16);
 
-    /* demangle the symbol - it may return either a demangled string
-     * or the string that was passed in.
-     */
-    pSymbol = Demangle(pSymbol, workBuf, sizeof(workBuf), &r->type);
-    if (!pSymbol) {
-      fprintf(stderr, "line %d:  demangle failed for symbol name\n", lineNbr);
-      continue;
-    }
+  /* skip entries whose seg & offset are both zero */
+  if (!r->seg && !r->offs)
+    return 0;
 
-    /* append symbol type info, if any, to the demangled symbol */
-    strcpy(r->text, pSymbol);
-    ptr = DecodeFlagName(r->type);
-    if (*ptr)
-      strcat(r->text, ptr);
-    r->lth = strlen(r->text) + 1;
-    pCur = &r->text[r->lth];
+  /* locate the remaining columns */
+  ctr = ScanColumns(ptr, aCol, 2);
 
-    r->mod = 0;
-    r->type |= REMAP_OBJ;
-    r->next = (REMAP*)pCur;
-    recCnt++;
+  /* skip over the flags column */
+  if (ctr == 2 && aCol[0].cb == 3) {
+    aCol[0] = aCol[1];
+    ctr--;
+  }
+
+  /* there should only be one column */
+  if (ctr != 1) {
+    fprintf(stderr, "line %d:  malformed/unexpected entry\n", line);
+    return 0;
+  }
+
+  pSymbol = aCol[0].ptr;
+  pSymbol[aCol[0].cb] = 0;
+
+  /* if there's no entry with the same seg, offs, & mapfile name,
+   * the symbol isn't a duplicate & won't need to be looked up again
+   */
+  r->hash = HashName(pSymbol, aCol[0].cb);
+  fProbe = (pSet && pSet->aRec && IbmProbePub(pSet, r));
+
+  /* demangle the symbol - it may return either a demangled string
+   * or the string that was passed in.
+   */
+  pSymbol = Demangle(pSymbol, pWork, sizeof(workBuf), &r->type, pdc);
+  if (!pSymbol) {
+    fprintf(stderr, "line %d:  demangle failed for symbol name\n", line);
+    return 0;
   }
 
+  /* append symbol type info, if any, to the demangled symbol */
+  strcpy(r->text, pSymbol);
+  ptr = DecodeFlagName(r->type);
+  if (*ptr)
+    strcat(r->text, ptr);
+  r->lth = strlen(r->text) + 1;
+
+  r->mod = 0;
+  r->type |= REMAP_OBJ;
+
+  if (fProbe && *IbmFindPub(pSet, r))
+    return 0;
+
   return 1;
 }
 
@@ -1230,7 +2359,7 @@ int     IbmStorePublics(void)
  * to the first entry.  See SortByAddress() for how this is used.
  */
 
-int     IbmMarkDuplicateMods(char* pMods, int modCnt)
+int     IbmMarkDuplicateMods(REMAP* pMods, int modCnt)
 {
   int     ctr;
   REMAP** pr;
@@ -1250,7 +2379,7 @@ int     IbmMarkDuplicateMods(char* pMods, int modCnt)
     return 0;
   }
 
-  pRec = (REMAP*)pMods;
+  pRec = pMods;
   pArr = pr;
   ctr = 0;
   /* note:  pRec->next == null identifies the first invalid entry */
@@ -1321,40 +2450,37 @@ int     IbmDuplicateModSorter(const void* key, const void* element)
 }
 
 /*****************************************************************************/
-/* If we read both Pubs by Name and Pubs by Value, there are many
- * duplicate entries.  If two entries are found to be identical
- * while sorting, mark one as a duplicate.
+/* If we read both Pubs by Name and Pubs by Value, add each entry in a
+ * run of publics to the hash set.  An entry that is already there is
+ * marked as a duplicate.
  */
 
-int     IbmMarkDuplicatePubs(char* pPublics, int pubCnt)
+int     IbmMarkDuplicatePubs(REMAP* pPublics, int pubCnt)
 {
   int     ctr;
-  REMAP** pr;
-  REMAP** pArr;
+  int     rc;
   REMAP * pRec;
 
   if (!pubCnt) {
-    fprintf(stderr, "no public symbols to sort\n");
+    fprintf(stderr, "no public symbols to mark\n");
     return 0;
   }
 
-  pr = (REMAP**)malloc((pubCnt + 1) * sizeof(REMAP*));
-  if (!pr) {
-    fprintf(stderr, "malloc failed for IbmMarkDuplicatePubs - bytes= %d\n",
-            pubCnt * sizeof(REMAP*));
+  if (!IbmSizePubSet(&pubSet, pubSet.cnt + pubCnt))
     return 0;
-  }
 
-  pRec = (REMAP*)pPublics;
-  pArr = pr;
+  pRec = pPublics;
   ctr = 0;
   /* note:  pRec->next == null identifies the first invalid entry */
-  while (pRec->next) {
-    *pArr++ = pRec;
+  while (pRec->next && ctr < pubCnt) {
+    rc = IbmAddPub(&pubSet, pRec);
+    if (rc < 0)
+      return 0;
+    if (!rc)
+      pRec->type |= REMAP_DUP;
     pRec = pRec->next;
     ctr++;
   }
-  *pArr = 0;
 
   if (ctr != pubCnt) {
     fprintf(stderr, "invalid record count:  cnt= %d  pubCnt= %d\n",
@@ -1362,984 +2488,4189 @@ int     IbmMarkDuplicatePubs(char* pPublics, int pubCnt)
     return 0;
   }
 
-  qsort(pr, pubCnt, sizeof(REMAP*), IbmDuplicatePubSorter);
-  free(pr);
-
   return 1;
 }
 
 /*****************************************************************************/
-/* qsort callback for marking duplicate publics */
+/* Return the slot that holds an entry with the same seg, offs, type, &
+ * name as r or, if there isn't one, the empty slot where r belongs.
+ * The mapfile names' hashes are compared first so most mismatches are
+ * cheap.
+ */
 
-int     IbmDuplicatePubSorter(const void* key, const void* element)
+REMAP** IbmFindPub(PUBSET* ps, REMAP* r)
 {
-  int     res;
-  ULONG   kType;
-  ULONG   eType;
-
-  res = (*(REMAP**)key)->seg - (*(REMAP**)element)->seg;
-  if (res)
-    return res;
-
-  res = (*(REMAP**)key)->offs - (*(REMAP**)element)->offs;
-  if (res)
-    return res;
+  ULONG   ndx;
+  REMAP * p;
 
-  kType = (*(REMAP**)key)->type;
-  eType = (*(REMAP**)element)->type;
+  ndx = (r->hash ^ (r->offs * 0x9E3779B1UL) ^ (r->seg << 24)) & ps->mask;
 
-  res = (kType & REMAP_MASK) - (eType & REMAP_MASK);
-  if (res) {
-    fprintf(stderr, "PubSort:  key- %04lx:%08lx type=%lx  elem- %04lx:%08lx type=%lx\n",
-            (*(REMAP**)key)->seg, (*(REMAP**)key)->offs, kType,
-            (*(REMAP**)element)->seg, (*(REMAP**)element)->offs, eType);
-    return res;
+  while ((p = ps->aRec[ndx]) != 0) {
+    if (p->hash == r->hash && p->offs == r->offs && p->seg == r->seg &&
+        (p->type & REMAP_MASK) == (r->type & REMAP_MASK) &&
+        !strcmp(p->text, r->text))
+      break;
+    ndx = (ndx + 1) & ps->mask;
   }
 
-  res = strcmp((*(REMAP**)key)->text, (*(REMAP**)element)->text);
-  if (res)
-    return res;
-
-  if (!(kType & REMAP_DUP) && !(eType & REMAP_DUP))
-    (*(REMAP**)key)->type |= REMAP_DUP;
-
-  return 0;
+  return &ps->aRec[ndx];
 }
 
 /*****************************************************************************/
-/*  Utility Functions                                                        */
-/*****************************************************************************/
-/* Read lines until either the "seek" or "stop" string is found */
+/* Return 1 if the set has an entry with the same seg, offs, & mapfile
+ * name hash as r.  Only those entries can match r, so this can be done
+ * before r's name is demangled.
+ */
 
-char**  SeekToHdr(char** pSeek, char** pStop)
+int     IbmProbePub(PUBSET* ps, REMAP* r)
 {
-  char ** pRtn = 0;
-
-  while (fgets(bufIn, sizeof(bufIn), fi)) {
-    lineNbr++;
+  ULONG   ndx;
+  REMAP * p;
 
-    if (MatchArray(pSeek, bufIn)) {
-      pRtn = pSeek;
-      break;
-    }
+  ndx = (r->hash ^ (r->offs * 0x9E3779B1UL) ^ (r->seg << 24)) & ps->mask;
 
-    if (pStop) {
-      if (MatchArray(pStop, bufIn)) {
-        pRtn = pStop;
-        break;
-      }
-    }
+  while ((p = ps->aRec[ndx]) != 0) {
+    if (p->hash == r->hash && p->offs == r->offs && p->seg == r->seg)
+      return 1;
+    ndx = (ndx + 1) & ps->mask;
   }
 
-  return pRtn;
+  return 0;
 }
 
 /*****************************************************************************/
-/* Match individual words in a string - this reduces the chance that a
- * string will be missed due to formatting variations.
+/* Add r to the set unless it's already there.  Returns 1 if it was
+ * added, 0 if it was already there, or -1 if the set couldn't grow.
  */
 
-int     MatchArray(char** pArray, char* pText)
+int     IbmAddPub(PUBSET* ps, REMAP* r)
 {
-  while (**pArray) {
-    pText = strstr(pText, *pArray);
-    if (!pText)
-      return 0;
+  REMAP** pSlot;
 
-    pText += strlen(*pArray);
-    pArray++;
-  }
+  pSlot = IbmFindPub(ps, r);
+  if (*pSlot)
+    return 0;
 
-  return 1;
+  *pSlot = r;
+  ps->cnt++;
+
+  return (IbmSizePubSet(ps, ps->cnt) ? 1 : -1);
 }
 
 /*****************************************************************************/
-/* This trims words in-place.  It returns the first non-whitespace character
-   in pTrim & puts a null after the last non-ws char.  If ppNext is supplied,
-   it points to the character after the inserted null.
-*/
+/* Ensure the set has at least twice as many slots as cnt, rehashing
+ * any existing entries if it has to be enlarged.
+ */
 
-char*   Trim(char* pTrim, char** ppNext)
+int     IbmSizePubSet(PUBSET* ps, ULONG cnt)
 {
-  char *  ptr;
+  ULONG   ctr;
+  ULONG   cntSlot;
+  REMAP** aOld;
+  REMAP** aNew;
 
-  if (ppNext)
-    *ppNext = 0;
+  if (ps->aRec && cnt * 2 <= ps->mask + 1)
+    return 1;
 
-  if (!pTrim)
-    return 0;
+  for (cntSlot = 1024; cntSlot < cnt * 2; cntSlot *= 2)
+    ;
 
-  pTrim += strspn(pTrim, pszWS);
-  if (!*pTrim)
+  aNew = (REMAP**)calloc(cntSlot, sizeof(REMAP*));
+  if (!aNew) {
+    fprintf(stderr, "malloc failed for IbmSizePubSet - bytes= %ld\n",
+            cntSlot * sizeof(REMAP*));
     return 0;
+  }
 
-  ptr = strpbrk(pTrim, pszWS);
-  if (!ptr)
-    return pTrim;
+  aOld = ps->aRec;
+  ctr  = (aOld ? ps->mask + 1 : 0);
+  ps->aRec = aNew;
+  ps->mask = cntSlot - 1;
 
-  *ptr++ = 0;
-  if (ppNext && *ptr)
-    *ppNext = ptr;
+  while (ctr--) {
+    if (aOld[ctr])
+      *IbmFindPub(ps, aOld[ctr]) = aOld[ctr];
+  }
 
-  return pTrim;
+  if (aOld)
+    free(aOld);
+
+  return 1;
 }
 
 /*****************************************************************************/
-/* This trims a line in-place. */
 
-char *  TrimLine(char* pTrim)
+void    IbmFreePubSet(PUBSET* ps)
 {
-  char *  ptr;
-
-  if (!pTrim)
-    return 0;
+  if (ps->aRec)
+    free(ps->aRec);
 
-  pTrim += strspn(pTrim, pszWS);
-  if (!*pTrim)
-    return 0;
-
-  ptr = strchr(pTrim, 0) - 1;
-  while (ptr > pTrim && strchr(pszWS, *ptr))
-    ptr--;
-  *(++ptr) = 0;
+  memset(ps, 0, sizeof(PUBSET));
 
-  return pTrim;
+  return;
 }
 
 /*****************************************************************************/
-/* Convert the flags generated when the function was demangled into
- * strings that will be appended to the method name.
+/*  ELF executables & objects                                                */
+/*****************************************************************************/
+/* Symbols are taken directly from .symtab, or from .dynsym if the file
+ * has been stripped, so no mapfile is needed.  Each symbol's section
+ * index becomes its seg & its st_value becomes its offset.  Only code
+ * & data symbols are stored, and there's no module info.  Both 32- &
+ * 64-bit files in either byte order are accepted.
  */
 
-char *  DecodeFlagName(ULONG flags)
+int     ParseElf(void)
 {
-  if (flags & REMAP_VTABLE)
-    return "::{vtable}";
+  int     type;
+  ULONG   ctr;
+  ULONG   cntSym;
+  ULONG   cntSkip = 0;
+  ULONG   cbSym;
+  ULONG   cbSymtab;
+  ULONG   cbStr;
+  ULONG   ulType;
+  ULONG   ulLink;
+  ULONG   ndxName;
+  ULONG   ndxSec = 0;
+  ULONG   cbEntry;
+  char *  pSymtab = 0;
+  char *  pSym;
+  char *  pStr;
+  char *  pName;
+  char *  pEnd;
+  REMAP * r;
+  unsigned long long  val;
+  ELFFILE ef;
 
-  if (flags & REMAP_THUNK)
-    return "::{thunk}";
+  if (!ElfReadAll())
+    return 0;
 
-  if (flags & REMAP_TYPEINFO)
-    return "::{typeinfo}";
+  memset(&ef, 0, sizeof(ef));
+  ef.pData  = pMap;
+  ef.cbData = pMapEnd - pMap;
+  ef.f64    = (ef.pData[4] == 2);
+  ef.fBE    = (ef.pData[5] == 2);
 
-  if (flags & REMAP_TYPENAME)
-    return "::{typename}";
+  if ((ef.pData[4] != 1 && !ef.f64) || (ef.pData[5] != 1 && !ef.fBE) ||
+      ef.cbData < (ULONG)(ef.f64 ? 64 : 52)) {
+    fprintf(stderr, "unsupported or invalid ELF header\n");
+    return 0;
+  }
 
-  if (flags & REMAP_GUARD)
-    return "::{guard_variable}";
+  /* e_shoff, e_shentsize, & e_shnum */
+  val = ElfGet(&ef, ef.pData + (ef.f64 ? 0x28 : 0x20), (ef.f64 ? 8 : 4));
+  ef.cbShdr  = ElfGet(&ef, ef.pData + (ef.f64 ? 0x3A : 0x2E), 2);
+  ef.cntShdr = ElfGet(&ef, ef.pData + (ef.f64 ? 0x3C : 0x30), 2);
 
-  if (flags & REMAP_VTT)
-    return "::{vtt}";
+  if (!val || val >= ef.cbData ||
+      ef.cbShdr < (ULONG)(ef.f64 ? 64 : 40) ||
+      ef.cbShdr > ef.cbData - val) {
+    fprintf(stderr, "ELF file has no section headers\n");
+    return 0;
+  }
+  ef.pShdr = ef.pData + val;
 
-  if (flags & REMAP_VIRTTHUNK)
-    return "::{virtual thunk}";
+  /* If there are too many sections for e_shnum, the count is in the
+   * first header's sh_size.
+   */
+  if (!ef.cntShdr) {
+    val = ElfGet(&ef, ef.pShdr + (ef.f64 ? 32 : 20), (ef.f64 ? 8 : 4));
+    ef.cntShdr = (val > 0xFFFFFFFFUL) ? 0xFFFFFFFFUL : (ULONG)val;
+  }
+  if (ef.cntShdr > (ef.cbData - (ef.pShdr - ef.pData)) / ef.cbShdr) {
+    fprintf(stderr, "ELF section headers extend past the end of the file\n");
+    return 0;
+  }
 
-  if (flags & REMAP_CONSTRUCT)
-    return "::{construction vtable}";
+  /* Use the full symbol table if there is one. */
+  for (ctr = 1; ctr < ef.cntShdr; ctr++) {
+    if (!ElfSection(&ef, ctr, &ulType, &pSym, &cbSymtab, &ulLink, &cbSym))
+      continue;
+    if (ulType == ELF_SHT_SYMTAB || (ulType == ELF_SHT_DYNSYM && !pSymtab)) {
+      pSymtab = pSym;
+      ndxSec  = ctr;
+      if (ulType == ELF_SHT_SYMTAB)
+        break;
+    }
+  }
+  if (!pSymtab) {
+    fprintf(stderr, "ELF file has no symbol table\n");
+    return 0;
+  }
 
-  return "";
-}
+  /* Its sh_link identifies its string table. */
+  ElfSection(&ef, ndxSec, &ulType, &pSymtab, &cbSymtab, &ulLink, &cbSym);
+  if (cbSym < (ULONG)(ef.f64 ? 24 : 16) || !ulLink ||
+      !ElfSection(&ef, ulLink, &ulType, &pStr, &cbStr, &ulLink, &cbEntry)) {
+    fprintf(stderr, "invalid ELF symbol table\n");
+    return 0;
+  }
+  cntSym = cbSymtab / cbSym;
 
-/*****************************************************************************/
-/* This demangles symbols for GCC using the builtin demangler. */
+  /* The first symbol is always null. */
+  for (ctr = 1; ctr < cntSym; ctr++) {
+    pSym = pSymtab + ctr * cbSym;
 
-char *  Demangle(char* pIn, char* pOut, ULONG cbOut, ULONG* pFlags)
-{
-  int     ndx;
-  char *  ptr;
+    ndxName = ElfGet(&ef, pSym, 4);
+    if (ef.f64) {
+      type   = pSym[4] & 0x0F;
+      ndxSec = ElfGet(&ef, pSym + 6, 2);
+      val    = ElfGet(&ef, pSym + 8, 8);
+    }
+    else {
+      val    = ElfGet(&ef, pSym + 4, 4);
+      type   = pSym[12] & 0x0F;
+      ndxSec = ElfGet(&ef, pSym + 14, 2);
+    }
 
-  if (opts & OPT_NO_DEMANGLE)
-    return pIn;
+    /* skip section, file, & TLS symbols, plus undefined & absolute ones */
+    if ((type != ELF_STT_NOTYPE && type != ELF_STT_OBJECT &&
+         type != ELF_STT_FUNC && type != ELF_STT_IFUNC) ||
+        !ndxSec || ndxSec >= ELF_SHN_LORESERVE || ndxName >= cbStr)
+      continue;
 
-  if (opts & OPT_VAC)
-    return DemangleVAC(pIn, pOut, pFlags);
+    pName = pStr + ndxName;
+    pEnd = memchr(pName, 0, cbStr - ndxName);
+    if (!pEnd || pEnd == pName)
+      continue;
 
-  /* OPT_GCC */
+    /* skip ARM's mapping symbols ($a, $d, $t, & $x) */
+    if (pName[0] == '$' && (!pName[2] || pName[2] == '.'))
+      continue;
 
-  /* Determine if this is mangled & whether to remove the leading character. */
-  if (!memcmp(pIn, "__Z", 3) || !memcmp(pIn, "@_Z", 3))
-    ndx = 1;
-  else
-  if (!memcmp(pIn, "_Z", 2))
-    ndx = 0;
-  else
-    return pIn;
+    /* segs & offsets are limited to 8 & 32 bits */
+    if (ndxSec > 255 || val > 0xFFFFFFFFUL) {
+      cntSkip++;
+      continue;
+    }
 
-  *pOut = 0;
+    r = NewRec(&arena, pEnd - pName);
+    if (!r)
+      return 0;
 
-  /* Mozilla (at least) appends a unique identifier to many symbols
-   * that the demangler can't handle.  If the leading characters of
-   * the identifier ("$w$") are found, remove the identifier.
-   */
-  ptr = strstr(pIn, pszTrouble);
-  if (ptr)
-    *ptr = 0;
+    r->seg  = ndxSec;
+    r->offs = (ULONG)val;
 
-  /* Call the gcc 3.x demangler. */
-  *pOut = 0;
-  if (!cplus_demangle_v3_callback(&pIn[ndx], 0, &DemangleCallback, &pOut))
-    return pIn;
+    pName = Demangle(pName, workBuf, sizeof(workBuf), &r->type, &aDmCache[0]);
+    if (!pName) {
+      fprintf(stderr, "symbol %ld:  demangle failed for symbol name\n", ctr);
+      continue;
+    }
 
-  /* Trim any trailing whitespace. */
-  ptr = strchr(pOut, 0) - 1;
-  while (ptr > pOut && strchr(pszWS, *ptr))
-    ptr--;
-  *(++ptr) = 0;
+    /* append symbol type info, if any, to the demangled symbol */
+    strcpy(r->text, pName);
+    pName = DecodeFlagName(r->type);
+    if (*pName)
+      strcat(r->text, pName);
+    r->lth = strlen(r->text) + 1;
 
-  /* Convert metadata generated by the demangler into flags,
-   * then remove the metadata.
-   */
-  if (strchr(pOut, ' ')) {
-    if (!strncmp(pOut, szVtable, cbVtable)) {
-      *pFlags |= REMAP_VTABLE;
-      strcpy(pOut, pOut + cbVtable);
-    }
-    else
-    if (!strncmp(pOut, szThunk, cbThunk)) {
-      *pFlags |= REMAP_THUNK;
-      strcpy(pOut, pOut + cbThunk);
+    r->mod = 0;
+    r->type |= REMAP_OBJ;
 
-      /* remove the argument list that gets included for thunks */
-      if ((ptr = strchr(pOut, '(')) != 0)
-        *ptr = 0;
-    }
-    else
-    if (!strncmp(pOut, szTypeInfo, cbTypeInfo)) {
-      *pFlags |= REMAP_TYPEINFO;
-      strcpy(pOut, pOut + cbTypeInfo);
-    }
-    else
-    if (!strncmp(pOut, szTypeName, cbTypeName)) {
-      *pFlags |= REMAP_TYPENAME;
-      strcpy(pOut, pOut + cbTypeName);
-    }
-    else
-    if (!strncmp(pOut, szGuard, cbGuard)) {
-      *pFlags |= REMAP_GUARD;
-      strcpy(pOut, pOut + cbGuard);
-    }
-    else
-    if (!strncmp(pOut, szVTT, cbVTT)) {
-      *pFlags |= REMAP_VTT;
-      strcpy(pOut, pOut + cbVTT);
-    }
-    else
-    if (!strncmp(pOut, szConstruct, cbConstruct)) {
-      *pFlags |= REMAP_CONSTRUCT;
-      strcpy(pOut, pOut + cbConstruct);
-    }
-    else
-    if (!strncmp(pOut, szVirtThunk, cbVirtThunk)) {
-      *pFlags |= REMAP_VIRTTHUNK;
-      strcpy(pOut, pOut + cbVirtThunk);
-    }
+    AddRec(&arena, r);
+    recCnt++;
   }
 
-  /* remove the arguments for templates */
-  ptr = strchr(pOut, '<');
-  while (ptr) {
-    int     cnt;
-    char *  pRt;
+  if (cntSkip)
+    fprintf(stderr, "%ld symbols in sections above 255 or above 4GB were ignored\n",
+            cntSkip);
 
-    for (pRt = ptr+1, cnt = 1; *pRt; pRt++) {
-      if (*pRt == '<')
-        cnt++;
-      else
-      if (*pRt == '>') {
-        cnt--;
-        if (!cnt) {
-          strcpy(ptr, pRt+1);
-          break;
-        }
+  return 1;
+}
+
+/*****************************************************************************/
+/* Sections are located by their offsets, so the rest of the file is
+ * read into the map buffer.  If the file's size is known, the buffer
+ * is enlarged just once & reading stops when it's full;  otherwise,
+ * it's doubled as needed until read() reports EOF.
+ */
+
+int     ElfReadAll(void)
+{
+  int     cnt;
+  ULONG   cb;
+  ULONG   cbNew;
+  char *  ptr;
+
+  while (!fMapEOF) {
+    if (cbFile && (ULONG)(pMapEnd - pMap) >= cbFile)
+      break;
+
+    if (pMapEnd == pMap + cbMap) {
+      cbNew = (cbFile > cbMap) ? cbFile : cbMap * 2;
+      cb = pMapEnd - pMap;
+      ptr = realloc(pMap, cbNew + CB_MAPPAD);
+      if (!ptr) {
+        fprintf(stderr, "realloc for input buffer failed - size= %ld\n",
+                cbNew + CB_MAPPAD);
+        return 0;
       }
+      cbMap = cbNew;
+      pMap = ptr;
+      pMapCur = pMap;
+      pMapLast = pMap;
+      pMapEnd = pMap + cb;
     }
 
-    /* If there are more '<' than '>', it's probably because this
-     * line contains "operator<" or "operator<<".  If so, advance
-     * past them and retry;  otherwise, leave it as-is.
-     */
-    if (cnt) {
-      if (*ptr != '<')
-        break;
-      pRt = strstr(pOut, "operator<");
-      if (!pRt || pRt+8 != ptr)
-        break;
-      ptr++;
-      if (cnt > 1 && *ptr == '<')
-        ptr++;
+    cnt = read(hMap, pMapEnd, (pMap + cbMap) - pMapEnd);
+    if (cnt <= 0) {
+      if (cnt < 0) {
+        fprintf(stderr, "error reading input file '%s'\n", pszMapFile);
+        fMapErr = 1;
+        return 0;
+      }
+      fMapEOF = 1;
+      break;
     }
-    ptr = strchr(ptr, '<');
+    pMapEnd += cnt;
   }
 
-  return pOut;
+  return 1;
 }
 
 /*****************************************************************************/
-/* Called by the GCC demangler one or more times to copy the pieces
- * of a demangled method to an output buffer.  pv is actually a ptr
- * to the pOut & cbOut arguments to Demangle() - cheesy, huh?
+/* Get the type, location, size, link, & entry size of a section.  This
+ * returns zero if the section is outside the file or has no contents.
  */
 
-void    DemangleCallback(const char* pSrc, size_t cbSrc, void* pv)
+int     ElfSection(ELFFILE* pef, ULONG ndx, ULONG* pType, char** ppSec,
+                   ULONG* pcbSec, ULONG* pLink, ULONG* pcbEntry)
 {
-  struct ptr_lth {
-    char *  pbuf;
-    ULONG   cbbuf;
-  } * p;
-  size_t  cnt;
+  char *  pHdr;
+  unsigned long long  offs;
+  unsigned long long  cb;
+
+  if (ndx >= pef->cntShdr)
+    return 0;
+  pHdr = pef->pShdr + ndx * pef->cbShdr;
+
+  *pType = ElfGet(pef, pHdr + 4, 4);
+  if (pef->f64) {
+    offs      = ElfGet(pef, pHdr + 24, 8);
+    cb        = ElfGet(pef, pHdr + 32, 8);
+    *pLink    = ElfGet(pef, pHdr + 40, 4);
+    *pcbEntry = ElfGet(pef, pHdr + 56, 8);
+  }
+  else {
+    offs      = ElfGet(pef, pHdr + 16, 4);
+    cb        = ElfGet(pef, pHdr + 20, 4);
+    *pLink    = ElfGet(pef, pHdr + 24, 4);
+    *pcbEntry = ElfGet(pef, pHdr + 36, 4);
+  }
+
+  if (!cb || offs >= pef->cbData || cb > pef->cbData - offs)
+    return 0;
 
-  p = (struct ptr_lth*)pv;
-  cnt = strlen(p->pbuf);
-  if (cnt + cbSrc + 1 < p->cbbuf)
-    strcpy(p->pbuf + cnt, pSrc);
+  *ppSec  = pef->pData + offs;
+  *pcbSec = (ULONG)cb;
 
-  return;
+  return 1;
 }
 
 /*****************************************************************************/
-/* This demangles symbols for VAC via demangl.dll.  The functions in
- * demangl.dll all use Optlink which gcc 4.x can't handle, so they're
- * invoked via wrapper functions in remap_vac.c.  Each wrapper has
- * '_vac' appended to the function's original name.
+/* Fields are read a byte at a time, so neither the file's byte order
+ * nor the alignment of its structures matter.
  */
 
-char*   DemangleVAC(char* pIn, char* pOut, ULONG* pFlags)
+unsigned long long  ElfGet(ELFFILE* pef, char* ptr, int cb)
 {
-  char *    ptr;
-  char *    pEnd;
-  Name *    nm;
-  NameKind  nk;
-
-  *pOut = 0;
+  int     ctr;
+  unsigned long long  val = 0;
 
-  nm = demangle_vac(pIn, &ptr, (RegularNames | ClassNames | SpecialNames));
-  if (!nm)
-    return pIn;
+  for (ctr = 0; ctr < cb; ctr++) {
+    if (pef->fBE)
+      val = (val << 8) | (UCHAR)ptr[ctr];
+    else
+      val |= (unsigned long long)(UCHAR)ptr[ctr] << (ctr * 8);
+  }
 
-  nk = kind_vac(nm);
+  return val;
+}
 
-  if (nk == MemberFunction || nk == Function) {
+/*****************************************************************************/
+/*  Multi-threaded parsing                                                   */
+/*****************************************************************************/
+/* Once the extent of a publics listing is known, each of its lines can
+ * be parsed & demangled independently.  This takes as much of the listing
+ * as the mapfile buffer holds, splits it into one chunk per thread, has
+ * each thread parse its chunk into a separate arena, then appends the
+ * results to the main arena in their original order.  This repeats until
+ * the end of the listing.  The end result is identical to what the
+ * single-threaded code produces.  If the listing is too small to benefit,
+ * this returns zero without consuming any input & the caller parses it
+ * as usual.  It returns -1 if a thread ran out of memory.
+ */
 
-    if (nk == MemberFunction) {
-      ptr = qualifier_vac(nm);
-      if (ptr) {
-        strcpy(pOut, ptr);
-        strcat(pOut, "::");
-      }
-    }
-    ptr = functionName_vac(nm);
-    if (ptr)
-      strcat(pOut, ptr);
-  }
-  else {
-    ptr = text_vac(nm);
-    if (!ptr)
-      return pIn;
-    strcpy(pOut, ptr);
-  }
+int     StorePublicsMT(int fmt)
+{
+  int     cnt;
+  int     cntChunk;
+  int     skip;
+  int     fDone;
+  int     fFirst = 1;
+  int     rtn = 1;
+  char *  pStart;
+  char *  pEnd;
+  REMAP * rMod = 0;
 
-  if (nk == Special && (ptr = strstr(pOut, szVtableVAC)) != 0) {
-    *pFlags |= REMAP_VTABLE;
-    *ptr = 0;
+  /* Get as much of the listing into the buffer as possible. */
+  FillMap();
 
-    /* vtable entries for subclasses are formatted '{subclass}class';
-     * this reformats it as 'class::subclass'
+  do {
+    /* Locate the listing, or the part of it that's in the buffer,
+     * without disturbing it.
      */
-    if (*pOut == '{' && (pEnd = strchr(pOut, '}')) != 0) {
-      *pEnd++ = 0;
-      *ptr++ = ':';
-      *ptr++ = ':';
-      strcpy(ptr, &pOut[1]);
-      strcpy(pOut, pEnd);
+    pEnd = ScanPublics(fmt, fFirst, &pStart, &skip, &cnt);
+    fDone = (pEnd < pMapLast || fMapEOF);
+
+    cntChunk = (pEnd - pStart) / MIN_CHUNK;
+    if (cntChunk > cntThreads)
+      cntChunk = cntThreads;
+
+    if (fFirst && (fDone ? cntChunk < 2 : !cnt))
+      return 0;
+
+    if (cnt) {
+      rtn = ParseChunks(fmt, pStart, pEnd, (cntChunk ? cntChunk : 1),
+                        lineNbr + skip, &rMod);
+      if (!rtn && fFirst)
+        return 0;
     }
-  }
 
-  erase_vac(nm);
+    /* Move past the lines that were processed. */
+    lineNbr += skip + cnt;
+    pMapCur = pEnd;
+    fFirst = 0;
 
-  return pOut;
+  } while (rtn > 0 && !fDone && FillMap());
+
+  /* Consume the line that ended the listing. */
+  GetLine();
+
+  return (rtn > 0 ? 1 : -1);
 }
 
 /*****************************************************************************/
-/*  Output Processing                                                        */
-/*****************************************************************************/
+/* Divide [pStart, pEnd) at line boundaries & parse each chunk on its own
+ * thread.  'line' is the nbr of the line preceding pStart.  For Watcom,
+ * *prMod is the module in effect at pStart;  on return, it's the one in
+ * effect at pEnd.  This returns zero if nothing was done, or -1 if a
+ * thread ran out of memory.
+ */
 
-int     WriteOutput(void)
+int     ParseChunks(int fmt, char* pStart, char* pEnd, int cntChunk,
+                    int line, REMAP** prMod)
 {
-  int     rtn = 0;
-  REMAP** pArr = 0;
-
-do {
-  /* If no modules were found, set the OPT_NOMOD flag.  
-   * Note that the flag & 'cntMods' serve somewhat different purposes.
-   */
-  if (!cntMods)
-    opts |= OPT_NOMOD;
-
-  /* set the size of each XQSYM entry */
-  cbXQSYM = (opts & OPT_NOMOD) ? XQS_SYMSIZE_NOMOD : XQS_SYMSIZE_MOD;
+  static CHUNK  aChunk[MAX_THREADS];
 
-  /* Sort module and symbol entries by address. */
-  pArr = SortByAddress();
-  if (!pArr)
-    break;
+  int     ctr;
+  int     rtn = 1;
+  char *  pChar;
+  char *  ptr;
+  CHUNK * pc;
+
+  /* Divide the listing at line boundaries & give each chunk an arena. */
+  ptr = pStart;
+  for (ctr = 0; ctr < cntChunk; ctr++) {
+    pc = &aChunk[ctr];
+    pc->fmt    = fmt;
+    pc->tid    = 0;
+    pc->line   = line;
+    pc->recCnt = 0;
+    pc->modCnt = 0;
+    pc->failed = 0;
+    pc->rMod   = (ctr ? 0 : *prMod);
+    pc->pCache = &aDmCache[ctr];
+    pc->pStart = ptr;
+
+    if (ctr == cntChunk - 1)
+      ptr = pEnd;
+    else {
+      ptr = pStart + ((pEnd - pStart) / cntChunk) * (ctr + 1);
+      if (ptr < pc->pStart)
+        ptr = pc->pStart;
+      ptr = SplitPublics(fmt, ptr, pEnd);
+    }
+    pc->pEnd = ptr;
 
-  /* If requested, print a listing of modules & symbols. */
-  if (opts & OPT_LIST)
-    if (!PrintListing(pArr))
-      break;
+    /* Count this chunk's lines to get the nbr preceding the next one. */
+    for (pChar = pc->pStart;
+         (pChar = ScanNewline(pChar, pc->pEnd)) < pc->pEnd; pChar++)
+      line++;
 
-  /* Open the .xqs file. */
-  fo = fopen(fOut, "wb");
-  if (!fo) {
-    fprintf(stderr, "unable to open output file '%s'\n", fOut);
-    break;
+    if (!InitArena(&pc->arena)) {
+      while (ctr--)
+        FreeArena(&aChunk[ctr].arena);
+      return 0;
+    }
   }
 
-  /* Write the file header and module names.*/
-  if (!WriteHeader(pArr))
-    break;
+  /* Start a thread for every chunk but the first, which is parsed on
+   * this thread.  If a thread can't be started, parse its chunk here.
+   */
+  for (ctr = 1; ctr < cntChunk; ctr++) {
+    pc = &aChunk[ctr];
+    pc->tid = _beginthread(ParseChunk, 0, CB_THREADSTACK, pc);
+    if (pc->tid == -1) {
+      pc->tid = 0;
+      ParseChunk(pc);
+    }
+  }
+  ParseChunk(&aChunk[0]);
 
-  /* Write each segment's header, symbols, and strings. */
-  rtn = WriteSegs(pArr);
+  /* Wait for each thread, then add its arena's blocks and entries to
+   * the end of the main arena.  Nothing has to be copied or relocated.
+   */
+  for (ctr = 0; ctr < cntChunk; ctr++) {
+    pc = &aChunk[ctr];
+    if (pc->tid) {
+      TID   tid = pc->tid;
+      DosWaitThread(&tid, DCWW_WAIT);
+    }
 
-} while (0);
+    if (pc->failed)
+      rtn = -1;
+    if (pc->rMod)
+      *prMod = pc->rMod;
 
-  /* Clean up. */
-  if (pArr)
-    free(pArr);
-  if (fo)
-    fclose(fo);
+    JoinArena(&arena, &pc->arena);
+    recCnt  += pc->recCnt;
+    cntMods += pc->modCnt;
+  }
 
   return rtn;
 }
 
 /*****************************************************************************/
-/* Sort all entries by address. */
+/* This applies the same rules as the single-threaded parsers to find the
+ * first & last lines of a publics listing:  leading blank lines (and
+ * underlines for Watcom) are skipped, then the next one ends the listing.
+ * It returns the start of that line (or the end of the buffered lines),
+ * and also the start of the listing, the nbr of lines skipped, & the nbr
+ * of lines in the listing.  If fFirst is zero, the listing is already
+ * underway, so there's nothing to skip.
+ */
 
-REMAP** SortByAddress(void)
+char *  ScanPublics(int fmt, int fFirst, char** ppStart, int* pSkip, int* pCnt)
 {
-  int     ctr;
-  REMAP** pr;
-  REMAP** pArr;
-  REMAP * pRec;
-
-  pr = (REMAP**)malloc((recCnt + 1) * sizeof(REMAP*));
-  if (!pr) {
-    fprintf(stderr, "malloc failed for SortByAddress - bytes= %d\n",
-            recCnt * sizeof(REMAP*));
-    return 0;
-  }
+  int     blankOK = fFirst;
+  char *  ptr;
+  char *  pNext;
+  char *  pStart = (fFirst ? 0 : pMapCur);
 
-  pRec = (REMAP*)buffer;
-  pArr = pr;
-  ctr  = 0;
-  /* note:  the last valid pRec has a valid pRec->next; 
-   * pRec->next == null identifies the first invalid entry
-   */
-  while (pRec->next) {
-    if (!(pRec->type & REMAP_DUP)) {
-      *pArr++ = pRec;
-      ctr++;
-    }
-    pRec = pRec->next;
-  }
-  *pArr = 0;
+  *pSkip = 0;
+  *pCnt = 0;
 
-  qsort(pr, ctr, sizeof(REMAP*), AddressSorter);
+  for (ptr = pMapCur; ptr < pMapLast; ptr = pNext) {
+    char *  pChar;
 
-  /* Associate symbols with the preceding module entry (if any).
-   * Also, set a flag on each module entry that is referenced by a symbol.
-   * If there were multiple entries for a module, IbmMarkDuplicateMods()
-   * set the 2nd and subsequent entries' pRec->mod to point at the first
-   * entry.  Only that first one is referenced and marked as used;  the
-   * rest remain unused & unmarked.
-   */
-  if (!isWat && cntMods) {
-    REMAP * pMod = 0;
+    pNext = ScanNewline(ptr, pMapLast);
+    if (pNext < pMapLast)
+      pNext++;
 
-    pArr = pr;
-    pRec = *pArr;
-    while (pRec) {
-      if (pRec->type & REMAP_MOD) {
-        if (pRec->mod)
-          pMod = pRec->mod;
-        else
-          pMod = pRec;
-      }
-      else {
-        pRec->mod = pMod;
-        if (pMod)
-          pMod->type |= REMAP_USED;
-      }
+    for (pChar = ptr; pChar < pNext && strchr(pszWS, *pChar); pChar++)
+      ;
 
-      pArr++;
-      pRec = *pArr;
+    if (pChar == pNext || (fmt == PUBS_WAT && *pChar == '=')) {
+      if (pStart || !blankOK)
+        break;
+      if (fmt != PUBS_WAT)
+        blankOK = 0;
+      (*pSkip)++;
+      continue;
     }
+
+    if (!pStart)
+      pStart = ptr;
+    (*pCnt)++;
   }
 
-  return pr;
+  *ppStart = (pStart ? pStart : ptr);
+
+  return ptr;
 }
 
 /*****************************************************************************/
-/* qsort callback for sorting by address */
+/* Return the start of the first line at or after ptr where a new chunk
+ * can begin.  Watcom entries depend on the preceding "Module:" line, so
+ * its chunks have to start with one.
+ */
 
-int     AddressSorter(const void *key, const void *element)
+char *  SplitPublics(int fmt, char* ptr, char* pEnd)
 {
-  int     res;
-  ULONG   kType;
-  ULONG   eType;
+  char *  pChar;
 
-  res = (*(REMAP**)key)->seg - (*(REMAP**)element)->seg;
-  if (res)
-    return res;
+  if (ptr[-1] != '\n') {
+    ptr = ScanNewline(ptr, pEnd);
+    if (ptr >= pEnd)
+      return pEnd;
+    ptr++;
+  }
 
-  res = (*(REMAP**)key)->offs - (*(REMAP**)element)->offs;
-  if (res)
-    return res;
+  if (fmt != PUBS_WAT)
+    return ptr;
 
-  kType = (*(REMAP**)key)->type;
-  eType = (*(REMAP**)element)->type;
+  while (ptr < pEnd) {
+    pChar = ptr + strspn(ptr, " \t");
+    if (!strncmp(pChar, pszModule, 7) && strchr(pszWS, pChar[7]))
+      break;
 
-  res = (kType & REMAP_TYPE) - (eType & REMAP_TYPE);
-  if (res)
-    return res;
+    ptr = ScanNewline(ptr, pEnd);
+    if (ptr >= pEnd)
+      return pEnd;
+    ptr++;
+  }
 
-  return stricmp((*(REMAP**)key)->text, (*(REMAP**)element)->text);
+  return ptr;
 }
 
 /*****************************************************************************/
-/* Print a listing of modules & symbols by address. */
+/* Thread proc for StorePublicsMT().  Every line in the chunk has data. */
 
-int     PrintListing(REMAP** pr)
+void    ParseChunk(void* pv)
 {
-  FILE *  fl = 0;
+  int     ok;
+  int     line;
+  char *  ptr;
+  char *  pLine;
+  char *  pNext;
   REMAP * r;
-  REMAP * rMod = 0;
-  int     modCnt = 0;
-  int     symCnt = 0;
+  REMAP * rMod;
+  CHUNK * pc = (CHUNK*)pv;
 
-  fl = fopen(fList, "w");
-  if (!fl) {
-    fprintf(stderr, "unable to open list file '%s'\n", fList);
-    return 0;
-  }
+  rMod  = pc->rMod;
+  line  = pc->line;
+  pNext = pc->pStart;
 
-  /* Print a report header & column header. */
-  fprintf(fl, pszReportHdr, (opts & OPT_NOMOD) ? "" : " and source files", fOut);
-  fputs(pszColumnHdr, fl);
+  while ((pLine = NextLine(&pNext, pc->pEnd)) != 0) {
+    line++;
 
-  r = *pr;
-  while (r) {
+    r = NewRec(&pc->arena, pNext - pLine);
+    if (!r) {
+      pc->failed = 1;
+      break;
+    }
 
-    switch (r->type & REMAP_TYPE) {
-      case REMAP_MOD:
-        /* Only count modules that are referenced. */
-        if (r->type & REMAP_USED)
-          modCnt++;
+    switch (pc->fmt) {
+      case PUBS_IBM:
+        ptr = ScanSpace(pLine);
+        ok = IbmParsePublic(ptr, r, pc->workBuf, line, &pubSet, pc->pCache);
         break;
 
-      case REMAP_OBJ:
-        /* If the current entry points at a different module
-         * than the previous one, print the new module name.
-         */
-        if (r->mod != rMod) {
-          rMod = r->mod;
-          fprintf(fl, "\n %s\n", (rMod && rMod->text) ? rMod->text : "[unknown]");
-        }
+      case PUBS_BOR:
+        ptr = TrimLine(pLine);
+        ok = BorParsePublic(ptr, r, line);
+        break;
 
-        /* Print the entry & inc the symbol count. */
-        fprintf(fl, "   %04lX:%08lX  %s\n", r->seg, r->offs, r->text);
-        symCnt++;
+      case PUBS_WAT:
+        ok = WatParseLine(pLine, r, &rMod, pc->workBuf, line, pc->pCache);
+        if (ok == 2)
+          pc->modCnt++;
+        ok = (ok > 0);
         break;
 
       default:
-        /* Ooops... what's this? */
-        fprintf(fl, " ERROR:  unknown type= %lu\n", (r->type & REMAP_TYPE));
+        ok = 0;
         break;
     }
 
-    pr++;
-    r = *pr;
+    if (!ok)
+      continue;
+
+    AddRec(&pc->arena, r);
+    pc->recCnt++;
   }
 
-  /* Show the total number of modules & symbols. */
-  fprintf(fl, "\n Modules= %d  Symbols= %d\n\n", modCnt, symCnt);
-  fclose(fl);
+  pc->rMod = rMod;
 
-  return 1;
+  return;
 }
 
 /*****************************************************************************/
+/*  Entry storage                                                            */
+/*****************************************************************************/
+/* Each entry is placed immediately after the previous one unless the
+ * current block is too full, in which case a new block is started.
+ * Either way, the previous entry's 'next' points at it.  The space
+ * following the last entry always contains an end marker whose 'next'
+ * is null, so the list can be walked without knowing where it ends.
+ * Blocks are neither zeroed nor ever reallocated, so adding entries
+ * never moves the ones that were already stored.
+ */
 
-int     WriteHeader(REMAP** pArr)
+int     InitArena(ARENA* pa)
 {
-  int     rtn = 1;
-  ULONG   padMods = 0;
-  XQFILE  xqFile;
-  REMAP** pr;
+  memset(pa, 0, sizeof(ARENA));
 
-  memset(&xqFile, 0, sizeof(XQFILE));
-  xqFile.magic = XQFILE_MAGIC;
-  xqFile.cbStruct = sizeof(XQFILE);
-  xqFile.version = 1;
-  xqFile.firstSeg = sizeof(XQFILE);
+  if (!NewBlock(pa, 0))
+    return 0;
 
-  /* If mod info will be included, put the mod names immediately after
-   * this header and relocate the first segment header after the names.
-   */
-  if (!(opts & OPT_NOMOD)) {
-    xqFile.offsMod = sizeof(XQFILE);
+  pa->pFirst = (REMAP*)pa->pCur;
+
+  return 1;
+}
+
+/*****************************************************************************/
+/* Add a block with room for at least cbNeed bytes & make it current. */
+
+int     NewBlock(ARENA* pa, ULONG cbNeed)
+{
+  ULONG   cb = CB_ARENABLK;
+  char *  pBlk;
+
+  cbNeed += sizeof(char*) + sizeof(REMAP*);
+  if (cb < cbNeed)
+    cb = cbNeed;
+
+  pBlk = malloc(cb);
+  if (!pBlk) {
+    fprintf(stderr, "malloc for entry storage failed - size= %ld\n", cb);
+    return 0;
+  }
+
+  *(char**)pBlk = 0;
+  if (pa->pBlk)
+    *(char**)pa->pBlk = pBlk;
+  else
+    pa->pFirstBlk = pBlk;
+
+  pa->pBlk = pBlk;
+  pa->pCur = pBlk + sizeof(char*);
+  pa->pEnd = pBlk + cb;
+  ((REMAP*)pa->pCur)->next = 0;
+
+  pa->cntBlk++;
+  pa->cbAlloc += cb;
+
+  return 1;
+}
+
+/*****************************************************************************/
+/* Return space for an entry whose text comes from a line that is cbLine
+ * bytes long.  A demangled name may be longer than the line, so room
+ * is also left for the largest one Demangle() can produce.  The entry
+ * isn't part of the list until it's passed to AddRec(), so it can be
+ * abandoned simply by not doing so.
+ */
+
+REMAP * NewRec(ARENA* pa, ULONG cbLine)
+{
+  ULONG   cbNeed;
+  REMAP * r;
+
+  cbNeed = sizeof(REMAP) + cbLine + sizeof(workBuf) + CB_FLAGNAME;
+  if (cbNeed + sizeof(REMAP*) > (ULONG)(pa->pEnd - pa->pCur) &&
+      !NewBlock(pa, cbNeed))
+    return 0;
+
+  r = (REMAP*)pa->pCur;
+  r->next = 0;
+  r->type = 0;
+
+  return r;
+}
+
+/*****************************************************************************/
+/* Add a completed entry to the end of the list. */
+
+void    AddRec(ARENA* pa, REMAP* r)
+{
+  if (pa->pLast)
+    pa->pLast->next = r;
+  else
+    pa->pFirst = r;
+  pa->pLast = r;
+
+  pa->pCur = &r->text[r->lth];
+  pa->cbUsed += pa->pCur - (char*)r;
+
+  r->next = (REMAP*)pa->pCur;
+  r->next->next = 0;
+}
+
+/*****************************************************************************/
+/* Move pAdd's blocks & entries to the end of pa.  Whatever space remains
+ * in pa's current block is abandoned.
+ */
+
+void    JoinArena(ARENA* pa, ARENA* pAdd)
+{
+  if (!pAdd->pLast) {
+    FreeArena(pAdd);
+    return;
+  }
+
+  if (pa->pLast)
+    pa->pLast->next = pAdd->pFirst;
+  else
+    pa->pFirst = pAdd->pFirst;
+  pa->pLast = pAdd->pLast;
+
+  *(char**)pa->pBlk = pAdd->pFirstBlk;
+  pa->pBlk = pAdd->pBlk;
+  pa->pCur = pAdd->pCur;
+  pa->pEnd = pAdd->pEnd;
+
+  pa->cntBlk  += pAdd->cntBlk;
+  pa->cbAlloc += pAdd->cbAlloc;
+  pa->cbUsed  += pAdd->cbUsed;
+
+  memset(pAdd, 0, sizeof(ARENA));
+}
+
+/*****************************************************************************/
+
+void    FreeArena(ARENA* pa)
+{
+  char *  pBlk;
+  char *  pNext;
+
+  for (pBlk = pa->pFirstBlk; pBlk; pBlk = pNext) {
+    pNext = *(char**)pBlk;
+    free(pBlk);
+  }
+
+  memset(pa, 0, sizeof(ARENA));
+}
+
+/*****************************************************************************/
+/*  Utility Functions                                                        */
+/*****************************************************************************/
+/* Read lines until the "seek" string or either "stop" string is found */
+
+char**  SeekToHdr(char** pSeek, char** pStop, char** pStop2)
+{
+  char ** pRtn = 0;
+  char *  pLine;
+
+  while ((pLine = GetLine()) != 0) {
+
+    if (MatchArray(pSeek, pLine)) {
+      pRtn = pSeek;
+      break;
+    }
+
+    if (pStop) {
+      if (MatchArray(pStop, pLine)) {
+        pRtn = pStop;
+        break;
+      }
+    }
+
+    if (pStop2) {
+      if (MatchArray(pStop2, pLine)) {
+        pRtn = pStop2;
+        break;
+      }
+    }
+  }
+
+  return pRtn;
+}
+
+/*****************************************************************************/
+/* Match individual words in a string - this reduces the chance that a
+ * string will be missed due to formatting variations.
+ */
+
+int     MatchArray(char** pArray, char* pText)
+{
+  while (**pArray) {
+    pText = strstr(pText, *pArray);
+    if (!pText)
+      return 0;
+
+    pText += strlen(*pArray);
+    pArray++;
+  }
+
+  return 1;
+}
+
+/*****************************************************************************/
+/* This trims words in-place.  It returns the first non-whitespace character
+   in pTrim & puts a null after the last non-ws char.  If ppNext is supplied,
+   it points to the character after the inserted null.
+*/
+
+char*   Trim(char* pTrim, char** ppNext)
+{
+  char *  ptr;
+
+  if (ppNext)
+    *ppNext = 0;
+
+  if (!pTrim)
+    return 0;
+
+  pTrim = ScanSpace(pTrim);
+  if (!*pTrim)
+    return 0;
+
+  ptr = ScanWord(pTrim);
+  if (!*ptr)
+    return pTrim;
+
+  *ptr++ = 0;
+  if (ppNext && *ptr)
+    *ppNext = ptr;
+
+  return pTrim;
+}
+
+/*****************************************************************************/
+/* This trims a line in-place. */
+
+char *  TrimLine(char* pTrim)
+{
+  char *  ptr;
+
+  if (!pTrim)
+    return 0;
+
+  pTrim = ScanSpace(pTrim);
+  if (!*pTrim)
+    return 0;
+
+  ptr = strchr(pTrim, 0) - 1;
+  while (ptr > pTrim && strchr(pszWS, *ptr))
+    ptr--;
+  *(++ptr) = 0;
+
+  return pTrim;
+}
+
+/*****************************************************************************/
+/* Convert the flags generated when the function was demangled into
+ * strings that will be appended to the method name.
+ */
+
+char *  DecodeFlagName(ULONG flags)
+{
+  if (flags & REMAP_VTABLE)
+    return "::{vtable}";
+
+  if (flags & REMAP_THUNK)
+    return "::{thunk}";
+
+  if (flags & REMAP_TYPEINFO)
+    return "::{typeinfo}";
+
+  if (flags & REMAP_TYPENAME)
+    return "::{typename}";
+
+  if (flags & REMAP_GUARD)
+    return "::{guard_variable}";
+
+  if (flags & REMAP_VTT)
+    return "::{vtt}";
+
+  if (flags & REMAP_VIRTTHUNK)
+    return "::{virtual thunk}";
+
+  if (flags & REMAP_CONSTRUCT)
+    return "::{construction vtable}";
+
+  return "";
+}
+
+/*****************************************************************************/
+/* FNV-1a hash of a symbol's name. */
+
+ULONG   HashName(char* pName, int cb)
+{
+  ULONG   hash = 2166136261UL;
+
+  while (cb--)
+    hash = (hash ^ (UCHAR)*pName++) * 16777619UL;
+
+  return hash;
+}
+
+/*****************************************************************************/
+/* This demangles symbols for GCC using the builtin demangler.  If the
+ * same name has been seen before, its text & flags are taken from the
+ * calling thread's cache (pdc) instead.
+ */
+
+char *  Demangle(char* pIn, char* pOut, ULONG cbOut, ULONG* pFlags,
+                 DMCACHE* pdc)
+{
+  int     ndx;
+  ULONG   cbKey;
+  ULONG   hash;
+  ULONG   flags = 0;
+  char *  pKey;
+  char *  ptr;
+  DMENTRY * pde;
+
+  if (opts & OPT_NO_DEMANGLE)
+    return pIn;
+
+  if (opts & OPT_VAC)
+    return DemangleVAC(pIn, pOut, pFlags);
+
+  /* OPT_GCC */
+
+  /* Determine if this is mangled & whether to remove the leading character. */
+  if (!memcmp(pIn, "__Z", 3) || !memcmp(pIn, "@_Z", 3))
+    ndx = 1;
+  else
+  if (!memcmp(pIn, "_Z", 2))
+    ndx = 0;
+  else
+    return pIn;
+
+  *pOut = 0;
+
+  /* Mozilla (at least) appends a unique identifier to many symbols
+   * that the demangler can't handle.  If the leading characters of
+   * the identifier ("$w$") are found, remove the identifier.
+   */
+  ptr = strstr(pIn, pszTrouble);
+  if (ptr)
+    *ptr = 0;
+
+  pKey = &pIn[ndx];
+  if (!pdc || !pdc->cbMax)
+    return (DemangleGCC(pKey, pOut, cbOut, pFlags) ? pOut : pIn);
+
+  cbKey = strlen(pKey);
+  hash = HashName(pKey, cbKey);
+
+  pde = FindDemangled(pdc, pKey, cbKey, hash);
+  if (pde) {
+    pdc->cntHit++;
+    if (!pde->cbText)
+      return pIn;
+
+    memcpy(pOut, &pde->data[cbKey + 1], pde->cbText);
+    *pFlags |= pde->flags;
+    return pOut;
+  }
+  pdc->cntMiss++;
+
+  if (!DemangleGCC(pKey, pOut, cbOut, &flags)) {
+    CacheDemangled(pdc, pKey, cbKey, hash, 0, 0);
+    return pIn;
+  }
+
+  CacheDemangled(pdc, pKey, cbKey, hash, pOut, flags);
+  *pFlags |= flags;
+
+  return pOut;
+}
+
+/*****************************************************************************/
+/* This calls the gcc 3.x demangler, then has ConvertDemangled() tidy
+ * the result.  It returns null on failure.
+ */
+
+char *  DemangleGCC(char* pIn, char* pOut, ULONG cbOut, ULONG* pFlags)
+{
+  ULONG   cb;
+  DMOUT   dmo;
+
+  dmo.pBuf  = pOut;
+  dmo.cbBuf = cbOut;
+  dmo.cb    = 0;
+
+  *pOut = 0;
+  if (!cplus_demangle_v3_callback(pIn, 0, &DemangleCallback, &dmo))
+    return 0;
+
+  /* Trim any trailing whitespace. */
+  cb = dmo.cb;
+  while (cb > 1 && strchr(pszWS, pOut[cb-1]))
+    cb--;
+  pOut[cb] = 0;
+
+  ConvertDemangled(pOut, cb, pFlags);
+
+  return pOut;
+}
+
+/*****************************************************************************/
+/* This converts & removes the metadata in a demangled name & strips its
+ * template arguments, in place.  Besides the demangler's output, it's
+ * used for names that GNU ld has already demangled.  Rather than shifting
+ * the text each time something is removed, the prefix is skipped &
+ * StripTemplateArgs() copies the rest into place.
+ */
+
+void    ConvertDemangled(char* pOut, ULONG cb, ULONG* pFlags)
+{
+  char *  pSrc;
+  char *  ptr;
+
+  /* Convert metadata generated by the demangler into flags,
+   * then skip over the metadata.
+   */
+  pSrc = pOut;
+  if (memchr(pOut, ' ', cb)) {
+    if (!strncmp(pOut, szVtable, cbVtable)) {
+      *pFlags |= REMAP_VTABLE;
+      pSrc += cbVtable;
+    }
+    else
+    if (!strncmp(pOut, szThunk, cbThunk)) {
+      *pFlags |= REMAP_THUNK;
+      pSrc += cbThunk;
+
+      /* remove the argument list that gets included for thunks */
+      if ((ptr = strchr(pSrc, '(')) != 0)
+        *ptr = 0;
+    }
+    else
+    if (!strncmp(pOut, szTypeInfo, cbTypeInfo)) {
+      *pFlags |= REMAP_TYPEINFO;
+      pSrc += cbTypeInfo;
+    }
+    else
+    if (!strncmp(pOut, szTypeName, cbTypeName)) {
+      *pFlags |= REMAP_TYPENAME;
+      pSrc += cbTypeName;
+    }
+    else
+    if (!strncmp(pOut, szGuard, cbGuard)) {
+      *pFlags |= REMAP_GUARD;
+      pSrc += cbGuard;
+    }
+    else
+    if (!strncmp(pOut, szVTT, cbVTT)) {
+      *pFlags |= REMAP_VTT;
+      pSrc += cbVTT;
+    }
+    else
+    if (!strncmp(pOut, szConstruct, cbConstruct)) {
+      *pFlags |= REMAP_CONSTRUCT;
+      pSrc += cbConstruct;
+    }
+    else
+    if (!strncmp(pOut, szVirtThunk, cbVirtThunk)) {
+      *pFlags |= REMAP_VIRTTHUNK;
+      pSrc += cbVirtThunk;
+    }
+  }
+
+  StripTemplateArgs(pOut, pSrc);
+
+  return;
+}
+
+/*****************************************************************************/
+/* Copy pSrc to pOut, which may be the same buffer provided pOut <= pSrc,
+ * removing template arguments along the way.  Each '<' is matched with
+ * its '>' & both are skipped along with everything between them.
+ *
+ * If there are more '<' than '>', it's probably because this line
+ * contains "operator<" or "operator<<".  If the first one in the line
+ * ends at this '<', copy it & continue;  otherwise, leave the rest of
+ * the line as-is.  Since only the first operator can be skipped, the
+ * scan for a '>' only reaches the end of the line once or twice, so
+ * this takes linear time.
+ */
+
+void    StripTemplateArgs(char* pOut, char* pSrc)
+{
+  int     cnt;
+  char *  pDst = pOut;
+  char *  pRt;
+  char *  ptr;
+
+  while (*pSrc) {
+    if (*pSrc != '<') {
+      *pDst++ = *pSrc++;
+      continue;
+    }
+
+    for (pRt = pSrc + 1, cnt = 1; *pRt; pRt++) {
+      if (*pRt == '<')
+        cnt++;
+      else
+      if (*pRt == '>') {
+        cnt--;
+        if (!cnt)
+          break;
+      }
+    }
+
+    if (!cnt) {
+      pSrc = pRt + 1;
+      continue;
+    }
+
+    /* The text already copied must end with the first "operator". */
+    pRt = pDst - 8;
+    if (pRt < pOut || memcmp(pRt, "operator", 8))
+      break;
+    for (ptr = pOut; ptr < pRt; ptr++) {
+      if (!memcmp(ptr, "operator<", 9))
+        break;
+    }
+    if (ptr < pRt)
+      break;
+
+    *pDst++ = *pSrc++;
+    if (cnt > 1 && *pSrc == '<')
+      *pDst++ = *pSrc++;
+  }
+
+  memmove(pDst, pSrc, strlen(pSrc) + 1);
+
+  return;
+}
+
+/*****************************************************************************/
+/* Remove a function's argument list, along with any 'const', 'volatile',
+ * or reference qualifiers after it, from a demangled name in place.
+ * Text that follows the arguments (e.g. "::x" for a local static) means
+ * they're part of an enclosing name, so they're left alone.  Returns 1
+ * if an argument list was removed.
+ */
+
+int     StripArgs(char* pName)
+{
+  int     cnt;
+  ULONG   ctr;
+  char *  ptr;
+
+  /* remove qualifiers at the end of the name */
+  ctr = strlen(pName);
+  while (ctr) {
+    if (ctr > 6 && !strcmp(&pName[ctr-6], " const"))
+      ctr -= 6;
+    else
+    if (ctr > 9 && !strcmp(&pName[ctr-9], " volatile"))
+      ctr -= 9;
+    else
+    if (ctr > 3 && !strcmp(&pName[ctr-3], " &&"))
+      ctr -= 3;
+    else
+    if (ctr > 2 && !strcmp(&pName[ctr-2], " &"))
+      ctr -= 2;
+    else
+      break;
+    pName[ctr] = 0;
+  }
+
+  if (!ctr || pName[ctr-1] != ')')
+    return 0;
+
+  /* find the '(' that matches the final ')' */
+  for (ptr = &pName[ctr-2], cnt = 1; ptr > pName; ptr--) {
+    if (*ptr == '(') {
+      if (!(--cnt)) {
+        *ptr = 0;
+        return 1;
+      }
+    }
+    else
+    if (*ptr == ')')
+      cnt++;
+  }
+
+  return 0;
+}
+
+/*****************************************************************************/
+/* A demangled template function is preceded by its return type, which
+ * the demangler omits when it's told not to show arguments.  This finds
+ * the start of the qualified name by working back from its end, skipping
+ * balanced "<...>" & "(...)" groups (e.g. "(anonymous namespace)"), until
+ * it reaches a space that's outside of them.  An operator's name starts
+ * at "operator", since it may contain '<', '>', or a space.
+ */
+
+void    StripReturnType(char* pName)
+{
+  int     cnt;
+  char    chOpen;
+  char *  ptr;
+  char *  pOp;
+
+  ptr = strchr(pName, 0);
+  if (ptr == pName || ptr[-1] != '>')
+    return;
+
+  for (pOp = pName; (pOp = strstr(pOp, "operator")) != 0; pOp++)
+    ptr = pOp;
+
+  while (ptr > pName && ptr[-1] != ' ') {
+    ptr--;
+    if (*ptr != '>' && *ptr != ')')
+      continue;
+
+    chOpen = (*ptr == '>') ? '<' : '(';
+    for (cnt = 1; ptr > pName && cnt; ) {
+      ptr--;
+      if (*ptr == chOpen)
+        cnt--;
+      else
+      if (*ptr == (chOpen == '<' ? '>' : ')'))
+        cnt++;
+    }
+    if (cnt)
+      return;
+  }
+
+  if (ptr > pName)
+    memmove(pName, ptr, strlen(ptr) + 1);
+
+  return;
+}
+
+/*****************************************************************************/
+/*  Demangler cache                                                          */
+/*****************************************************************************/
+/* Return the entry for a mangled name or null if it isn't cached. */
+
+DMENTRY * FindDemangled(DMCACHE* pdc, char* pKey, ULONG cbKey, ULONG hash)
+{
+  DMENTRY * pde;
+
+  if (!pdc->pBuf)
+    return 0;
+
+  for (pde = pdc->aBucket[hash & pdc->mask]; pde; pde = pde->next) {
+    if (pde->hash == hash && pde->cbKey == cbKey &&
+        !memcmp(pde->data, pKey, cbKey))
+      break;
+  }
+
+  return pde;
+}
+
+/*****************************************************************************/
+/* Add a name & its demangled text (or null if it couldn't be demangled)
+ * to the cache.  If the cache is full, everything in it is discarded.
+ */
+
+void    CacheDemangled(DMCACHE* pdc, char* pKey, ULONG cbKey, ULONG hash,
+                       char* pText, ULONG flags)
+{
+  ULONG   cb;
+  ULONG   cbText;
+  DMENTRY * pde;
+
+  if (!pdc->pBuf && !InitDemangleCache(pdc))
+    return;
+
+  cbText = (pText ? strlen(pText) + 1 : 0);
+  cb = sizeof(DMENTRY) + cbKey + cbText;
+  cb = (cb + sizeof(DMENTRY*) - 1) & ~(sizeof(DMENTRY*) - 1);
+
+  if (cb > (ULONG)(pdc->pEnd - pdc->pCur)) {
+    if (cb > (ULONG)(pdc->pEnd - (char*)&pdc->aBucket[pdc->mask + 1]))
+      return;
+
+    memset(pdc->aBucket, 0, (pdc->mask + 1) * sizeof(DMENTRY*));
+    pdc->pCur = (char*)&pdc->aBucket[pdc->mask + 1];
+    pdc->cntFlush++;
+  }
+
+  pde = (DMENTRY*)pdc->pCur;
+  pdc->pCur += cb;
+
+  pde->hash   = hash;
+  pde->flags  = flags;
+  pde->cbKey  = cbKey;
+  pde->cbText = cbText;
+  memcpy(pde->data, pKey, cbKey);
+  pde->data[cbKey] = 0;
+  if (cbText)
+    memcpy(&pde->data[cbKey + 1], pText, cbText);
+
+  pde->next = pdc->aBucket[hash & pdc->mask];
+  pdc->aBucket[hash & pdc->mask] = pde;
+
+  return;
+}
+
+/*****************************************************************************/
+/* Allocate the cache's block & give about 1/16th of it to the buckets. */
+
+int     InitDemangleCache(DMCACHE* pdc)
+{
+  ULONG   cnt;
+
+  if (pdc->cbMax < CB_DMCACHEMIN) {
+    pdc->cbMax = 0;
+    return 0;
+  }
+
+  pdc->pBuf = malloc(pdc->cbMax);
+  if (!pdc->pBuf) {
+    fprintf(stderr, "malloc for demangler cache failed - size= %ld\n",
+            pdc->cbMax);
+    pdc->cbMax = 0;
+    return 0;
+  }
+
+  for (cnt = 64; cnt * 2 * 16 * sizeof(DMENTRY*) <= pdc->cbMax; cnt *= 2)
+    ;
+
+  pdc->mask = cnt - 1;
+  pdc->aBucket = (DMENTRY**)pdc->pBuf;
+  memset(pdc->aBucket, 0, cnt * sizeof(DMENTRY*));
+  pdc->pCur = (char*)&pdc->aBucket[cnt];
+  pdc->pEnd = pdc->pBuf + pdc->cbMax;
+
+  return 1;
+}
+
+/*****************************************************************************/
+
+void    FreeDemangleCache(DMCACHE* pdc)
+{
+  if (pdc->pBuf)
+    free(pdc->pBuf);
+
+  pdc->pBuf = 0;
+  pdc->pCur = 0;
+  pdc->pEnd = 0;
+  pdc->aBucket = 0;
+
+  return;
+}
+
+/*****************************************************************************/
+/* Called by the GCC demangler one or more times to copy the pieces
+ * of a demangled method to an output buffer.  pv is the DMOUT that
+ * DemangleGCC() uses to track the buffer & its current length.  As
+ * before, a piece that doesn't fit is dropped.
+ */
+
+void    DemangleCallback(const char* pSrc, size_t cbSrc, void* pv)
+{
+  DMOUT * p = (DMOUT*)pv;
+
+  if (p->cb + cbSrc + 1 < p->cbBuf) {
+    memcpy(p->pBuf + p->cb, pSrc, cbSrc);
+    p->cb += cbSrc;
+    p->pBuf[p->cb] = 0;
+  }
+
+  return;
+}
+
+/*****************************************************************************/
+/* This demangles symbols for VAC via demangl.dll.  The functions in
+ * demangl.dll all use Optlink which gcc 4.x can't handle, so they're
+ * invoked via wrapper functions in remap_vac.c.  Each wrapper has
+ * '_vac' appended to the function's original name.
+ */
+
+char*   DemangleVAC(char* pIn, char* pOut, ULONG* pFlags)
+{
+  char *    ptr;
+  char *    pEnd;
+  Name *    nm;
+  NameKind  nk;
+
+  *pOut = 0;
+
+  nm = demangle_vac(pIn, &ptr, (RegularNames | ClassNames | SpecialNames));
+  if (!nm)
+    return pIn;
+
+  nk = kind_vac(nm);
+
+  if (nk == MemberFunction || nk == Function) {
+
+    if (nk == MemberFunction) {
+      ptr = qualifier_vac(nm);
+      if (ptr) {
+        strcpy(pOut, ptr);
+        strcat(pOut, "::");
+      }
+    }
+    ptr = functionName_vac(nm);
+    if (ptr)
+      strcat(pOut, ptr);
+  }
+  else {
+    ptr = text_vac(nm);
+    if (!ptr)
+      return pIn;
+    strcpy(pOut, ptr);
+  }
+
+  if (nk == Special && (ptr = strstr(pOut, szVtableVAC)) != 0) {
+    *pFlags |= REMAP_VTABLE;
+    *ptr = 0;
+
+    /* vtable entries for subclasses are formatted '{subclass}class';
+     * this reformats it as 'class::subclass'
+     */
+    if (*pOut == '{' && (pEnd = strchr(pOut, '}')) != 0) {
+      *pEnd++ = 0;
+      *ptr++ = ':';
+      *ptr++ = ':';
+      strcpy(ptr, &pOut[1]);
+      strcpy(pOut, pEnd);
+    }
+  }
+
+  erase_vac(nm);
+
+  return pOut;
+}
+
+/*****************************************************************************/
+/*  Output Processing                                                        */
+/*****************************************************************************/
+
+int     WriteOutput(void)
+{
+  int     rtn = 0;
+  REMAP** pArr = 0;
+
+do {
+  /* If no modules were found, set the OPT_NOMOD flag.  
+   * Note that the flag & 'cntMods' serve somewhat different purposes.
+   */
+  if (!cntMods)
+    opts |= OPT_NOMOD;
+
+  /* set the size of each XQSYM entry */
+  cbXQSYM = (opts & OPT_NOMOD) ? XQS_SYMSIZE_NOMOD : XQS_SYMSIZE_MOD;
+
+  /* Sort module and symbol entries by address. */
+  pArr = SortByAddress();
+  if (!pArr)
+    break;
+
+  /* If requested, print a listing of modules & symbols. */
+  if (opts & OPT_LIST)
+    if (!PrintListing(pArr))
+      break;
+
+  /* If requested, find the offset of each symbol's name in the pool. */
+  if (opts & OPT_POOL)
+    if (!PoolNames(pArr))
+      break;
+
+  /* Open the .xqs file. */
+  hOut = open(fOut, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY,
+              S_IREAD | S_IWRITE);
+  if (hOut == -1) {
+    fprintf(stderr, "unable to open output file '%s'\n", fOut);
+    break;
+  }
+
+  /* If requested, size the segment directory. */
+  if (opts & OPT_SEGDIR)
+    cbDir = LayoutDir(pArr);
+
+  /* The entire file is assembled in memory, then written in one call. */
+  if (!AllocImage(pArr))
+    break;
+
+  /* Store the file header and module names.*/
+  if (!WriteHeader(pArr))
+    break;
+
+  /* Store each segment's header, symbols, and strings. */
+  if (!WriteSegs(pArr))
+    break;
+
+  if (write(hOut, pImg, offsImg) != (int)offsImg) {
+    fprintf(stderr, "error writing to output file - aborting\n");
+    break;
+  }
+
+  rtn = 1;
+
+} while (0);
+
+  /* Clean up. */
+  if (pArr)
+    free(pArr);
+  if (pImg) {
+    free(pImg);
+    pImg = 0;
+  }
+  if (hOut != -1) {
+    close(hOut);
+    hOut = -1;
+  }
+
+  return rtn;
+}
+
+/*****************************************************************************/
+/* Sort all entries by address. */
+
+REMAP** SortByAddress(void)
+{
+  int     ctr;
+  REMAP** pr;
+  REMAP** pArr;
+  REMAP * pRec;
+
+  pr = (REMAP**)malloc((recCnt + 1) * sizeof(REMAP*));
+  if (!pr) {
+    fprintf(stderr, "malloc failed for SortByAddress - bytes= %d\n",
+            recCnt * sizeof(REMAP*));
+    return 0;
+  }
+
+  pRec = arena.pFirst;
+  pArr = pr;
+  ctr  = 0;
+  /* note:  the last valid pRec has a valid pRec->next; 
+   * pRec->next == null identifies the first invalid entry
+   */
+  while (pRec->next) {
+    if (!(pRec->type & REMAP_DUP)) {
+      *pArr++ = pRec;
+      ctr++;
+    }
+    pRec = pRec->next;
+  }
+  *pArr = 0;
+
+  if (!SortKeysByAddress(pr, ctr))
+    qsort(pr, ctr, sizeof(REMAP*), AddressSorter);
+
+  /* Associate symbols with the preceding module entry (if any).
+   * Also, set a flag on each module entry that is referenced by a symbol.
+   * If there were multiple entries for a module, IbmMarkDuplicateMods()
+   * set the 2nd and subsequent entries' pRec->mod to point at the first
+   * entry.  Only that first one is referenced and marked as used;  the
+   * rest remain unused & unmarked.
+   */
+  if (!isWat && cntMods) {
+    REMAP * pMod = 0;
+
+    pArr = pr;
+    pRec = *pArr;
+    while (pRec) {
+      if (pRec->type & REMAP_MOD) {
+        if (pRec->mod)
+          pMod = pRec->mod;
+        else
+          pMod = pRec;
+      }
+      else {
+        pRec->mod = pMod;
+        if (pMod)
+          pMod->type |= REMAP_USED;
+      }
+
+      pArr++;
+      pRec = *pArr;
+    }
+  }
+
+  return pr;
+}
+
+/*****************************************************************************/
+/* qsort callback for sorting by address */
+
+int     AddressSorter(const void *key, const void *element)
+{
+  int     res;
+  ULONG   kType;
+  ULONG   eType;
+
+  res = (*(REMAP**)key)->seg - (*(REMAP**)element)->seg;
+  if (res)
+    return res;
+
+  res = (*(REMAP**)key)->offs - (*(REMAP**)element)->offs;
+  if (res)
+    return res;
+
+  kType = (*(REMAP**)key)->type;
+  eType = (*(REMAP**)element)->type;
+
+  res = (kType & REMAP_TYPE) - (eType & REMAP_TYPE);
+  if (res)
+    return res;
+
+  return stricmp((*(REMAP**)key)->text, (*(REMAP**)element)->text);
+}
+
+/*****************************************************************************/
+/* This produces the same order as qsort() with AddressSorter() without
+ * touching the entries for every comparison.  The linkers list their
+ * modules & publics in address order, so the entries usually form a
+ * few ascending runs of packed keys.  These are found while building
+ * the keys and combined with a k-way merge;  if there are too many,
+ * the keys get radix-sorted instead.  Both preserve the original order
+ * of entries with identical keys, so only those runs are then sorted
+ * by name.  This returns zero if there isn't enough memory.
+ */
+
+int     SortKeysByAddress(REMAP** pr, int cnt)
+{
+  int     ctr;
+  int     end;
+  int     cntRun;
+  REMAP * pRec;
+  SORTKEY * pKey;
+  SORTKEY * pSrc;
+  unsigned long long  key;
+  int     aRun[MAX_SORTRUNS + 1];
+
+  cntSortRuns = cnt ? 1 : 0;
+  if (cnt < 2)
+    return 1;
+
+  pKey = (SORTKEY*)malloc(cnt * 2 * sizeof(SORTKEY));
+  if (!pKey)
+    return 0;
+
+  /* Build the keys & note where each ascending run starts. */
+  aRun[0] = 0;
+  cntRun = 1;
+  for (ctr = 0; ctr < cnt; ctr++) {
+    pRec = pr[ctr];
+    key  = ((unsigned long long)pRec->seg << 36) |
+           ((unsigned long long)pRec->offs << 4) |
+           (pRec->type & REMAP_TYPE);
+
+    if (ctr && key < pKey[ctr - 1].key) {
+      if (cntRun < MAX_SORTRUNS)
+        aRun[cntRun] = ctr;
+      cntRun++;
+    }
+
+    pKey[ctr].key  = key;
+    pKey[ctr].pRec = pRec;
+    pKey[ctr].ndx  = ctr;
+  }
+  cntSortRuns = cntRun;
+
+  if (cntRun == 1)
+    pSrc = pKey;
+  else
+  if (cntRun <= MAX_SORTRUNS) {
+    aRun[cntRun] = cnt;
+    pSrc = MergeKeyRuns(pKey, pKey + cnt, aRun, cntRun);
+  }
+  else
+    pSrc = RadixSortKeys(pKey, pKey + cnt, cnt);
+
+  /* Sort runs of identical keys by name. */
+  for (ctr = 0; ctr < cnt; ctr = end) {
+    for (end = ctr + 1; end < cnt && pSrc[end].key == pSrc[ctr].key; end++)
+      ;
+    if (end - ctr > 1)
+      qsort(&pSrc[ctr], end - ctr, sizeof(SORTKEY), NameSorter);
+  }
+
+  for (ctr = 0; ctr < cnt; ctr++)
+    pr[ctr] = pSrc[ctr].pRec;
+
+  free(pKey);
+
+  return 1;
+}
+
+/*****************************************************************************/
+/* Merge the ascending runs of keys in pSrc into pDst.  aRun[] holds the
+ * start of each run followed by the total count.  Ties go to the earlier
+ * run, so entries with identical keys keep their original order.
+ */
+
+SORTKEY * MergeKeyRuns(SORTKEY* pSrc, SORTKEY* pDst, int* aRun, int cntRun)
+{
+  int     run;
+  int     best;
+  int     out;
+  int     cnt;
+  int     aPos[MAX_SORTRUNS];
+
+  for (run = 0; run < cntRun; run++)
+    aPos[run] = aRun[run];
+  cnt = aRun[cntRun];
+
+  for (out = 0; out < cnt; out++) {
+    best = -1;
+    for (run = 0; run < cntRun; run++) {
+      if (aPos[run] >= aRun[run + 1])
+        continue;
+      if (best < 0 || pSrc[aPos[run]].key < pSrc[aPos[best]].key)
+        best = run;
+    }
+    pDst[out] = pSrc[aPos[best]++];
+  }
+
+  return pDst;
+}
+
+/*****************************************************************************/
+/* LSD radix sort of the keys (8 bits per pass), skipping any pass where
+ * every key has the same digit.  pSrc & pDst are swapped after each pass;
+ * this returns whichever one ends up holding the sorted keys.
+ */
+
+SORTKEY * RadixSortKeys(SORTKEY* pSrc, SORTKEY* pDst, int cnt)
+{
+  int     ctr;
+  int     pass;
+  int     shift;
+  ULONG   sum;
+  ULONG   tmp;
+  ULONG * pCnt;
+  SORTKEY * pTmp;
+  ULONG   aCnt[6][256];
+
+  /* Count the occurrences of each digit. */
+  memset(aCnt, 0, sizeof(aCnt));
+  for (ctr = 0; ctr < cnt; ctr++)
+    for (pass = 0; pass < 6; pass++)
+      aCnt[pass][(ULONG)(pSrc[ctr].key >> (pass * 8)) & 0xff]++;
+
+  for (pass = 0; pass < 6; pass++) {
+    shift = pass * 8;
+    pCnt = aCnt[pass];
+    if (pCnt[(ULONG)(pSrc->key >> shift) & 0xff] == (ULONG)cnt)
+      continue;
+
+    for (ctr = 0, sum = 0; ctr < 256; ctr++) {
+      tmp = pCnt[ctr];
+      pCnt[ctr] = sum;
+      sum += tmp;
+    }
+
+    for (ctr = 0; ctr < cnt; ctr++)
+      pDst[pCnt[(ULONG)(pSrc[ctr].key >> shift) & 0xff]++] = pSrc[ctr];
+
+    pTmp = pSrc;
+    pSrc = pDst;
+    pDst = pTmp;
+  }
+
+  return pSrc;
+}
+
+/*****************************************************************************/
+/* qsort callback for sorting entries at the same address by name */
+
+int     NameSorter(const void *key, const void *element)
+{
+  int     res;
+
+  res = stricmp(((SORTKEY*)key)->pRec->text, ((SORTKEY*)element)->pRec->text);
+  if (res)
+    return res;
+
+  return ((SORTKEY*)key)->ndx - ((SORTKEY*)element)->ndx;
+}
+
+/*****************************************************************************/
+/* Print a listing of modules & symbols by address. */
+
+int     PrintListing(REMAP** pr)
+{
+  FILE *  fl = 0;
+  REMAP * r;
+  REMAP * rMod = 0;
+  int     modCnt = 0;
+  int     symCnt = 0;
+
+  fl = fopen(fList, "w");
+  if (!fl) {
+    fprintf(stderr, "unable to open list file '%s'\n", fList);
+    return 0;
+  }
+
+  /* Print a report header & column header. */
+  fprintf(fl, pszReportHdr, (opts & OPT_NOMOD) ? "" : " and source files", fOut);
+  fputs(pszColumnHdr, fl);
+
+  r = *pr;
+  while (r) {
+
+    switch (r->type & REMAP_TYPE) {
+      case REMAP_MOD:
+        /* Only count modules that are referenced. */
+        if (r->type & REMAP_USED)
+          modCnt++;
+        break;
+
+      case REMAP_OBJ:
+        /* If the current entry points at a different module
+         * than the previous one, print the new module name.
+         */
+        if (r->mod != rMod) {
+          rMod = r->mod;
+          fprintf(fl, "\n %s\n", (rMod && rMod->text) ? rMod->text : "[unknown]");
+        }
+
+        /* Print the entry & inc the symbol count. */
+        fprintf(fl, "   %04lX:%08lX  %s\n", r->seg, r->offs, r->text);
+        symCnt++;
+        break;
+
+      default:
+        /* Ooops... what's this? */
+        fprintf(fl, " ERROR:  unknown type= %lu\n", (r->type & REMAP_TYPE));
+        break;
+    }
+
+    pr++;
+    r = *pr;
+  }
+
+  /* Show the total number of modules & symbols. */
+  fprintf(fl, "\n Modules= %d  Symbols= %d\n\n", modCnt, symCnt);
+  fclose(fl);
+
+  return 1;
+}
+
+/*****************************************************************************/
+/* Give each distinct symbol name an offset in a file-wide pool so that
+ * identical names (e.g. overloads once their args are stripped) are only
+ * stored once.  Names are added in address order.  Each entry's offsPool
+ * is the offset of its name relative to the start of the pool.
+ */
+
+int     PoolNames(REMAP** pArr)
+{
+  ULONG   cnt = 0;
+  ULONG   mask;
+  ULONG   ndx;
+  REMAP*  r;
+  REMAP*  p;
+  REMAP** pr;
+  REMAP** aSlot;
+
+  for (pr = pArr; *pr; pr++) {
+    if ((*pr)->type & REMAP_OBJ)
+      cnt++;
+  }
+
+  /* an open-addressing table that's at least twice the nbr of names */
+  for (mask = 0x0F; mask < cnt * 2; mask = (mask << 1) | 1)
+    ;
+
+  aSlot = (REMAP**)calloc(mask + 1, sizeof(REMAP*));
+  if (!aSlot) {
+    fprintf(stderr, "calloc failed for string pool - bytes= %ld\n",
+            (ULONG)((mask + 1) * sizeof(REMAP*)));
+    return 0;
+  }
+
+  cbPool = 0;
+  cbPoolRaw = 0;
+  cntPoolNames = 0;
+
+  for (pr = pArr; *pr; pr++) {
+    r = *pr;
+    if (!(r->type & REMAP_OBJ))
+      continue;
+
+    cbPoolRaw += r->lth;
+
+    for (ndx = HashName(r->text, r->lth) & mask;
+         (p = aSlot[ndx]) != 0;
+         ndx = (ndx + 1) & mask) {
+      if (p->lth == r->lth && !memcmp(p->text, r->text, r->lth))
+        break;
+    }
+
+    /* If the name is already in the pool, share it. */
+    if (p) {
+      r->offsPool = p->offsPool;
+      continue;
+    }
+
+    aSlot[ndx] = r;
+    r->offsPool = cbPool;
+    cbPool += r->lth;
+    cntPoolNames++;
+  }
+
+  free(aSlot);
+
+  return 1;
+}
+
+/*****************************************************************************/
+/* Allocate a zero-filled buffer that's large enough for the entire file
+ * so padding never has to be written.  Rather than doing a separate pass
+ * to get the exact size, this assumes every segment needs the maximum
+ * amount of padding and that every entry's string goes into the file.
+ */
+
+int     AllocImage(REMAP** pArr)
+{
+  ULONG   cbText = 0;
+  ULONG   cnt = 0;
+  REMAP** pr;
+
+  for (pr = pArr; *pr; pr++) {
+    cbText += (*pr)->lth;
+    cnt++;
+  }
+
+  cbImg = sizeof(XQFILE) + 0x0F + cbText + (cnt * cbXQSYM) +
+          (256 * (sizeof(XQSEG) + 0x1E)) + cbDir;
+
+  /* Compressed data is never larger than the original, but each
+   * segment gets an XQZIP & each block of symbols gets an XQZBLK.
+   */
+  if (opts & OPT_ZIP)
+    cbImg += sizeof(XQZMOD) + (256 * sizeof(XQZIP)) +
+             ((cnt / CNT_ZIPBLKSYM + 256) * sizeof(XQZBLK));
+
+  /* Front-coding can add a byte per name & padding for each block. */
+  if (opts & OPT_FRONT)
+    cbImg += MaxSymBlock(cnt, 0) - (cnt * cbXQSYM) +
+             ((cnt / CNT_ZIPBLKSYM + 256) * 0x0F);
+
+  /* Pooled names are never larger than the originals but are padded. */
+  if (opts & OPT_POOL)
+    cbImg += 0x0F;
+
+  /* An index has no more than 2 pages per symbol & is padded. */
+  if (opts & OPT_INDEX)
+    cbImg += (256 * (sizeof(XQINDEX) + 0x1E)) + (cnt * 2 * sizeof(XQIDX));
+
+  /* A name index has an entry per symbol & a bucket per 2 symbols. */
+  if (opts & OPT_NAMEHASH)
+    cbImg += sizeof(XQHASH) + 0x1E + ((cnt / 2 + 2) * sizeof(ULONG)) +
+             (cnt * sizeof(XQHENT));
+  offsImg = 0;
+
+  pImg = (char*)calloc(cbImg, 1);
+  if (!pImg) {
+    fprintf(stderr, "calloc failed for output image - bytes= %ld\n", cbImg);
+    return 0;
+  }
+
+  return 1;
+}
+
+/*****************************************************************************/
+/* Copy data to the image & return the offset following it. */
+
+ULONG   PutImage(ULONG offs, void* pData, ULONG cb)
+{
+  assert(offs + cb <= cbImg);
+  memcpy(&pImg[offs], pData, cb);
+
+  return offs + cb;
+}
+
+/*****************************************************************************/
+
+int     WriteHeader(REMAP** pArr)
+{
+  ULONG   padMods = 0;
+  ULONG   offsEnd;
+  ULONG   offsData;
+  XQFILE  xqFile;
+  REMAP** pr;
+
+  /* The segment directory (if any) immediately follows this header,
+   * so everything else starts after it.
+   */
+  memset(&xqFile, 0, sizeof(XQFILE));
+  xqFile.magic = XQFILE_MAGIC;
+  xqFile.cbStruct = sizeof(XQFILE);
+  xqFile.version = 1;
+  xqFile.firstSeg = sizeof(XQFILE) + cbDir;
+
+  /* If mod info will be included, put the mod names immediately after
+   * this header and relocate the first segment header after the names.
+   */
+  if (opts & OPT_ZIP)
+    xqFile.flags = XQFLAG_ZIP;
+
+  if (!(opts & OPT_NOMOD) && (opts & OPT_ZIP)) {
+    xqFile.offsMod = sizeof(XQFILE) + cbDir;
+    xqFile.flags |= XQFLAG_ZIP_MOD;
+    xqFile.firstSeg = ZipMods(pArr, xqFile.offsMod);
+    if (!xqFile.firstSeg)
+      return 0;
+  }
+  else
+  if (!(opts & OPT_NOMOD)) {
+    xqFile.offsMod = sizeof(XQFILE) + cbDir;
+
+    for (pr = pArr; *pr; pr++) {
+      if (((*pr)->type & (REMAP_MOD | REMAP_USED)) == (REMAP_MOD | REMAP_USED))
+        xqFile.firstSeg += (*pr)->lth;
+    }
+    padMods = (0x10 - (xqFile.firstSeg & 0x0F)) & 0x0F;
+    xqFile.firstSeg += padMods;
+  }
+
+  /* If names are pooled, put the pool after the mod names and
+   * relocate the first segment header after the pool.
+   */
+  offsEnd = xqFile.firstSeg;
+  if (opts & OPT_POOL) {
+    xqFile.flags |= XQFLAG_POOL;
+    offsPool = xqFile.firstSeg;
+    xqFile.firstSeg += cbPool + ((0x10 - (cbPool & 0x0F)) & 0x0F);
+  }
+
+  /* With a directory, the segments' symbols start here but the chain
+   * starts at the directory's first header (unless there aren't any).
+   * LayoutSegs() fills in the directory's table.
+   */
+  offsData = xqFile.firstSeg;
+  if (opts & OPT_SEGDIR) {
+    xqFile.flags |= XQFLAG_SEGDIR;
+    xqFile.offsDir = sizeof(XQFILE);
+    if (xqDir.cntSeg)
+      xqFile.firstSeg = offsDirSeg;
+    PutImage(xqFile.offsDir, &xqDir, sizeof(XQSEGDIR));
+  }
+
+  /* Store the file header. */
+  PutImage(0, &xqFile, sizeof(XQFILE));
+
+  /* If appropriate, store the module name strings (unless they were
+   * compressed, in which case they're already in place).
+   */
+  if (!(opts & OPT_NOMOD) && !(opts & OPT_ZIP)) {
+    offsImg = xqFile.offsMod;
+    WriteMods(pArr, xqFile.offsMod, offsEnd, padMods);
+  }
+
+  if (opts & OPT_POOL)
+    WritePool(pArr);
+
+  offsImg = offsData;
+
+  return 1;
+}
+
+/*****************************************************************************/
+
+void    WriteMods(REMAP** pArr, ULONG offs, ULONG offsEnd, ULONG padMods)
+{
+  REMAP*  r;
+  REMAP** pr;
+
+  /* Store the strings associated with module entries referenced by symbols. */
+  for (pr = pArr; *pr; pr++) {
+    r = *pr;
+    if ((r->type & (REMAP_MOD | REMAP_USED)) != (REMAP_MOD | REMAP_USED))
+      continue;
+
+    r->offs = offs;
+    offsImg = PutImage(offsImg, r->text, r->lth);
+    offs += r->lth;
+  }
+
+  /* The image is zero-filled, so padding only needs to be skipped. */
+  offsImg += padMods;
+
+  /* Confirm we're where we should be (offsEnd already includes any padding). */
+  assert(offsImg == offsEnd);
+
+  return;
+}
+
+/*****************************************************************************/
+/* Store each distinct symbol name at offsPool.  Names were given offsets
+ * in the order they're encountered here, so a name is stored only if its
+ * offset is the current end of the pool;  any other is a duplicate.
+ */
+
+void    WritePool(REMAP** pArr)
+{
+  ULONG   offs = 0;
+  REMAP** pr;
+
+  for (pr = pArr; *pr; pr++) {
+    if (!((*pr)->type & REMAP_OBJ) || (*pr)->offsPool != offs)
+      continue;
+
+    PutImage(offsPool + offs, (*pr)->text, (*pr)->lth);
+    offs += (*pr)->lth;
+  }
+
+  assert(offs == cbPool);
+
+  return;
+}
+
+/*****************************************************************************/
+/* Compress the strings associated with module entries referenced by
+ * symbols & store them after an XQZMOD at offsMod.  Each entry's offset
+ * is set as though the strings had been stored uncompressed.  This
+ * returns the offset following the padded data, or zero on failure.
+ */
+
+ULONG   ZipMods(REMAP** pArr, ULONG offsMod)
+{
+  ULONG   offs = 0;
+  ULONG   offsData;
+  char *  pRaw;
+  REMAP*  r;
+  REMAP** pr;
+  XQZMOD  xqzMod;
+
+  xqzMod.cbRaw = 0;
+  for (pr = pArr; *pr; pr++) {
+    if (((*pr)->type & (REMAP_MOD | REMAP_USED)) == (REMAP_MOD | REMAP_USED))
+      xqzMod.cbRaw += (*pr)->lth;
+  }
+
+  pRaw = (char*)malloc(xqzMod.cbRaw + 1);
+  if (!pRaw) {
+    fprintf(stderr, "malloc failed for module names - bytes= %ld\n",
+            xqzMod.cbRaw);
+    return 0;
+  }
+
+  for (pr = pArr; *pr; pr++) {
+    r = *pr;
+    if ((r->type & (REMAP_MOD | REMAP_USED)) != (REMAP_MOD | REMAP_USED))
+      continue;
+
+    r->offs = offsMod + offs;
+    memcpy(&pRaw[offs], r->text, r->lth);
+    offs += r->lth;
+  }
+
+  /* If compression doesn't make them smaller, store the names as-is. */
+  offsData = offsMod + sizeof(XQZMOD);
+  assert(offsData + xqzMod.cbRaw <= cbImg);
+  xqzMod.cbData = XqzPack(pRaw, xqzMod.cbRaw, &pImg[offsData], xqzMod.cbRaw);
+  if (!xqzMod.cbData) {
+    memcpy(&pImg[offsData], pRaw, xqzMod.cbRaw);
+    xqzMod.cbData = xqzMod.cbRaw;
+  }
+  free(pRaw);
+
+  PutImage(offsMod, &xqzMod, sizeof(XQZMOD));
+  cbZipRaw    += xqzMod.cbRaw;
+  cbZipStored += xqzMod.cbData;
+
+  offs = offsData + xqzMod.cbData;
+  return offs + ((0x10 - (offs & 0x0F)) & 0x0F);
+}
+
+/*****************************************************************************/
+/* Segments are stored in two phases.  First, the position of every
+ * segment's header, symbols, & strings is calculated.  Then, since no
+ * segment depends on any other, they're stored at those positions -
+ * on multiple threads if requested and there's enough to do.
+ */
+
+int     WriteSegs(REMAP** pArr)
+{
+  int     cntSeg;
+  int     ctr;
+  void    (*pfn)(SEGLAYOUT*);
+
+  cntSeg = LayoutSegs(pArr);
+
+  /* Compressed, packed, & front-coded segments are built in separate
+   * buffers, then placed once their sizes are known.
+   */
+  if (opts & OPT_ZIP)
+    pfn = ZipSyms;
+  else
+  if (opts & OPT_PACK)
+    pfn = PackSyms;
+  else
+  if (opts & OPT_FRONT)
+    pfn = FrontSyms;
+  else
+    pfn = WriteSyms;
+
+  if (cntThreads > 1 && cntSeg > 1)
+    WriteSegsMT(cntSeg, pfn);
+  else
+    for (ctr = 0; ctr < cntSeg; ctr++)
+      pfn(&aLayout[ctr]);
+
+  if ((opts & (OPT_ZIP | OPT_FRONT | OPT_PACK)) && !PlaceSegs(cntSeg))
+    return 0;
+
+  /* The name index needs the final position of every segment. */
+  if ((opts & OPT_NAMEHASH) && cntSeg)
+    return WriteNameIndex(cntSeg);
+
+  return 1;
+}
+
+/*****************************************************************************/
+/* Calculate the layout of each segment that has symbols & return the
+ * nbr of segments.  On exit, offsImg is the end of the last segment.
+ */
+
+int     LayoutSegs(REMAP** pArr)
+{
+  int     cntSeg = 0;
+  ULONG   cbStrings;
+  ULONG   offsEnd;
+  REMAP** pStart;
+  REMAP** pStop;
+  SEGLAYOUT*  pl;
+
+  pStart = pArr;
+  while (*pStart) {
+
+    pl = &aLayout[cntSeg];
+    memset(&pl->xqSeg, 0, sizeof(XQSEG));
+    pl->xqSeg.magic    = XQSEG_MAGIC;
+    pl->xqSeg.cbStruct = sizeof(XQSEG);
+    pl->xqSeg.cbXQSYM  = cbXQSYM;
+    pl->xqSeg.seg      = (*pStart)->seg;
+
+    cbStrings = 0;
+    pStop = pStart;
+    pl->pData = 0;
+    pl->cbData = 0;
+    pl->fFront = 0;
+    pl->fPack = 0;
+
+    /* Count the number of symbols in this segment and calculate the
+     * aggregate length of the strings associated with those symbols
+     * (unless they're in the pool).
+     */
+    while (*pStop && (*pStop)->seg == pl->xqSeg.seg) {
+      if ((*pStop)->type & REMAP_OBJ) {
+        if (!(opts & OPT_POOL))
+          cbStrings += (*pStop)->lth;
+        pl->xqSeg.cntSym++;
+      }
+      pStop++;
+    }
+
+    /* If this seg has no symbols, skip it. */
+    if (!pl->xqSeg.cntSym) {
+      pStart = pStop;
+      continue;
+    }
+
+    /* XQSYM entries start at the current pos + the sizeof XQSEG,
+     * unless the XQSEG is in the directory.
+     */
+    pl->pStart  = pStart;
+    pl->pStop   = pStop;
+    pl->cbStrings = cbStrings;
+    pl->offsSeg = offsImg;
+    if (opts & OPT_SEGDIR) {
+      pl->offsHdr = offsDirSeg + cntSeg * sizeof(XQSEG);
+      pl->xqSeg.offsSym = offsImg;
+      ((USHORT*)&pImg[sizeof(XQFILE) + sizeof(XQSEGDIR)])
+                [pl->xqSeg.seg - xqDir.segBase] = (USHORT)(cntSeg + 1);
+    }
+    else {
+      pl->offsHdr = offsImg;
+      pl->xqSeg.offsSym = offsImg + sizeof(XQSEG);
+    }
+
+    /* Calc any padding needed after the XQSYM array,
+     * then calc the position of the symbol's strings.
+     */
+    pl->padSym = (0x10 - ((pl->xqSeg.cntSym * cbXQSYM) & 0x0F)) & 0x0F;
+    pl->offsStrings = pl->xqSeg.offsSym + (pl->xqSeg.cntSym * cbXQSYM) +
+                      pl->padSym;
+
+    /* If requested, the address index follows the strings
+     * on a 16-byte boundary.
+     */
+    offsEnd = pl->offsStrings + cbStrings;
+    pl->cbIndex = 0;
+    if (opts & OPT_INDEX) {
+      pl->cbIndex = LayoutIndex(pl);
+      pl->xqSeg.offsIndex = (offsEnd + 0x0F) & ~0x0F;
+      offsEnd = pl->xqSeg.offsIndex + pl->cbIndex;
+    }
+
+    /* Calc padding for the strings (or index), then calc the offset
+     * of the next XQSEG header.  The last segment is fixed up below.
+     */
+    pl->padStrings = (0x10 - (offsEnd & 0x0F)) & 0x0F;
+    pl->xqSeg.offsNext = offsEnd + pl->padStrings;
+
+    /* Headers in the directory are chained in order. */
+    if (opts & OPT_SEGDIR)
+      pl->xqSeg.offsNext = (cntSeg + 1 < (int)xqDir.cntSeg) ?
+                           pl->offsHdr + sizeof(XQSEG) : 0;
+
+    offsImg = offsEnd + pl->padStrings;
+    cntSeg++;
+    pStart = pStop;
+  }
+
+  /* The last segment with symbols ends the chain & isn't padded, even
+   * if it's followed by entries that aren't symbols.
+   */
+  if (cntSeg) {
+    pl = &aLayout[cntSeg - 1];
+    offsImg -= pl->padStrings;
+    pl->padStrings = 0;
+    pl->xqSeg.offsNext = 0;
+  }
+
+  assert(!(opts & OPT_SEGDIR) || cntSeg == (int)xqDir.cntSeg);
+  return cntSeg;
+}
+
+/*****************************************************************************/
+/* Choose the page size for a segment's address index & return the size
+ * of the index.  Pages are normally 4k but may be larger if the symbols
+ * are sparse, so the index never has more than 2 pages per symbol.
+ */
+
+ULONG   LayoutIndex(SEGLAYOUT* pl)
+{
+  ULONG     first;
+  ULONG     last;
+  REMAP**   pr;
+  XQINDEX*  pi = &pl->xqIndex;
+
+  /* Symbols are sorted, so the first & last have the range. */
+  for (pr = pl->pStart; !((*pr)->type & REMAP_OBJ); pr++)
+    ;
+  first = (*pr)->offs;
+  for (pr = pl->pStop - 1; !((*pr)->type & REMAP_OBJ); pr--)
+    ;
+  last = (*pr)->offs;
+
+  pi->magic    = XQINDEX_MAGIC;
+  pi->cbStruct = sizeof(XQINDEX);
+  pi->shift    = INDEX_SHIFT;
+  while ((last >> pi->shift) - (first >> pi->shift) >= pl->xqSeg.cntSym * 2)
+    pi->shift++;
+  pi->base     = first >> pi->shift;
+  pi->cntPage  = (last >> pi->shift) - pi->base + 1;
+
+  return sizeof(XQINDEX) + pi->cntPage * sizeof(XQIDX);
+}
+
+/*****************************************************************************/
+/* Count the segments that have symbols & the range of their seg nbrs,
+ * then return the size of the segment directory including its headers.
+ * Entries are sorted by seg, so the first & last symbols have the range.
+ */
+
+ULONG   LayoutDir(REMAP** pArr)
+{
+  USHORT  segLast = 0;
+  REMAP** pr;
+
+  memset(&xqDir, 0, sizeof(XQSEGDIR));
+  xqDir.magic    = XQSEGDIR_MAGIC;
+  xqDir.cbStruct = sizeof(XQSEGDIR);
+  xqDir.cbXQSEG  = sizeof(XQSEG);
+
+  for (pr = pArr; *pr; pr++) {
+    if (!((*pr)->type & REMAP_OBJ))
+      continue;
+
+    if (!xqDir.cntSeg)
+      xqDir.segBase = (USHORT)(*pr)->seg;
+    if (!xqDir.cntSeg || (USHORT)(*pr)->seg != segLast)
+      xqDir.cntSeg++;
+    segLast = (USHORT)(*pr)->seg;
+  }
+
+  if (xqDir.cntSeg)
+    xqDir.cntSlot = segLast - xqDir.segBase + 1;
+
+  /* The headers start on a 16-byte boundary after the table. */
+  offsDirSeg = sizeof(XQFILE) +
+               ((sizeof(XQSEGDIR) + xqDir.cntSlot * sizeof(USHORT) + 0x0F) &
+                ~0x0F);
+
+  return offsDirSeg - sizeof(XQFILE) + xqDir.cntSeg * sizeof(XQSEG);
+}
+
+/*****************************************************************************/
+/* Divide the segments into contiguous ranges of roughly equal size,
+ * then store each range on its own thread.  The first range is stored
+ * on this thread, as is any whose thread can't be started.
+ */
+
+void    WriteSegsMT(int cntSeg, void (*pfn)(SEGLAYOUT*))
+{
+  int     ctr;
+  int     cntWork;
+  ULONG   cbTotal;
+  ULONG   cbEach;
+  SEGLAYOUT*  pl;
+  SEGLAYOUT*  pEnd = &aLayout[cntSeg];
+  SEGWORK aWork[MAX_THREADS];
+
+  cbTotal = offsImg - aLayout[0].offsSeg;
+  cntWork = cbTotal / MIN_CHUNK;
+  if (cntWork > cntThreads)
+    cntWork = cntThreads;
+  if (cntWork > cntSeg)
+    cntWork = cntSeg;
+  if (cntWork < 2) {
+    for (pl = aLayout; pl < pEnd; pl++)
+      pfn(pl);
+    return;
+  }
+
+  /* A segment goes in the first range whose share of the total extends
+   * past the segment's midpoint.  Some ranges may end up empty.
+   */
+  cbEach = cbTotal / cntWork;
+  pl = aLayout;
+  for (ctr = 0; ctr < cntWork; ctr++) {
+    aWork[ctr].tid = 0;
+    aWork[ctr].pfn = pfn;
+    aWork[ctr].pFirst = pl;
+    if (ctr == cntWork - 1)
+      pl = pEnd;
+    else
+      while (pl < pEnd &&
+             (pl->offsSeg + ((pl + 1 < pEnd) ? pl[1].offsSeg : offsImg)) / 2 -
+             aLayout[0].offsSeg < cbEach * (ctr + 1))
+        pl++;
+    aWork[ctr].pStop = pl;
+  }
+
+  for (ctr = 1; ctr < cntWork; ctr++) {
+    if (aWork[ctr].pFirst == aWork[ctr].pStop)
+      continue;
+    aWork[ctr].tid = _beginthread(WriteSegRange, 0, CB_THREADSTACK, &aWork[ctr]);
+    if (aWork[ctr].tid == -1) {
+      aWork[ctr].tid = 0;
+      WriteSegRange(&aWork[ctr]);
+    }
+  }
+  WriteSegRange(&aWork[0]);
+
+  for (ctr = 1; ctr < cntWork; ctr++) {
+    if (aWork[ctr].tid) {
+      TID   tid = aWork[ctr].tid;
+      DosWaitThread(&tid, DCWW_WAIT);
+    }
+  }
+
+  return;
+}
+
+/*****************************************************************************/
+/* thread proc for WriteSegsMT() */
+
+void    WriteSegRange(void* pv)
+{
+  SEGWORK*    pw = (SEGWORK*)pv;
+  SEGLAYOUT*  pl;
+
+  for (pl = pw->pFirst; pl < pw->pStop; pl++)
+    pw->pfn(pl);
+
+  return;
+}
+
+/*****************************************************************************/
+/* Store a segment's header, symbols, & strings.  This only touches the
+ * part of the image that belongs to the segment, so it's thread-safe.
+ */
+
+void    WriteSyms(SEGLAYOUT* pl)
+{
+  ULONG     offs;
+  ULONG     pos;
+  REMAP**   pr;
+  REMAP *   r;
+  XQSYM     xqs;
+
+  PutImage(pl->offsHdr, &pl->xqSeg, sizeof(XQSEG));
+  offs = pl->xqSeg.offsSym;
+
+  memset(&xqs, 0, sizeof(xqs));
+  pos = pl->offsStrings;
+
+  /* Store XQSYM entries, */
+  for (pr = pl->pStart; pr < pl->pStop; pr++) {
+    r = *pr;
+
+    /* Ignore module entries. */
+    if (!(r->type & REMAP_OBJ))
+      continue;
+
+    xqs.address  = r->offs;
+    xqs.cbName   = r->lth;
+    if (opts & OPT_POOL)
+      xqs.offsName = offsPool + r->offsPool;
+    else {
+      xqs.offsName = pos;
+      pos += r->lth;
+    }
+
+    /* Store module references if appropriate.  Note:  OPT_NOMOD may
+     * be set by user request or because there was no module info.
+     */
+    if (!(opts & OPT_NOMOD)) {
+      if (r->mod) {
+        xqs.cbMod   = r->mod->lth;
+        xqs.offsMod = r->mod->offs;
+      }
+      else {
+        xqs.cbMod   = 0;
+        xqs.offsMod = 0;
+      }
+    }
+
+    offs = PutImage(offs, &xqs, cbXQSYM);
+  }
+
+  /* Skip the padding after the XQSYMs & confirm we're where we should be. */
+  offs += pl->padSym;
+  assert(offs == pl->offsStrings);
+
+  /* Store the symbols' strings (unless they're in the pool). */
+  for (pr = pl->pStart; pr < pl->pStop && !(opts & OPT_POOL); pr++) {
+    if (!((*pr)->type & REMAP_OBJ))
+      continue;
+
+    offs = PutImage(offs, (*pr)->text, (*pr)->lth);
+  }
+
+  /* Confirm we're where we should be (pos doesn't include any padding). */
+  assert(offs == pos);
+
+  if (pl->cbIndex)
+    offs = StoreIndex(pl);
+  assert(offs + pl->padStrings <= cbImg);
+
+  return;
+}
+
+/*****************************************************************************/
+/* Return the most space StoreSymBlock() could need for cntSym symbols
+ * whose names total cbStrings bytes.  Front-coding may add a byte per
+ * name plus padding before the names & after each block of names.
+ */
+
+ULONG   MaxSymBlock(ULONG cntSym, ULONG cbStrings)
+{
+  ULONG   cb = cntSym * cbXQSYM + cbStrings;
+
+  if (opts & OPT_FRONT)
+    cb += cntSym + 0x0F + (cntSym / XQF_RESTART + 1) * 0x0F;
+
+  return cb;
+}
+
+/*****************************************************************************/
+/* Return the size of the names in [pStart, pStop) if they were front-coded
+ * (including the worst-case padding before the first block).  Segments
+ * whose names don't get smaller are stored normally.
+ */
+
+ULONG   FrontSize(REMAP** pStart, REMAP** pStop)
+{
+  ULONG     cb = 0x0F;
+  ULONG     cbShared;
+  ULONG     ndx = 0;
+  REMAP**   pr;
+  REMAP *   pPrev = 0;
+
+  for (pr = pStart; pr < pStop; pr++) {
+    if (!((*pr)->type & REMAP_OBJ))
+      continue;
+
+    if (ndx == XQF_RESTART || !pPrev) {
+      cb = (cb + 0x0F) & ~0x0F;
+      cb += (*pr)->lth;
+      ndx = 0;
+    }
+    else {
+      for (cbShared = 0; pPrev->text[cbShared] &&
+           pPrev->text[cbShared] == (*pr)->text[cbShared]; cbShared++)
+        ;
+      cb += (*pr)->lth - cbShared +
+            ((cbShared < 0x80) ? 1 : (cbShared < 0x4000) ? 2 : 3);
+    }
+    pPrev = *pr;
+    ndx++;
+  }
+
+  return cb;
+}
+
+/*****************************************************************************/
+/* Store an XQSYM array for the cntSym symbols in [pStart, pStop) followed
+ * by their names.  offsName is relative to pOut (unless the names are in
+ * the pool).  If names are front-coded,
+ * they start on a 16-byte boundary & each restart block is padded to one.
+ * This returns the total size & the size of the names (incl. padding).
+ */
+
+ULONG   StoreSymBlock(REMAP** pStart, REMAP** pStop, ULONG cntSym,
+                      int fFront, char* pOut, ULONG* pcbNames)
+{
+  ULONG     cbSym;
+  ULONG     pos;
+  ULONG     ctr = 0;
+  ULONG     ndx = 0;
+  ULONG     offsBlk = 0;
+  REMAP**   pr;
+  REMAP *   r;
+  REMAP *   pPrev = 0;
+  XQSYM     xqs;
+
+  memset(&xqs, 0, sizeof(xqs));
+  cbSym = cntSym * cbXQSYM;
+  pos = cbSym;
+
+  for (pr = pStart; pr < pStop; pr++) {
+    r = *pr;
+    if (!(r->type & REMAP_OBJ))
+      continue;
+
+    xqs.address = r->offs;
+    xqs.cbName  = r->lth;
+
+    /* Start a new restart block on a 16-byte boundary when needed. */
+    if (fFront) {
+      if (ndx == XQF_RESTART || !pPrev) {
+        while (pos & 0x0F)
+          pOut[pos++] = 0;
+        offsBlk = pos;
+        ndx = 0;
+        pPrev = 0;
+      }
+      xqs.offsName = offsBlk + ndx;
+      pos += XqfPutName(&pOut[pos], (pPrev ? pPrev->text : 0), r->text);
+      pPrev = r;
+      ndx++;
+    }
+    else
+    if (opts & OPT_POOL)
+      xqs.offsName = offsPool + r->offsPool;
+    else {
+      xqs.offsName = pos;
+      memcpy(&pOut[pos], r->text, r->lth);
+      pos += r->lth;
+    }
+
+    if (!(opts & OPT_NOMOD)) {
+      if (r->mod) {
+        xqs.cbMod   = r->mod->lth;
+        xqs.offsMod = r->mod->offs;
+      }
+      else {
+        xqs.cbMod   = 0;
+        xqs.offsMod = 0;
+      }
+    }
+
+    memcpy(&pOut[ctr++ * cbXQSYM], &xqs, cbXQSYM);
+  }
+  assert(ctr == cntSym);
+
+  *pcbNames = pos - cbSym;
+
+  return pos;
+}
+
+/*****************************************************************************/
+/* Build a segment's XQSYM array & names in its own buffer, front-coding
+ * the names if requested & that makes them smaller.  Its offsName values
+ * are relative to the buffer until PlaceSegs() stores it.  If memory
+ * isn't available, pl->pData is left null.
+ */
+
+void    FrontSyms(SEGLAYOUT* pl)
+{
+  pl->fFront = (opts & OPT_FRONT) &&
+               FrontSize(pl->pStart, pl->pStop) < pl->cbStrings;
+
+  pl->pData = (char*)malloc(MaxSymBlock(pl->xqSeg.cntSym, pl->cbStrings));
+  if (!pl->pData)
+    return;
+
+  pl->cbData = StoreSymBlock(pl->pStart, pl->pStop, pl->xqSeg.cntSym,
+                             pl->fFront, pl->pData, &pl->cbNames);
+
+  return;
+}
+
+/*****************************************************************************/
+/* Build a segment's XQSYM array & names with FrontSyms(), then replace
+ * the array with its packed equivalent if that's smaller.  The names
+ * are copied after the packed data at the same position relative to a
+ * 16-byte boundary so front-coded offsets remain valid.  Only each
+ * block's offsName has to be adjusted since the rest are relative.
+ */
+
+void    PackSyms(SEGLAYOUT* pl)
+{
+  int       fMod;
+  ULONG     cntBlk;
+  ULONG     ctr;
+  ULONG     cbSym;
+  ULONG     offs;
+  char *    pPack;
+  XQSYM *   pSym;
+  XQPACK*   pp;
+  XQPBLK*   pb = 0;
+  XQPSYM    xqpPrev;
+  XQPSYM    xqpSym;
+
+  FrontSyms(pl);
+  if (!pl->pData)
+    return;
+
+  fMod = cbXQSYM >= XQS_SYMSIZE_MOD;
+  cbSym = pl->xqSeg.cntSym * cbXQSYM;
+  cntBlk = (pl->xqSeg.cntSym + CNT_PACKBLKSYM - 1) / CNT_PACKBLKSYM;
+  offs = sizeof(XQPACK) + cntBlk * sizeof(XQPBLK);
+
+  /* If memory isn't available, the array is kept. */
+  pPack = (char*)malloc(offs + pl->xqSeg.cntSym * XQP_MAXSYM + 0x0F +
+                        pl->cbData - cbSym);
+  if (!pPack)
+    return;
+
+  pp = (XQPACK*)pPack;
+  pp->magic     = XQPACK_MAGIC;
+  pp->cbStruct  = sizeof(XQPACK);
+  pp->cbXQPBLK  = sizeof(XQPBLK);
+  pp->cntBlk    = cntBlk;
+  pp->cntBlkSym = CNT_PACKBLKSYM;
+
+  memset(&xqpSym, 0, sizeof(xqpSym));
+  for (ctr = 0; ctr < pl->xqSeg.cntSym; ctr++) {
+    pSym = (XQSYM*)&pl->pData[ctr * cbXQSYM];
+    xqpSym.address  = pSym->address;
+    xqpSym.offsName = pSym->offsName;
+    xqpSym.cbName   = pSym->cbName;
+    if (fMod) {
+      xqpSym.offsMod = pSym->offsMod;
+      xqpSym.cbMod   = pSym->cbMod;
+    }
+
+    /* Each block starts with a copy of its first symbol's address & name. */
+    if (!(ctr % CNT_PACKBLKSYM)) {
+      pb = (ctr ? pb + 1 : (XQPBLK*)&pp[1]);
+      pb->address  = xqpSym.address;
+      pb->offsData = offs;
+      pb->offsName = xqpSym.offsName;
+      memset(&xqpPrev, 0, sizeof(xqpPrev));
+      xqpPrev.address  = pb->address;
+      xqpPrev.offsName = pb->offsName;
+    }
+
+    offs += XqpPutSym(&pPack[offs], &xqpPrev, &xqpSym, fMod);
+    xqpPrev = xqpSym;
+  }
+
+  /* Keep the array if packing doesn't make the segment smaller. */
+  offs += (cbSym - offs) & 0x0F;
+  if (offs >= cbSym) {
+    free(pPack);
+    return;
+  }
+
+  if (!(opts & OPT_POOL)) {
+    for (pb = (XQPBLK*)&pp[1], ctr = 0; ctr < cntBlk; pb++, ctr++)
+      pb->offsName = pb->offsName - cbSym + offs;
+  }
+
+  memcpy(&pPack[offs], &pl->pData[cbSym], pl->cbData - cbSym);
+  free(pl->pData);
+  pl->pData  = pPack;
+  pl->cbData = offs + pl->cbData - cbSym;
+  pl->fPack  = 1;
+
+  return;
+}
+
+/*****************************************************************************/
+/* Build a compressed segment in its own buffer.  Compression removes
+ * much of what front-coding would, so if both were requested, the
+ * segment is built both ways & the smaller one is kept.
+ */
+
+void    ZipSyms(SEGLAYOUT* pl)
+{
+  char *  pData;
+  ULONG   cbData;
+  ULONG   cbNames;
+
+  if (!(opts & OPT_FRONT) ||
+      FrontSize(pl->pStart, pl->pStop) >= pl->cbStrings) {
+    ZipSymBlocks(pl, 0);
+    return;
+  }
+
+  ZipSymBlocks(pl, 1);
+  if (!pl->pData)
+    return;
+
+  pData   = pl->pData;
+  cbData  = pl->cbData;
+  cbNames = pl->cbNames;
+
+  ZipSymBlocks(pl, 0);
+  if (pl->pData && pl->cbData <= cbData) {
+    free(pData);
+    return;
+  }
+
+  if (pl->pData)
+    free(pl->pData);
+  pl->pData   = pData;
+  pl->cbData  = cbData;
+  pl->cbNames = cbNames;
+  pl->fFront  = 1;
+
+  return;
+}
+
+/*****************************************************************************/
+/* Divide a segment's symbols into blocks of CNT_ZIPBLKSYM entries, store
+ * each with StoreSymBlock(), then compress it.  The segment's XQSEG is
+ * stored later by PlaceSegs().  If memory isn't available, pl->pData
+ * is left null.
+ */
+
+void    ZipSymBlocks(SEGLAYOUT* pl, int fFront)
+{
+  ULONG     cntBlk;
+  ULONG     cntSym;
+  ULONG     cbStrings;
+  ULONG     cbRaw;
+  ULONG     cbMax = 0;
+  ULONG     cbData;
+  ULONG     cbNames;
+  ULONG     offs;
+  char *    pRaw;
+  REMAP**   pr;
+  REMAP**   pFirst;
+  XQZIP *   pz;
+  XQZBLK *  pb;
+
+  cntBlk = (pl->xqSeg.cntSym + CNT_ZIPBLKSYM - 1) / CNT_ZIPBLKSYM;
+  pl->fFront = fFront;
+
+  /* Find the most space any block could need. */
+  for (pr = pl->pStart; pr < pl->pStop; ) {
+    for (cntSym = 0, cbStrings = 0;
+         cntSym < CNT_ZIPBLKSYM && pr < pl->pStop; pr++) {
+      if ((*pr)->type & REMAP_OBJ) {
+        cbStrings += (*pr)->lth;
+        cntSym++;
+      }
+    }
+    cbRaw = MaxSymBlock(cntSym, cbStrings);
+    if (cbRaw > cbMax)
+      cbMax = cbRaw;
+  }
+
+  /* Compressed blocks are never larger than the originals. */
+  offs = sizeof(XQZIP) + cntBlk * sizeof(XQZBLK);
+  pl->pData = (char*)malloc(offs + MaxSymBlock(pl->xqSeg.cntSym, pl->cbStrings) +
+                            cntBlk * 0x1F);
+  pRaw = (char*)malloc(cbMax);
+  if (!pl->pData || !pRaw) {
+    if (pl->pData)
+      free(pl->pData);
+    if (pRaw)
+      free(pRaw);
+    pl->pData = 0;
+    return;
+  }
+
+  pz = (XQZIP*)pl->pData;
+  pz->magic     = XQZIP_MAGIC;
+  pz->cbStruct  = sizeof(XQZIP);
+  pz->cbXQZBLK  = sizeof(XQZBLK);
+  pz->cntBlk    = cntBlk;
+  pz->cntBlkSym = CNT_ZIPBLKSYM;
+  pb = (XQZBLK*)&pz[1];
+  pl->cbNames = 0;
+
+  for (pr = pl->pStart; pr < pl->pStop; pb++) {
+
+    /* Find the end of the block & the address of its first symbol. */
+    pFirst = pr;
+    for (cntSym = 0; cntSym < CNT_ZIPBLKSYM && pr < pl->pStop; pr++) {
+      if ((*pr)->type & REMAP_OBJ) {
+        if (!cntSym)
+          pb->address = (*pr)->offs;
+        cntSym++;
+      }
+    }
+
+    cbRaw = StoreSymBlock(pFirst, pr, cntSym, pl->fFront, pRaw, &cbNames);
+    pl->cbNames += cbNames;
+
+    /* If compression doesn't make the block smaller, store it as-is. */
+    cbData = XqzPack(pRaw, cbRaw, &pl->pData[offs], cbRaw);
+    if (!cbData) {
+      memcpy(&pl->pData[offs], pRaw, cbRaw);
+      cbData = cbRaw;
+    }
+
+    pb->offsData = offs;
+    pb->cbData   = cbData;
+    pb->cbRaw    = cbRaw;
+    offs += cbData;
+  }
+
+  assert(pb == (XQZBLK*)&pz[1] + cntBlk);
+
+  free(pRaw);
+  pl->cbData = offs;
+
+  return;
+}
+
+/*****************************************************************************/
+/* Store each segment that was built in its own buffer, one after the
+ * other, then free the buffer.  Uncompressed segments have their
+ * offsName values made absolute (unless the names are in the pool).  On exit, offsImg is the
+ * end of the last segment.  Returns zero if any segment is missing.
+ */
+
+int     PlaceSegs(int cntSeg)
+{
+  int     rtn = 1;
+  int     ctr;
+  ULONG   cnt;
+  ULONG   offs;
+  ULONG   pad;
+  ULONG   offsEnd;
+  XQSYM * pSym;
+  XQPACK* pp;
+  XQPBLK* pb;
+  SEGLAYOUT*  pl;
+
+  if (!cntSeg)
+    return 1;
+
+  offs = aLayout[0].offsSeg;
+  for (ctr = 0; ctr < cntSeg; ctr++) {
+    pl = &aLayout[ctr];
+    if (!pl->pData) {
+      rtn = 0;
+      continue;
+    }
+
+    pl->xqSeg.flags   = ((opts & OPT_ZIP) ? XQFLAG_ZIP : 0) |
+                        (pl->fFront ? XQFLAG_FRONT : 0) |
+                        (pl->fPack ? XQFLAG_PACK : 0);
+    if (pl->fFront)
+      ((XQFILE*)pImg)->flags |= XQFLAG_FRONT;
+    if (pl->fPack)
+      ((XQFILE*)pImg)->flags |= XQFLAG_PACK;
+    pl->xqSeg.offsSym = offs + ((opts & OPT_SEGDIR) ? 0 : sizeof(XQSEG));
+
+    /* The index (if any) follows on a 16-byte boundary.
+     * Pad every segment but the last to a 16-byte boundary.
+     */
+    offsEnd = pl->xqSeg.offsSym + pl->cbData;
+    if (pl->cbIndex) {
+      pl->xqSeg.offsIndex = (offsEnd + 0x0F) & ~0x0F;
+      offsEnd = pl->xqSeg.offsIndex + pl->cbIndex;
+    }
+
+    pad = 0;
+    pl->xqSeg.offsNext = 0;
+    if (ctr < cntSeg - 1) {
+      pad = (0x10 - (offsEnd & 0x0F)) & 0x0F;
+      pl->xqSeg.offsNext = offsEnd + pad;
+    }
+
+    pl->offsSeg = offs;
+    if (opts & OPT_SEGDIR) {
+      if (pl->xqSeg.offsNext)
+        pl->xqSeg.offsNext = pl->offsHdr + sizeof(XQSEG);
+    }
+    else
+      pl->offsHdr = offs;
+    PutImage(pl->offsHdr, &pl->xqSeg, sizeof(XQSEG));
+    PutImage(pl->xqSeg.offsSym, pl->pData, pl->cbData);
+    if (pl->cbIndex)
+      StoreIndex(pl);
+    offs = offsEnd + pad;
+
+    if (pl->fPack) {
+      pp = (XQPACK*)&pImg[pl->xqSeg.offsSym];
+      pb = (XQPBLK*)&pp[1];
+      for (cnt = pp->cntBlk; cnt && !(opts & OPT_POOL); cnt--, pb++)
+        pb->offsName += pl->xqSeg.offsSym;
+    }
+    else
+    if (!(opts & (OPT_ZIP | OPT_POOL))) {
+      pSym = (XQSYM*)&pImg[pl->xqSeg.offsSym];
+      for (cnt = pl->xqSeg.cntSym; cnt; cnt--) {
+        pSym->offsName += pl->xqSeg.offsSym;
+        pSym = (XQSYM*)((char*)pSym + cbXQSYM);
+      }
+    }
+
+    if (opts & OPT_ZIP) {
+      cbZipRaw    += pl->xqSeg.cntSym * cbXQSYM + pl->cbStrings;
+      cbZipStored += pl->cbData;
+    }
+    cbNamesRaw    += pl->cbStrings;
+    cbNamesStored += pl->cbNames;
+    cbPackRaw     += pl->xqSeg.cntSym * cbXQSYM;
+    cbPackStored  += pl->cbData - pl->cbNames;
+
+    free(pl->pData);
+    pl->pData = 0;
+  }
+
+  if (!rtn)
+    fprintf(stderr, "malloc failed while building segments - aborting\n");
+
+  offsImg = offs;
+
+  return rtn;
+}
+
+/*****************************************************************************/
+/* Store a segment's address index at XQSEG.offsIndex & return the offset
+ * following it.  For each page, 'last' is the symbol preceding the first
+ * one on a later page;  'first' is the symbol preceding the first one
+ * that's past the start of the page.  Pages past the last such symbol
+ * get the segment's last symbol.
+ */
+
+ULONG   StoreIndex(SEGLAYOUT* pl)
+{
+  ULONG     ndx;
+  ULONG     page;
+  REMAP**   pr;
+  XQIDX *   pIdx;
+  XQINDEX*  pi = &pl->xqIndex;
+
+  PutImage(pl->xqSeg.offsIndex, pi, sizeof(XQINDEX));
+  pIdx = (XQIDX*)&pImg[pl->xqSeg.offsIndex + sizeof(XQINDEX)];
+  assert(pl->xqSeg.offsIndex + pl->cbIndex <= cbImg);
+
+  for (pr = pl->pStart, ndx = 0, page = 0; pr < pl->pStop; pr++) {
+    if (!((*pr)->type & REMAP_OBJ))
+      continue;
+    while (page < pi->cntPage &&
+           page < ((*pr)->offs >> pi->shift) - pi->base)
+      pIdx[page++].last = ndx - 1;
+    ndx++;
+  }
+  while (page < pi->cntPage)
+    pIdx[page++].last = ndx - 1;
+
+  for (pr = pl->pStart, ndx = 0, page = 0; pr < pl->pStop; pr++) {
+    if (!((*pr)->type & REMAP_OBJ))
+      continue;
+    while (page < pi->cntPage &&
+           ((pi->base + page) << pi->shift) < (*pr)->offs)
+      pIdx[page++].first = (ndx ? ndx - 1 : 0);
+    ndx++;
+  }
+  while (page < pi->cntPage)
+    pIdx[page++].first = ndx - 1;
+
+  return pl->xqSeg.offsIndex + pl->cbIndex;
+}
+
+/*****************************************************************************/
+/* Store a name index after the last segment.  Its entries are stored in
+ * segment & address order, then sorted by hash so the buckets can be
+ * filled in.
+ */
+
+int     WriteNameIndex(int cntSeg)
+{
+  int       ctr;
+  ULONG     cnt = 0;
+  ULONG     ndx;
+  ULONG     bkt;
+  ULONG     offs;
+  ULONG     offsEnt;
+  ULONG *   aBkt;
+  REMAP**   pr;
+  XQHENT*   pEnt;
+  XQHASH    xqh;
+  SEGLAYOUT*  pl;
+  unsigned long long  hash;
+
+  for (ctr = 0; ctr < cntSeg; ctr++)
+    cnt += aLayout[ctr].xqSeg.cntSym;
+
+  memset(&xqh, 0, sizeof(xqh));
+  xqh.magic    = XQHASH_MAGIC;
+  xqh.cbStruct = sizeof(XQHASH);
+  xqh.cbXQHENT = sizeof(XQHENT);
+  xqh.cntEnt   = cnt;
+  while (xqh.bitsBkt < 24 && (2UL << xqh.bitsBkt) <= cnt / 2)
+    xqh.bitsBkt++;
+
+  offs = (offsImg + 0x0F) & ~0x0F;
+  offsEnt = (sizeof(XQHASH) + ((1UL << xqh.bitsBkt) + 1) * sizeof(ULONG) +
+             0x0F) & ~0x0F;
+  assert(offs + offsEnt + cnt * sizeof(XQHENT) <= cbImg);
+  PutImage(offs, &xqh, sizeof(XQHASH));
+
+  pEnt = (XQHENT*)&pImg[offs + offsEnt];
+  for (ctr = 0; ctr < cntSeg; ctr++) {
+    pl = &aLayout[ctr];
+    for (pr = pl->pStart, ndx = 0; pr < pl->pStop; pr++) {
+      if (!((*pr)->type & REMAP_OBJ))
+        continue;
+
+      hash = XqhHash((*pr)->text, (*pr)->lth - 1);
+      pEnt->hashLo  = (ULONG)(hash & 0xFFFFFFFFUL);
+      pEnt->hashHi  = (ULONG)(hash >> 32);
+      pEnt->offsSeg = pl->offsHdr;
+      pEnt->ndx     = ndx++;
+      pEnt++;
+    }
+  }
+
+  pEnt = (XQHENT*)&pImg[offs + offsEnt];
+  qsort(pEnt, cnt, sizeof(XQHENT), NameIndexSorter);
+
+  /* Each bucket starts at the first entry whose bucket isn't lower. */
+  aBkt = (ULONG*)&pImg[offs + sizeof(XQHASH)];
+  for (bkt = 0, ndx = 0; bkt <= (1UL << xqh.bitsBkt); bkt++) {
+    while (ndx < cnt && (xqh.bitsBkt ?
+           pEnt[ndx].hashHi >> (32 - xqh.bitsBkt) : 0) < bkt)
+      ndx++;
+    aBkt[bkt] = ndx;
+  }
+
+  ((XQFILE*)pImg)->offsHash = offs;
+  offsImg = offs + offsEnt + cnt * sizeof(XQHENT);
+
+  return 1;
+}
+
+/*****************************************************************************/
+/* Sort name index entries by hash, then by position in the file. */
+
+int     NameIndexSorter(const void *key, const void *element)
+{
+  XQHENT* p1 = (XQHENT*)key;
+  XQHENT* p2 = (XQHENT*)element;
+
+  if (p1->hashHi != p2->hashHi)
+    return (p1->hashHi < p2->hashHi) ? -1 : 1;
+  if (p1->hashLo != p2->hashLo)
+    return (p1->hashLo < p2->hashLo) ? -1 : 1;
+  if (p1->offsSeg != p2->offsSeg)
+    return (p1->offsSeg < p2->offsSeg) ? -1 : 1;
+  if (p1->ndx != p2->ndx)
+    return (p1->ndx < p2->ndx) ? -1 : 1;
+
+  return 0;
+}
+
+/*****************************************************************************/
+/*  XQS to XQL                                                               */
+/*****************************************************************************/
+/* Read the entire xqs file into a null-terminated buffer & confirm it's
+ * an XQS file.
+ */
+
+int     ReadXQS(void)
+{
+  int     hIn;
+  int     rtn;
+
+  /* Open the xqs file. */
+  hIn = open(fIn, O_RDONLY | O_BINARY, 0);
+  if (hIn < 0) {
+    fprintf(stderr, "unable to open input file '%s'\n", fIn);
+    return 0;
+  }
+
+  /* Read the entire file into a null-terminated buffer then close it. */
+  buffer = malloc(cbFile + 1);
+  if (!buffer) {
+    fprintf(stderr, "malloc for input buffer failed - size= %ld\n", cbFile);
+    close(hIn);
+    return 0;
+  }
+  rtn = read(hIn, buffer, cbFile);
+  close(hIn);
+  buffer[cbFile] = 0;
+
+  /* Ensure we got the entire file. */
+  if (rtn != cbFile) {
+    fprintf(stderr, "unable to read entire input file '%s'\n", fIn);
+    return 0;
+  }
+
+  /* Confirm this is a valid XQS file. */
+  if (cbFile < sizeof(XQFILE) || ((XQFILE*)buffer)->magic != XQFILE_MAGIC) {
+    fprintf(stderr, "input is not a valid XQS file - '%s'\n", fIn);
+    return 0;
+  }
+
+  return 1;
+}
+
+/*****************************************************************************/
+/* Create *.xql from *.xqs */
+
+int     DumpXQS(void)
+{
+  int     rtn = 1;
+  int     modCnt = 0;
+  int     symCnt = 0;
+  ULONG   ctr;
+  ULONG   offsSeg;
+  ULONG   offsDirSeg = 0;
+  ULONG   lastMod;
+  ULONG   maxMod = 0;
+  ULONG   offsMods = 0;
+  ULONG   cbMods;
+  char *  pMods;
+  char *  pModRaw = 0;
+  FILE *  fl = 0;
+  XQFILE* xqFile;
+  XQSEG * xqSeg;
+  XQSEGDIR* pDir = 0;
+
+  if (!ReadXQS())
+    return 0;
+
+  xqFile = (XQFILE*)buffer;
+
+  /* Module names are normally read in place.  If they're compressed,
+   * expand them into a separate buffer.  Either way, the name for a
+   * given XQSYM.offsMod is at pMods + offsMod - offsMods.
+   */
+  pMods = buffer;
+  cbMods = cbFile;
+  if (xqFile->offsMod && (xqFile->flags & XQFLAG_ZIP_MOD)) {
+    XQZMOD* xqzMod = (XQZMOD*)(buffer + xqFile->offsMod);
+
+    if (xqFile->offsMod > cbFile - sizeof(XQZMOD) ||
+        xqzMod->cbData > cbFile - xqFile->offsMod - sizeof(XQZMOD) ||
+        !(pModRaw = (char*)calloc(xqzMod->cbRaw + 1, 1)) ||
+        (xqzMod->cbData == xqzMod->cbRaw ?
+         !memcpy(pModRaw, &xqzMod[1], xqzMod->cbRaw) :
+         XqzUnpack((char*)&xqzMod[1], xqzMod->cbData,
+                   pModRaw, xqzMod->cbRaw) != (long)xqzMod->cbRaw)) {
+      fprintf(stderr, "unable to expand module names - aborting\n");
+      if (pModRaw)
+        free(pModRaw);
+      return 0;
+    }
+    pMods = pModRaw;
+    offsMods = xqFile->offsMod;
+    cbMods = xqzMod->cbRaw;
+  }
+
+  /* If there's a segment directory, its headers are listed in order
+   * rather than following the chain.
+   */
+  if (xqFile->flags & XQFLAG_SEGDIR) {
+    offsDirSeg = CheckSegDir(xqFile);
+    if (!offsDirSeg) {
+      if (pModRaw)
+        free(pModRaw);
+      return 0;
+    }
+    pDir = (XQSEGDIR*)(buffer + xqFile->offsDir);
+  }
+
+  /* Open the listing file. */
+  fl = fopen(fOut, "w");
+  if (!fl) {
+    fprintf(stderr, "unable to open list file '%s'\n", fOut);
+    if (pModRaw)
+      free(pModRaw);
+    return 0;
+  }
+
+  /* Print a report header & column header. */
+  fprintf(fl, pszReportHdr, (xqFile->offsMod) ? " and source files" : "", fIn);
+  fputs(pszColumnHdr, fl);
+
+  /* For each segment... */
+  for (ctr = 0; ; ctr++) {
+    if (pDir) {
+      if (ctr >= pDir->cntSeg)
+        break;
+      offsSeg = offsDirSeg + ctr * pDir->cbXQSEG;
+    }
+    else {
+      offsSeg = ctr ? xqSeg->offsNext : xqFile->firstSeg;
+      if (!offsSeg)
+        break;
+    }
+
+    /* Point at the XQSEG, then confirm it's valid. */
+    xqSeg = (XQSEG*)(buffer + offsSeg);
+    if (offsSeg > cbFile - sizeof(XQSEG) ||
+        xqSeg->magic != XQSEG_MAGIC) {
+      fprintf(stderr, "invalid segment offset %lx - aborting\n", offsSeg);
+      rtn = 0;
+      break;
+    }
+
+    lastMod = 0;
+    symCnt += xqSeg->cntSym;
+
+    /* If the segment has an index, collect its addresses to check it. */
+    if (xqSeg->offsIndex) {
+      if (xqSeg->cntSym > cbFile ||
+          !(aDumpAddr = (ULONG*)malloc((xqSeg->cntSym + 1) * sizeof(ULONG)))) {
+        fprintf(stderr, "invalid address index at %lx - aborting\n",
+                xqSeg->offsIndex);
+        rtn = 0;
+        break;
+      }
+      cntDumpAddr = 0;
+    }
+
+    if (xqSeg->cbXQSYM < XQS_SYMSIZE_NOMOD) {
+      fprintf(stderr, "invalid symbol size in segment at %lx - aborting\n",
+              offsSeg);
+      rtn = 0;
+      break;
+    }
+
+    if (xqSeg->flags & XQFLAG_ZIP) {
+      if (!DumpZipSeg(fl, xqSeg, pMods, offsMods, cbMods,
+                      &lastMod, &maxMod)) {
+        rtn = 0;
+        break;
+      }
+    }
+    else
+    if (xqSeg->flags & XQFLAG_PACK) {
+      if (!DumpPackSeg(fl, xqSeg, pMods, offsMods, cbMods,
+                       &lastMod, &maxMod)) {
+        rtn = 0;
+        break;
+      }
+    }
+    else
+    if (xqSeg->offsSym > cbFile ||
+        xqSeg->cntSym > (cbFile - xqSeg->offsSym) / xqSeg->cbXQSYM) {
+      fprintf(stderr, "invalid symbol array at %lx - aborting\n",
+              xqSeg->offsSym);
+      rtn = 0;
+      break;
+    }
+    else
+      DumpSyms(fl, xqSeg, buffer + xqSeg->offsSym, xqSeg->cntSym,
+               buffer, cbFile, pMods, offsMods, cbMods, &lastMod, &maxMod);
+
+    if (aDumpAddr) {
+      if (!CheckIndex(xqSeg)) {
+        rtn = 0;
+        break;
+      }
+      free(aDumpAddr);
+      aDumpAddr = 0;
+    }
+  }
+
+  if (aDumpAddr) {
+    free(aDumpAddr);
+    aDumpAddr = 0;
+  }
+    
+  /* Show the total number of modules & symbols. */
+  if (rtn) {
+    /* Count the number of module name strings. */
+    if (xqFile->offsMod && maxMod && xqFile->offsMod - offsMods < cbMods) {
+      char* ptr = pMods + xqFile->offsMod - offsMods;
+      while (*ptr && ptr <= &pMods[maxMod - offsMods]) {
+        modCnt++;
+        ptr = strchr(ptr, 0) + 1;
+      }
+    }
+
+    fprintf(fl, "\n Modules= %d  Symbols= %d\n\n", modCnt, symCnt);
+  }
+
+  fclose(fl);
+  if (pModRaw)
+    free(pModRaw);
+
+  return rtn;
+}
+
+/*****************************************************************************/
+/* Confirm that the segment directory & its headers are within the file,
+ * that every slot in its table identifies a header with that seg nbr,
+ * & that every header has a slot.  Returns the offset of the first
+ * header, or zero if the directory is invalid.
+ */
+
+ULONG   CheckSegDir(XQFILE* xqFile)
+{
+  ULONG     ctr;
+  ULONG     offs = xqFile->offsDir;
+  ULONG     offsSeg;
+  USHORT *  aSlot;
+  XQSEG *   xqSeg;
+  XQSEGDIR* pDir = (XQSEGDIR*)(buffer + offs);
+
+  if (!offs || offs > cbFile - sizeof(XQSEGDIR) ||
+      pDir->magic != XQSEGDIR_MAGIC || pDir->cbStruct < sizeof(XQSEGDIR) ||
+      pDir->cbXQSEG < sizeof(XQSEG) || pDir->cntSlot > 0x10000 ||
+      pDir->cbStruct + pDir->cntSlot * sizeof(USHORT) > cbFile - offs) {
+    fprintf(stderr, "invalid segment directory at %lx - aborting\n", offs);
+    return 0;
+  }
+
+  offsSeg = offs + ((pDir->cbStruct + pDir->cntSlot * sizeof(USHORT) + 0x0F) &
+                    ~0x0F);
+  if (offsSeg > cbFile || pDir->cntSeg > (cbFile - offsSeg) / pDir->cbXQSEG ||
+      (pDir->cntSeg && xqFile->firstSeg != offsSeg)) {
+    fprintf(stderr, "invalid segment directory at %lx - aborting\n", offs);
+    return 0;
+  }
+
+  aSlot = (USHORT*)((char*)pDir + pDir->cbStruct);
+  for (ctr = 0; ctr < pDir->cntSlot; ctr++) {
+    if (!aSlot[ctr])
+      continue;
+    xqSeg = (XQSEG*)(buffer + offsSeg + (aSlot[ctr] - 1) * pDir->cbXQSEG);
+    if (aSlot[ctr] > pDir->cntSeg || xqSeg->seg != pDir->segBase + ctr) {
+      fprintf(stderr, "invalid directory entry for segment %04lX - aborting\n",
+              pDir->segBase + ctr);
+      return 0;
+    }
+  }
+
+  for (ctr = 0; ctr < pDir->cntSeg; ctr++) {
+    xqSeg = (XQSEG*)(buffer + offsSeg + ctr * pDir->cbXQSEG);
+    if ((ULONG)(xqSeg->seg - pDir->segBase) >= pDir->cntSlot ||
+        aSlot[xqSeg->seg - pDir->segBase] != ctr + 1) {
+      fprintf(stderr, "segment %04hX is missing from the directory - aborting\n",
+              xqSeg->seg);
+      return 0;
+    }
+  }
+
+  return offsSeg;
+}
+
+/*****************************************************************************/
+/* Expand each block of a compressed segment & print its symbols. */
+
+int     DumpZipSeg(FILE* fl, XQSEG* xqSeg, char* pMods, ULONG offsMods,
+                   ULONG cbMods, ULONG* pLastMod, ULONG* pMaxMod)
+{
+  ULONG   ctr;
+  ULONG   cntSym;
+  ULONG   cbMax = 0;
+  char *  pBlk;
+  XQZIP * pz;
+  XQZBLK* pb;
+
+  pz = GetZipHdr(xqSeg);
+  if (!pz)
+    return 0;
+
+  /* Get a buffer large enough for the largest block. */
+  for (ctr = 0; ctr < pz->cntBlk; ctr++) {
+    pb = (XQZBLK*)((char*)pz + pz->cbStruct + ctr * pz->cbXQZBLK);
+    if (pb->cbRaw > cbMax)
+      cbMax = pb->cbRaw;
+  }
+  pBlk = (char*)malloc(cbMax + 1);
+  if (!pBlk) {
+    fprintf(stderr, "malloc for compressed block failed - size= %ld\n", cbMax);
+    return 0;
+  }
+
+  cntSym = xqSeg->cntSym;
+  for (ctr = 0; ctr < pz->cntBlk && cntSym; ctr++) {
+    ULONG   cnt = (cntSym < pz->cntBlkSym) ? cntSym : pz->cntBlkSym;
+
+    pb = (XQZBLK*)((char*)pz + pz->cbStruct + ctr * pz->cbXQZBLK);
+    if (pb->offsData > cbFile - xqSeg->offsSym ||
+        pb->cbData > cbFile - xqSeg->offsSym - pb->offsData ||
+        cnt * xqSeg->cbXQSYM > pb->cbRaw ||
+        (pb->cbData == pb->cbRaw ?
+         !memcpy(pBlk, (char*)pz + pb->offsData, pb->cbRaw) :
+         XqzUnpack((char*)pz + pb->offsData, pb->cbData,
+                   pBlk, pb->cbRaw) != (long)pb->cbRaw)) {
+      fprintf(stderr, "invalid compressed block at %lx - aborting\n",
+              xqSeg->offsSym + pb->offsData);
+      free(pBlk);
+      return 0;
+    }
+    pBlk[pb->cbRaw] = 0;
+
+    DumpSyms(fl, xqSeg, pBlk, cnt, pBlk, pb->cbRaw,
+             pMods, offsMods, cbMods, pLastMod, pMaxMod);
+    cntSym -= cnt;
+  }
+
+  free(pBlk);
+
+  return 1;
+}
+
+/*****************************************************************************/
+/* Decode each block of a packed segment into an array of XQSYM & print
+ * its symbols.
+ */
+
+int     DumpPackSeg(FILE* fl, XQSEG* xqSeg, char* pMods, ULONG offsMods,
+                    ULONG cbMods, ULONG* pLastMod, ULONG* pMaxMod)
+{
+  int     fMod;
+  ULONG   ctr;
+  ULONG   ndx;
+  ULONG   cnt;
+  ULONG   cntSym;
+  ULONG   cbSym;
+  char *  pSym;
+  const char *  ptr;
+  XQPACK* pp;
+  XQPBLK* pb;
+  XQPSYM  xqp;
+  XQSYM   xqs;
+
+  pp = GetPackHdr(xqSeg);
+  if (!pp)
+    return 0;
+
+  /* Get a buffer large enough for one block's symbols. */
+  fMod = xqSeg->cbXQSYM >= XQS_SYMSIZE_MOD;
+  cbSym = (xqSeg->cbXQSYM < sizeof(XQSYM)) ? xqSeg->cbXQSYM : sizeof(XQSYM);
+  cnt = (xqSeg->cntSym < pp->cntBlkSym) ? xqSeg->cntSym : pp->cntBlkSym;
+  pSym = (char*)calloc(cnt + 1, xqSeg->cbXQSYM);
+  if (!pSym) {
+    fprintf(stderr, "calloc for packed block failed - count= %ld\n", cnt);
+    return 0;
+  }
+
+  cntSym = xqSeg->cntSym;
+  for (ctr = 0; ctr < pp->cntBlk && cntSym; ctr++) {
+    cnt = (cntSym < pp->cntBlkSym) ? cntSym : pp->cntBlkSym;
+
+    pb = (XQPBLK*)((char*)pp + pp->cbStruct + ctr * pp->cbXQPBLK);
+    memset(&xqp, 0, sizeof(xqp));
+    xqp.address  = pb->address;
+    xqp.offsName = pb->offsName;
+    ptr = (char*)pp + pb->offsData;
+
+    for (ndx = 0; ndx < cnt; ndx++) {
+      if (pb->offsData > cbFile - xqSeg->offsSym ||
+          !XqpGetSym(&ptr, buffer + cbFile, &xqp, fMod)) {
+        fprintf(stderr, "invalid packed block at %lx - aborting\n",
+                xqSeg->offsSym + pb->offsData);
+        free(pSym);
+        return 0;
+      }
 
-    for (pr = pArr; *pr; pr++) {
-      if (((*pr)->type & (REMAP_MOD | REMAP_USED)) == (REMAP_MOD | REMAP_USED))
-        xqFile.firstSeg += (*pr)->lth;
+      xqs.address  = xqp.address;
+      xqs.offsName = xqp.offsName;
+      xqs.cbName   = (USHORT)xqp.cbName;
+      xqs.cbMod    = (USHORT)xqp.cbMod;
+      xqs.offsMod  = xqp.offsMod;
+      memcpy(&pSym[ndx * xqSeg->cbXQSYM], &xqs, cbSym);
     }
-    padMods = (0x10 - (xqFile.firstSeg & 0x0F)) & 0x0F;
-    xqFile.firstSeg += padMods;
-  }
 
-  /* Write the file header. */
-  if (fwrite(&xqFile, 1, sizeof(XQFILE), fo) != sizeof(XQFILE)) {
-    fprintf(stderr, "error writing XQFILE to file - aborting\n");
-    return 0;
+    DumpSyms(fl, xqSeg, pSym, cnt, buffer, cbFile,
+             pMods, offsMods, cbMods, pLastMod, pMaxMod);
+    cntSym -= cnt;
   }
 
-  /* If appropriate, write the module name strings. */
-  if (!(opts & OPT_NOMOD))
-    rtn = WriteMods(pArr, xqFile.offsMod, xqFile.firstSeg, padMods);
+  free(pSym);
 
-  return rtn;
+  return 1;
 }
 
 /*****************************************************************************/
+/* Print an array of symbols.  Their names are relative to pNames;  their
+ * module names are at pMods + XQSYM.offsMod - offsMods.  Both buffers
+ * must be followed by a null so a name can't run past the end.
+ */
 
-int     WriteMods(REMAP** pArr, ULONG offs, ULONG offsEnd, ULONG padMods)
+void    DumpSyms(FILE* fl, XQSEG* xqSeg, char* pSym, ULONG cntSym,
+                 char* pNames, ULONG cbNames, char* pMods, ULONG offsMods,
+                 ULONG cbMods, ULONG* pLastMod, ULONG* pMaxMod)
 {
-  ULONG   cur;
-  REMAP*  r;
-  REMAP** pr;
+  int     fMod;
+  int     fFront;
+  ULONG   offsBlk;
+  char *  pName;
+  XQSYM * xqs;
+  static char szName[0x10000];
 
-  /* Write the strings associated with module entries referenced by symbols. */
-  for (pr = pArr; *pr; pr++) {
-    r = *pr;
-    if ((r->type & (REMAP_MOD | REMAP_USED)) != (REMAP_MOD | REMAP_USED))
-      continue;
+  fMod = xqSeg->cbXQSYM >= XQS_SYMSIZE_MOD;
+  fFront = (xqSeg->flags & XQFLAG_FRONT) != 0;
 
-    r->offs = offs;
-    if (fwrite(r->text, 1, r->lth, fo) != r->lth) {
-      fprintf(stderr, "error writing module name to file - aborting\n");
-      return 0;
+  /* For each symbol entry in the segment... */
+  for (xqs = (XQSYM*)pSym;
+       cntSym;
+       cntSym--, xqs = (XQSYM*)((char*)xqs + xqSeg->cbXQSYM)) {
+
+    /* If this seg has module info & the current entry's mod is different
+     * than the previous one's, print the name provided it's valid.
+     */
+    if (fMod && *pLastMod != xqs->offsMod) {
+      *pLastMod = xqs->offsMod;
+      if (xqs->offsMod && xqs->cbMod &&
+          xqs->offsMod >= offsMods && xqs->offsMod - offsMods < cbMods) {
+        if (*pLastMod > *pMaxMod)
+          *pMaxMod = *pLastMod;
+        fprintf(fl, "\n %s\n", pMods + xqs->offsMod - offsMods);
+      }
+      else
+        fprintf(fl, "\n [unknown]\n");
     }
-    offs += r->lth;
-  }
 
-  /* If there should be padding after the strings, write it. */
-  if (padMods) {
-    if (fwrite(aPad, 1, padMods, fo) != padMods) {
-      fprintf(stderr, "error writing module name padding to file - aborting\n");
-      return 0;
+    /* Get the name, decoding it if it's front-coded. */
+    pName = "[error]";
+    if (xqs->offsName && xqs->cbName && xqs->offsName < cbNames) {
+      if (!fFront)
+        pName = pNames + xqs->offsName;
+      else {
+        offsBlk = xqs->offsName & ~0x0F;
+        if (XqfGetName(pNames + offsBlk, cbNames - offsBlk,
+                       xqs->offsName & 0x0F, szName, sizeof(szName)) > 0)
+          pName = szName;
+      }
     }
+
+    /* Print the symbol info. */
+    fprintf(fl, "   %04hX:%08lX  %s\n", xqSeg->seg, xqs->address, pName);
+
+    /* Save the address if the segment's index will be checked. */
+    if (aDumpAddr && cntDumpAddr < xqSeg->cntSym)
+      aDumpAddr[cntDumpAddr++] = xqs->address;
   }
 
-  /* Confirm we're where we should be (offsEnd already includes any padding). */
-  cur = ftell(fo);
-  if (cur != offsEnd) {
-    fprintf(stderr, "module array not expected length - aborting - expected= %ld  actual= %ld\n",
-            offsEnd, cur);
+  return;
+}
+
+/*****************************************************************************/
+/* Return a compressed segment's XQZIP after confirming that it & its
+ * block array are within the file.
+ */
+
+XQZIP * GetZipHdr(XQSEG* xqSeg)
+{
+  XQZIP * pz = (XQZIP*)(buffer + xqSeg->offsSym);
+
+  if (xqSeg->offsSym > cbFile - sizeof(XQZIP) ||
+      pz->magic != XQZIP_MAGIC || pz->cbStruct < sizeof(XQZIP) ||
+      pz->cbStruct > cbFile - xqSeg->offsSym ||
+      pz->cbXQZBLK < sizeof(XQZBLK) || !pz->cntBlkSym ||
+      pz->cntBlk > (cbFile - xqSeg->offsSym - pz->cbStruct) / pz->cbXQZBLK) {
+    fprintf(stderr, "invalid compressed segment at %lx - aborting\n",
+            xqSeg->offsSym);
     return 0;
   }
 
-  return 1;
+  return pz;
 }
 
 /*****************************************************************************/
+/* Return a packed segment's XQPACK after confirming that it & its block
+ * array are within the file.  Every symbol takes at least 3 bytes, so
+ * cntSym can't exceed the file's size.
+ */
 
-int     WriteSegs(REMAP** pArr)
+XQPACK* GetPackHdr(XQSEG* xqSeg)
 {
-  ULONG   cbStrings;
-  ULONG   offsStrings;
-  ULONG   padStrings;
-  ULONG   padSym;
-  REMAP** pStart;
-  REMAP** pStop;
-  XQSEG   xqSeg;
+  XQPACK* pp = (XQPACK*)(buffer + xqSeg->offsSym);
+
+  if (xqSeg->offsSym > cbFile - sizeof(XQPACK) ||
+      pp->magic != XQPACK_MAGIC || pp->cbStruct < sizeof(XQPACK) ||
+      pp->cbStruct > cbFile - xqSeg->offsSym ||
+      pp->cbXQPBLK < sizeof(XQPBLK) || !pp->cntBlkSym ||
+      pp->cntBlk > (cbFile - xqSeg->offsSym - pp->cbStruct) / pp->cbXQPBLK ||
+      xqSeg->cntSym > cbFile) {
+    fprintf(stderr, "invalid packed segment at %lx - aborting\n",
+            xqSeg->offsSym);
+    return 0;
+  }
 
-  memset(&xqSeg, 0, sizeof(XQSEG));
-  xqSeg.magic    = XQSEG_MAGIC;
-  xqSeg.cbStruct = sizeof(XQSEG);
-  xqSeg.cbXQSYM  = cbXQSYM;
+  return pp;
+}
 
-  pStart = pArr;
-  while (*pStart) {
+/*****************************************************************************/
+/* Confirm that a segment's address index matches the addresses of the
+ * symbols just printed, i.e. that each page's entries identify the
+ * same symbols a binary search of the whole segment would.
+ */
 
-    xqSeg.seg = (*pStart)->seg;
+int     CheckIndex(XQSEG* xqSeg)
+{
+  ULONG     ctr;
+  ULONG     start;
+  ULONG     cnt = cntDumpAddr;
+  ULONG *   pAddr = aDumpAddr;
+  XQIDX *   pIdx;
+  XQINDEX*  pi = (XQINDEX*)(buffer + xqSeg->offsIndex);
+
+  if (xqSeg->offsIndex > cbFile - sizeof(XQINDEX) ||
+      pi->magic != XQINDEX_MAGIC || pi->cbStruct < sizeof(XQINDEX) ||
+      pi->cbStruct > cbFile - xqSeg->offsIndex || pi->shift > 31 ||
+      pi->cntPage > (cbFile - xqSeg->offsIndex - pi->cbStruct) / sizeof(XQIDX) ||
+      cnt != xqSeg->cntSym || !cnt ||
+      pi->base != pAddr[0] >> pi->shift ||
+      pi->base + pi->cntPage - 1 != pAddr[cnt - 1] >> pi->shift) {
+    fprintf(stderr, "invalid address index at %lx - aborting\n",
+            xqSeg->offsIndex);
+    return 0;
+  }
 
-    cbStrings = 0;
-    xqSeg.cntSym = 0;
-    pStop = pStart;
+  pIdx = (XQIDX*)((char*)pi + pi->cbStruct);
+  for (ctr = 0; ctr < pi->cntPage; ctr++, pIdx++) {
+    start = (pi->base + ctr) << pi->shift;
 
-    /* Count the number of symbols in this segment and calculate the
-     * aggregate length of the strings associated with those symbols.
+    /* 'first' must be the last symbol at or below the page's start
+     * (or the first symbol);  'last' must be the last symbol before
+     * the next page.
      */
-    while (*pStop && (*pStop)->seg == xqSeg.seg) {
-      if ((*pStop)->type & REMAP_OBJ) {
-        cbStrings += (*pStop)->lth;
-        xqSeg.cntSym++;
-      }
-      pStop++;
-    }
-
-    /* If this seg has no symbols, skip it. */
-    if (!xqSeg.cntSym) {
-      pStart = pStop;
-      continue;
-    }
-
-    /* XQSYM entries start at the current pos + the sizeof XQSEG */
-    xqSeg.offsSym = ftell(fo);
-    if (xqSeg.offsSym < 0) {
-      fprintf(stderr, "ftell() failed  - aborting\n");
+    if (pIdx->first > pIdx->last || pIdx->last >= cnt ||
+        (pIdx->first && pAddr[pIdx->first] > start) ||
+        (pIdx->first + 1 < cnt && pAddr[pIdx->first + 1] <= start) ||
+        (pAddr[pIdx->last] >> pi->shift) > pi->base + ctr ||
+        (pIdx->last + 1 < cnt &&
+         (pAddr[pIdx->last + 1] >> pi->shift) <= pi->base + ctr)) {
+      fprintf(stderr, "invalid address index entry for %04hX:%08lX - aborting\n",
+              xqSeg->seg, start);
       return 0;
     }
-    xqSeg.offsSym += sizeof(XQSEG);
+  }
 
-    /* Calc any padding needed after the XQSYM array,
-     * then calc the position of the symbol's strings.
-     */
-    padSym = (0x10 - ((xqSeg.cntSym * cbXQSYM) & 0x0F)) & 0x0F;
-    offsStrings = xqSeg.offsSym + (xqSeg.cntSym * cbXQSYM) + padSym;
+  return 1;
+}
 
-    /* If this isn't the last segment, calc padding for the strings,
-     * then calc the offset of the next XQSEG header.
-     */
-    if (*pStop) {
-      padStrings = (0x10 - (cbStrings & 0x0F)) & 0x0F;
-      xqSeg.offsNext = offsStrings + cbStrings + padStrings;
-    }
-    else {
-      padStrings = 0;
-      xqSeg.offsNext = 0;
-    }
+/*****************************************************************************/
+/*  Name queries                                                             */
+/*****************************************************************************/
+/* Open fIn using the reader library & report any error. */
 
-    /* Write the current seg's header, then its symbols & strings. */
-    if (fwrite(&xqSeg, 1, sizeof(XQSEG), fo) != sizeof(XQSEG)) {
-      fprintf(stderr, "error writing XQSEG to file - aborting\n");
+int     OpenXQS(XQSREAD* pxr)
+{
+  switch (xqs_open(pxr, fIn)) {
+    case XQSR_OK:
+      return 1;
+    case XQSR_IO:
+      fprintf(stderr, "unable to read input file '%s'\n", fIn);
       return 0;
-    }
-    if (!WriteSyms(pStart, pStop, offsStrings, padSym, padStrings))
+    case XQSR_MEMORY:
+      fprintf(stderr, "malloc for input buffer failed - size= %ld\n", cbFile);
       return 0;
+    default:
+      fprintf(stderr, "input is not a valid XQS file - '%s'\n", fIn);
+      return 0;
+  }
+}
 
-    pStart = pStop;
+/*****************************************************************************/
+/* Print the address of every symbol named szQuery using the file's name
+ * index.  Entries whose hash matches but whose name doesn't are skipped.
+ */
+
+int     QueryXQS(void)
+{
+  int     rtn = 0;
+  int     rc;
+  int     cntFound = 0;
+  ULONG   next = 0;
+  XQSREAD xr;
+  XQSRESULT res;
+
+  if (!OpenXQS(&xr))
+    return 0;
+
+  while ((rc = xqs_findname(&xr, szQuery, &next, &res)) == XQSR_OK) {
+    printf("   %04hX:%08lX  %s\n", res.seg, res.address, res.pszName);
+    cntFound++;
   }
 
-  return 1;
+  if (rc == XQSR_NOHASH)
+    fprintf(stderr, "'%s' has no name index - recreate it using '-a'\n", fIn);
+  else
+  if (rc != XQSR_NOSYM)
+    fprintf(stderr, "invalid name index at %lx - aborting\n",
+            xr.pFile->offsHash);
+  else
+  if (!cntFound)
+    fprintf(stderr, "'%s' not found in '%s'\n", szQuery, fIn);
+  else
+    rtn = 1;
+
+  xqs_close(&xr);
+  return rtn;
 }
 
 /*****************************************************************************/
+/*  Address resolution                                                       */
+/*****************************************************************************/
+/* Print the symbol for each seg:offset address in fAddr, in the order
+ * they appear.  The addresses are sorted first so that xqs_merge() can
+ * resolve all of a segment's addresses in a single pass over its symbols,
+ * then the results are formatted in sorted order (so each symbol is only
+ * fetched once) & printed in input order.
+ */
 
-int     WriteSyms(REMAP** pStart, REMAP** pStop, ULONG offsStrings,
-                  ULONG padSym, ULONG padStrings)
+int     ResolveXQS(void)
 {
-  ULONG     pos;
-  ULONG     cur;
-  REMAP**   pr;
-  REMAP *   r;
-  XQSYM     xqs;
-
-  memset(&xqs, 0, sizeof(xqs));
-  pos = offsStrings;
+  int     rtn = 0;
+  int     rc;
+  ULONG   ctr;
+  ULONG   first;
+  ULONG   cb;
+  ULONG   cnt = 0;
+  ULONG   cntAlloc = 0;
+  ULONG   cbText = 0;
+  ULONG   cbAlloc = 0;
+  ULONG   offs;
+  USHORT  seg;
+  char *  pLine = 0;
+  char *  pText = 0;
+  ULONG * aOffs = 0;
+  ULONG * aNdx;
+  ULONG * aText;
+  ADDRQ * aAddr = 0;
+  void *  ptr;
+  XQSREAD xr;
+  XQSRESULT res;
+
+  if (!OpenXQS(&xr))
+    return 0;
 
-  /* Write XQSYM entries, */
-  for (pr = pStart; pr < pStop; pr++) {
-    r = *pr;
+do {
+  /* Collect the first address on each line. */
+  if (!OpenMap(fAddr))
+    break;
 
-    /* Ignore module entries. */
-    if (!(r->type & REMAP_OBJ))
+  while ((pLine = GetLine()) != 0) {
+    if (!ParseAddr(pLine, &seg, &offs))
       continue;
 
-    xqs.address  = r->offs;
-    xqs.offsName = pos;
-    xqs.cbName   = r->lth;
-    pos += r->lth;
-
-    /* Store module references if appropriate.  Note:  OPT_NOMOD may
-     * be set by user request or because there was no module info.
-     */
-    if (!(opts & OPT_NOMOD)) {
-      if (r->mod) {
-        xqs.cbMod   = r->mod->lth;
-        xqs.offsMod = r->mod->offs;
-      }
-      else {
-        xqs.cbMod   = 0;
-        xqs.offsMod = 0;
+    if (cnt == cntAlloc) {
+      cntAlloc = cntAlloc ? cntAlloc * 2 : 1024;
+      ptr = realloc(aAddr, cntAlloc * sizeof(ADDRQ));
+      if (!ptr) {
+        fprintf(stderr, "realloc for addresses failed - size= %ld\n",
+                cntAlloc * sizeof(ADDRQ));
+        break;
       }
+      aAddr = (ADDRQ*)ptr;
     }
 
-    if (fwrite(&xqs, 1, cbXQSYM, fo) != cbXQSYM) {
-      fprintf(stderr, "error writing XQSYM to file - aborting\n");
-      return 0;
-    }
+    aAddr[cnt].offs = offs;
+    aAddr[cnt].seg  = seg;
+    aAddr[cnt].ndx  = cnt;
+    cnt++;
   }
+  CloseMap();
 
-  /* If there should be padding after the XQSYMs, write it. */
-  if (padSym) {
-    if (fwrite(aPad, 1, padSym, fo) != padSym) {
-      fprintf(stderr, "error writing XQSYM padding to file - aborting\n");
-      return 0;
-    }
+  if (pLine || fMapErr)
+    break;
+
+  if (!cnt) {
+    fprintf(stderr, "no seg:offset addresses found in '%s'\n", fAddr);
+    break;
   }
 
-  /* Confirm we're where we should be. */
-  if (ftell(fo) != offsStrings) {
-    fprintf(stderr, "XQSYM array not expected length  - aborting\n");
-    return 0;
+  aOffs = (ULONG*)malloc(cnt * 3 * sizeof(ULONG));
+  if (!aOffs) {
+    fprintf(stderr, "malloc for addresses failed - size= %ld\n",
+            cnt * 3 * sizeof(ULONG));
+    break;
+  }
+  aNdx  = &aOffs[cnt];
+  aText = &aOffs[cnt * 2];
+
+  qsort(aAddr, cnt, sizeof(ADDRQ), ResolveSorter);
+  for (ctr = 0; ctr < cnt; ctr++)
+    aOffs[ctr] = aAddr[ctr].offs;
+
+  /* Resolve each segment's addresses. */
+  for (first = 0; first < cnt; first = ctr) {
+    for (ctr = first; ctr < cnt && aAddr[ctr].seg == aAddr[first].seg; ctr++)
+      ;
+
+    rc = xqs_merge(&xr, aAddr[first].seg, &aOffs[first], ctr - first,
+                   &aNdx[first]);
+    if (rc == XQSR_NOSEG)
+      memset(&aNdx[first], 0xFF, (ctr - first) * sizeof(ULONG));
+    else
+    if (rc != XQSR_OK) {
+      fprintf(stderr, "invalid symbols for segment %04hX - aborting\n",
+              aAddr[first].seg);
+      break;
+    }
   }
+  if (first < cnt)
+    break;
 
-  /* Write the symbols' strings. */
-  for (pr = pStart; pr < pStop; pr++) {
-    if (!((*pr)->type & REMAP_OBJ))
-      continue;
+  /* Format the results, fetching a symbol only when it changes.  The
+   * text for each address is located via its position in the input.
+   */
+  for (ctr = 0; ctr < cnt; ctr++) {
+    if (aNdx[ctr] != XQSR_NONE &&
+        (!ctr || aNdx[ctr] != aNdx[ctr - 1] ||
+         aAddr[ctr].seg != aAddr[ctr - 1].seg) &&
+        xqs_getsym(&xr, aAddr[ctr].seg, aNdx[ctr], &res) != XQSR_OK) {
+      fprintf(stderr, "invalid symbol for %04hX:%08lX - aborting\n",
+              aAddr[ctr].seg, aAddr[ctr].offs);
+      break;
+    }
 
-    if (fwrite((*pr)->text, 1, (*pr)->lth, fo) != (*pr)->lth) {
-      fprintf(stderr, "error writing symbol name to file - aborting\n");
-      return 0;
+    cb = 64;
+    if (aNdx[ctr] != XQSR_NONE)
+      cb += strlen(res.pszName) + (res.pszMod ? strlen(res.pszMod) : 0);
+    if (cbText + cb > cbAlloc) {
+      cbAlloc = (cbText + cb > cbAlloc * 2) ? cbText + cb : cbAlloc * 2;
+      ptr = realloc(pText, cbAlloc);
+      if (!ptr) {
+        fprintf(stderr, "realloc for results failed - size= %ld\n", cbAlloc);
+        break;
+      }
+      pText = (char*)ptr;
     }
-  }
 
-  /* If there should be padding after the strings, write it. */
-  if (padStrings) {
-    if (fwrite(aPad, 1, padStrings, fo) != padStrings) {
-      fprintf(stderr, "error writing symbol name padding to file - aborting\n");
-      return 0;
+    aText[aAddr[ctr].ndx] = cbText;
+    cbText += sprintf(&pText[cbText], "   %04hX:%08lX  ",
+                      aAddr[ctr].seg, aAddr[ctr].offs);
+
+    if (aNdx[ctr] == XQSR_NONE)
+      cbText += sprintf(&pText[cbText], "[no symbol]");
+    else {
+      cbText += sprintf(&pText[cbText], "%s", res.pszName);
+      if (aAddr[ctr].offs != res.address)
+        cbText += sprintf(&pText[cbText], " + %lX",
+                          aAddr[ctr].offs - res.address);
+      if (res.pszMod)
+        cbText += sprintf(&pText[cbText], "  (%s)", res.pszMod);
     }
+    cbText++;
   }
+  if (ctr < cnt)
+    break;
 
-  /* Confirm we're where we should be (pos doesn't include any padding). */
-  cur = ftell(fo);
-  if (cur != pos + padStrings) {
-    fprintf(stderr, "name array not expected length - aborting - expected= %ld  actual= %ld\n",
-            pos, cur);
-    return 0;
-  }
+  for (ctr = 0; ctr < cnt; ctr++)
+    printf("%s\n", &pText[aText[ctr]]);
 
-  return 1;
+  rtn = 1;
+
+} while (0);
+
+  if (pText)
+    free(pText);
+  if (aOffs)
+    free(aOffs);
+  if (aAddr)
+    free(aAddr);
+
+  xqs_close(&xr);
+  return rtn;
 }
 
 /*****************************************************************************/
-/*  XQS to XQL                                                               */
-/*****************************************************************************/
-/* Create *.xql from *.xqs */
+/* Sort addresses by seg & offs, keeping duplicates in input order. */
 
-int     DumpXQS(void)
+int     ResolveSorter(const void *key, const void *element)
 {
-  int     hIn;
-  int     rtn = 1;
-  int     modCnt = 0;
-  int     symCnt = 0;
-  int     fMod;
-  int     ctr;
-  ULONG   offsSeg;
-  ULONG   lastMod;
-  ULONG   maxMod = 0;
-  FILE *  fl = 0;
-  XQFILE* xqFile;
-  XQSEG * xqSeg;
-  XQSYM * xqs;
+  ADDRQ * p1 = (ADDRQ*)key;
+  ADDRQ * p2 = (ADDRQ*)element;
 
-  /* Open the xqs file. */
-  hIn = open(fIn, O_RDONLY | O_BINARY, 0);
-  if (hIn < 0) {
-    fprintf(stderr, "unable to open input file '%s'\n", fIn);
-    return 0;
-  }
+  if (p1->seg != p2->seg)
+    return (p1->seg < p2->seg) ? -1 : 1;
 
-  /* Read the entire file into the buffer then close it. */
-  rtn = read(hIn, buffer, cbBuffer);
-  close(hIn);
+  if (p1->offs != p2->offs)
+    return (p1->offs < p2->offs) ? -1 : 1;
 
-  /* Ensure we got the entire file. */
-  if (rtn != cbFile) {
-    fprintf(stderr, "unable to read entire input file '%s'\n", fIn);
-    return 0;
-  }
+  if (p1->ndx != p2->ndx)
+    return (p1->ndx < p2->ndx) ? -1 : 1;
 
-  xqFile = (XQFILE*)buffer;
+  return 0;
+}
 
-  /* Confirm this is a valid XQS file. */
-  if (xqFile->magic != XQFILE_MAGIC) {
-    fprintf(stderr, "input is not a valid XQS file - '%s'\n", fIn);
-    return 0;
-  }
+/*****************************************************************************/
+/* Find the first seg:offset on a line, e.g. in a trap report.  The seg
+ * must be 1-4 hex digits & the offset 1-8, and neither may adjoin other
+ * letters or digits, so register names like "CS:EIP" are skipped.
+ */
 
-  /* Open the listing file. */
-  fl = fopen(fOut, "w");
-  if (!fl) {
-    fprintf(stderr, "unable to open list file '%s'\n", fOut);
-    return 0;
-  }
+int     ParseAddr(char* pLine, USHORT* pSeg, ULONG* pOffs)
+{
+  char *  pColon;
+  char *  pStart;
+  char *  pEnd;
 
-  /* Print a report header & column header. */
-  fprintf(fl, pszReportHdr, (xqFile->offsMod) ? " and source files" : "", fIn);
-  fputs(pszColumnHdr, fl);
+  for (pColon = strchr(pLine, ':'); pColon; pColon = strchr(pColon + 1, ':')) {
+    for (pStart = pColon; pStart > pLine && isxdigit((UCHAR)pStart[-1]);
+         pStart--)
+      ;
+    if (pStart == pColon || pColon - pStart > 4 ||
+        (pStart > pLine && (isalnum((UCHAR)pStart[-1]) || pStart[-1] == '_')))
+      continue;
 
-  /* For each segment... */
-  for (offsSeg = xqFile->firstSeg; offsSeg; offsSeg = xqSeg->offsNext) {
+    for (pEnd = pColon + 1; isxdigit((UCHAR)*pEnd); pEnd++)
+      ;
+    if (pEnd == pColon + 1 || pEnd - pColon > 9 ||
+        isalnum((UCHAR)*pEnd) || *pEnd == '_')
+      continue;
 
-    /* Point at the XQSEG, then confirm it's valid. */
-    xqSeg = (XQSEG*)(buffer + offsSeg);
-    if (offsSeg > cbFile - sizeof(XQSEG) ||
-        xqSeg->magic != XQSEG_MAGIC) {
-      fprintf(stderr, "invalid segment offset %lx - aborting\n", offsSeg);
-      rtn = 0;
-      break;
-    }
+    *pSeg  = (USHORT)strtoul(pStart, 0, 16);
+    *pOffs = strtoul(pColon + 1, 0, 16);
+    return 1;
+  }
 
-    fMod = xqSeg->cbXQSYM >= XQS_SYMSIZE_MOD;
-    lastMod = 0;
-    symCnt += xqSeg->cntSym;
+  return 0;
+}
 
-    /* For each symbol entry in the segment... */
-    for (ctr = xqSeg->cntSym, xqs = (XQSYM*)(buffer + xqSeg->offsSym);
-         ctr;
-         ctr--, xqs = (XQSYM*)((char*)xqs + xqSeg->cbXQSYM)) {
-
-      /* If this seg has module info & the current entry's mod is different
-       * than the previous one's, print the name provided it's valid.
-       */
-      if (fMod && lastMod != xqs->offsMod) {
-        lastMod = xqs->offsMod;
-        if (lastMod > maxMod)
-          maxMod = lastMod;
-        if (xqs->offsMod && xqs->cbMod)
-          fprintf(fl, "\n %s\n", buffer + xqs->offsMod);
-        else
-          fprintf(fl, "\n [unknown]\n");
-      }
+/*****************************************************************************/
+/*  Statistics                                                               */
+/*****************************************************************************/
+/* Report resource usage to stdout.  Since entries are never freed while
+ * the mapfile is being processed, the memory allocated for them is also
+ * its high-water mark.
+ */
 
-      /* Print the symbol info. */
-      fprintf(fl, "   %04hX:%08lX  %s\n", xqSeg->seg, xqs->address,
-              (xqs->offsName && xqs->cbName) ? buffer + xqs->offsName : "[error]");
-    }
-  }
-    
-  /* Show the total number of modules & symbols. */
-  if (rtn) {
-    /* Count the number of module name strings. */
-    if (xqFile->offsMod && maxMod) {
-      char* ptr = buffer + xqFile->offsMod;
-      while (*ptr && ptr <= &buffer[maxMod]) {
-        modCnt++;
-        ptr = strchr(ptr, 0) + 1;
-      }
+void    PrintStats(void)
+{
+  printf(" Entries= %d  Modules= %d\n", recCnt, cntMods);
+  printf(" Entry storage:  blocks= %ld  allocated= %ld  used= %ld\n",
+         arena.cntBlk, arena.cbAlloc, arena.cbUsed);
+  printf(" Address sort:  runs= %d  (%s)\n", cntSortRuns,
+         (cntSortRuns > MAX_SORTRUNS) ? "sorted" : "merged");
+  if (opts & OPT_FRONT)
+    printf(" Symbol names:  original= %ld  front-coded= %ld\n",
+           cbNamesRaw, cbNamesStored);
+  if (opts & OPT_ZIP)
+    printf(" Compression:  original= %ld  stored= %ld\n",
+           cbZipRaw, cbZipStored);
+  if (opts & OPT_PACK)
+    printf(" Symbol tables:  original= %ld  packed= %ld\n",
+           cbPackRaw, cbPackStored);
+  if (opts & OPT_POOL)
+    printf(" String pool:  names= %ld  original= %ld  pooled= %ld  saved= %ld\n",
+           cntPoolNames, cbPoolRaw, cbPool, cbPoolRaw - cbPool);
+
+  if (aDmCache[0].cbMax) {
+    ULONG   ctr;
+    ULONG   cntHit = 0;
+    ULONG   cntMiss = 0;
+    ULONG   cntFlush = 0;
+
+    for (ctr = 0; ctr < MAX_THREADS; ctr++) {
+      cntHit   += aDmCache[ctr].cntHit;
+      cntMiss  += aDmCache[ctr].cntMiss;
+      cntFlush += aDmCache[ctr].cntFlush;
     }
 
-    fprintf(fl, "\n Modules= %d  Symbols= %d\n\n", modCnt, symCnt);
+    printf(" Demangler cache:  size= %ld  hits= %ld  misses= %ld  flushes= %ld\n",
+           cbDmCache, cntHit, cntMiss, cntFlush);
   }
 
-  fclose(fl);
-
-  return rtn;
+  return;
 }
 
 /*****************************************************************************/
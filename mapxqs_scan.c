@@ -0,0 +1,488 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is MapXQS.
+ *
+ * The Initial Developer of the Original Code is
+ * Richard L. Walsh
+ * Portions created by the Initial Developer are Copyright (C) 2010-2011
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ *
+ * ***** END LICENSE BLOCK ***** */
+/*****************************************************************************/
+/*  mapxqs_scan.c - v1.04a
+ *
+ *  These functions locate line & column boundaries for the mapfile
+ *  parsers.  If gcc is told the target supports SSE2 (-msse2) or AVX2
+ *  (-mavx2), they examine 16 or 32 bytes at a time;  otherwise, they
+ *  fall back to plain byte-at-a-time loops.
+ *
+ *  The vector versions only use aligned loads, so they may read a few
+ *  bytes before the start or after the end of a string, but they will
+ *  never read past the end of the memory page that contains it.
+ *
+ *  Compiling this file with -DSCAN_BENCH creates a stand-alone program
+ *  that compares ScanColumns() to the Trim()-based column counting the
+ *  parsers used previously:
+ *    gcc -O2 -msse2 -DSCAN_BENCH -o scanbench.exe mapxqs_scan.c
+ */
+/*****************************************************************************/
+
+#include <string.h>
+#include <stddef.h>
+
+#include "mapxqs_scan.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SCAN_WIDTH      32
+#define SCAN_SIMD       1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SCAN_WIDTH      16
+#define SCAN_SIMD       1
+#else
+#define SCAN_SIMD       0
+#endif
+
+/*****************************************************************************/
+
+#if SCAN_SIMD
+
+/* Each bit in a mask describes the corresponding byte in a block. */
+typedef unsigned int    SCANMASK;
+
+#define SCAN_ALIGN(p)   ((char*)((size_t)(p) & ~(size_t)(SCAN_WIDTH - 1)))
+#define SCAN_FULL       ((SCANMASK)((1ULL << SCAN_WIDTH) - 1))
+#define SCAN_FROM(n)    (SCAN_FULL & ~(SCANMASK)((1ULL << (n)) - 1))
+
+static SCANMASK ScanBlockWS(char* pBlk, SCANMASK* pNul);
+static SCANMASK ScanBlockNL(char* pBlk);
+
+/*****************************************************************************/
+/* Return a mask of the whitespace in an aligned block & a mask of nulls. */
+
+#if SCAN_WIDTH == 32
+
+static SCANMASK ScanBlockWS(char* pBlk, SCANMASK* pNul)
+{
+  __m256i   v;
+  __m256i   ws;
+
+  v  = _mm256_load_si256((__m256i*)pBlk);
+  ws = _mm256_or_si256(
+         _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                         _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+         _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')),
+                         _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))));
+
+  *pNul = (SCANMASK)_mm256_movemask_epi8(
+                      _mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+
+  return (SCANMASK)_mm256_movemask_epi8(ws);
+}
+
+static SCANMASK ScanBlockNL(char* pBlk)
+{
+  __m256i   v;
+
+  v = _mm256_load_si256((__m256i*)pBlk);
+  return (SCANMASK)_mm256_movemask_epi8(
+                     _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+}
+
+#else
+
+static SCANMASK ScanBlockWS(char* pBlk, SCANMASK* pNul)
+{
+  __m128i   v;
+  __m128i   ws;
+
+  v  = _mm_load_si128((__m128i*)pBlk);
+  ws = _mm_or_si128(
+         _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                      _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+         _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')),
+                      _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))));
+
+  *pNul = (SCANMASK)_mm_movemask_epi8(
+                      _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+
+  return (SCANMASK)_mm_movemask_epi8(ws);
+}
+
+static SCANMASK ScanBlockNL(char* pBlk)
+{
+  __m128i   v;
+
+  v = _mm_load_si128((__m128i*)pBlk);
+  return (SCANMASK)_mm_movemask_epi8(
+                     _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+}
+
+#endif /* SCAN_WIDTH */
+
+/*****************************************************************************/
+
+char *  ScanNewline(char* ptr, char* pEnd)
+{
+  char *    pBlk;
+  SCANMASK  bits;
+
+  if (ptr >= pEnd)
+    return pEnd;
+
+  pBlk = SCAN_ALIGN(ptr);
+  bits = ScanBlockNL(pBlk) & SCAN_FROM(ptr - pBlk);
+
+  for (;;) {
+    if (bits) {
+      ptr = pBlk + __builtin_ctz(bits);
+      return (ptr < pEnd) ? ptr : pEnd;
+    }
+
+    pBlk += SCAN_WIDTH;
+    if (pBlk >= pEnd)
+      return pEnd;
+
+    bits = ScanBlockNL(pBlk);
+  }
+}
+
+/*****************************************************************************/
+
+char *  ScanSpace(char* ptr)
+{
+  char *    pBlk;
+  SCANMASK  ws;
+  SCANMASK  nul;
+  SCANMASK  bits;
+
+  pBlk = SCAN_ALIGN(ptr);
+  ws = ScanBlockWS(pBlk, &nul);
+  bits = (~ws | nul) & SCAN_FROM(ptr - pBlk);
+
+  while (!bits) {
+    pBlk += SCAN_WIDTH;
+    ws = ScanBlockWS(pBlk, &nul);
+    bits = (~ws | nul) & SCAN_FULL;
+  }
+
+  return pBlk + __builtin_ctz(bits);
+}
+
+/*****************************************************************************/
+
+char *  ScanWord(char* ptr)
+{
+  char *    pBlk;
+  SCANMASK  ws;
+  SCANMASK  nul;
+  SCANMASK  bits;
+
+  pBlk = SCAN_ALIGN(ptr);
+  ws = ScanBlockWS(pBlk, &nul);
+  bits = (ws | nul) & SCAN_FROM(ptr - pBlk);
+
+  while (!bits) {
+    pBlk += SCAN_WIDTH;
+    ws = ScanBlockWS(pBlk, &nul);
+    bits = ws | nul;
+  }
+
+  return pBlk + __builtin_ctz(bits);
+}
+
+/*****************************************************************************/
+/* This walks the transitions between whitespace & non-whitespace in each
+ * block's mask.  A null is treated as whitespace that also ends the line.
+ */
+
+int     ScanColumns(char* ptr, COLSPAN* pCol, int maxCol)
+{
+  int       cnt = 0;
+  int       inCol = 0;
+  int       ndx;
+  int       end;
+  char *    pBlk;
+  char *    pStart = 0;
+  SCANMASK  ws;
+  SCANMASK  nul;
+  SCANMASK  bits;
+
+  pBlk = SCAN_ALIGN(ptr);
+  ndx = ptr - pBlk;
+
+  for (;;) {
+    ws   = ScanBlockWS(pBlk, &nul);
+    nul &= SCAN_FROM(ndx);
+    ws  |= nul;
+    end  = nul ? __builtin_ctz(nul) : SCAN_WIDTH;
+
+    while (ndx < end) {
+      bits = ((inCol ? ws : ~ws) & SCAN_FULL) >> ndx;
+      if (!bits)
+        break;
+
+      ndx += __builtin_ctz(bits);
+      if (inCol) {
+        if (cnt < maxCol) {
+          pCol[cnt].ptr = pStart;
+          pCol[cnt].cb  = pBlk + ndx - pStart;
+        }
+        cnt++;
+        inCol = 0;
+      }
+      else {
+        if (ndx >= end)
+          break;
+        pStart = pBlk + ndx;
+        inCol = 1;
+      }
+    }
+
+    /* A column that ends at the start of this block is still open. */
+    if (nul) {
+      if (inCol) {
+        if (cnt < maxCol) {
+          pCol[cnt].ptr = pStart;
+          pCol[cnt].cb  = pBlk + end - pStart;
+        }
+        cnt++;
+      }
+      break;
+    }
+
+    pBlk += SCAN_WIDTH;
+    ndx = 0;
+  }
+
+  return cnt;
+}
+
+/*****************************************************************************/
+
+#else /* !SCAN_SIMD */
+
+/*****************************************************************************/
+
+#define SCAN_ISWS(c)    ((c) == ' ' || (c) == '\t' || (c) == '\r' || (c) == '\n')
+
+char *  ScanNewline(char* ptr, char* pEnd)
+{
+  if (ptr >= pEnd)
+    return pEnd;
+
+  ptr = memchr(ptr, '\n', pEnd - ptr);
+  return ptr ? ptr : pEnd;
+}
+
+/*****************************************************************************/
+
+char *  ScanSpace(char* ptr)
+{
+  while (SCAN_ISWS(*ptr))
+    ptr++;
+
+  return ptr;
+}
+
+/*****************************************************************************/
+
+char *  ScanWord(char* ptr)
+{
+  while (*ptr && !SCAN_ISWS(*ptr))
+    ptr++;
+
+  return ptr;
+}
+
+/*****************************************************************************/
+
+int     ScanColumns(char* ptr, COLSPAN* pCol, int maxCol)
+{
+  int     cnt = 0;
+  char *  pStart;
+
+  for (;;) {
+    ptr = ScanSpace(ptr);
+    if (!*ptr)
+      break;
+
+    pStart = ptr;
+    ptr = ScanWord(ptr);
+
+    if (cnt < maxCol) {
+      pCol[cnt].ptr = pStart;
+      pCol[cnt].cb  = ptr - pStart;
+    }
+    cnt++;
+  }
+
+  return cnt;
+}
+
+/*****************************************************************************/
+
+#endif /* SCAN_SIMD */
+
+/*****************************************************************************/
+/*  Microbenchmark                                                           */
+/*****************************************************************************/
+
+#ifdef SCAN_BENCH
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCH_LINES     4096
+#define BENCH_PASSES    500
+
+char *  pszWS = " \t\r\n";
+
+/*****************************************************************************/
+/* This is the Trim() used by mapxqs v1.04a. */
+
+char*   OldTrim(char* pTrim, char** ppNext)
+{
+  char *  ptr;
+
+  if (ppNext)
+    *ppNext = 0;
+
+  if (!pTrim)
+    return 0;
+
+  pTrim += strspn(pTrim, pszWS);
+  if (!*pTrim)
+    return 0;
+
+  ptr = strpbrk(pTrim, pszWS);
+  if (!ptr)
+    return pTrim;
+
+  *ptr++ = 0;
+  if (ppNext && *ptr)
+    *ppNext = ptr;
+
+  return pTrim;
+}
+
+/*****************************************************************************/
+/* This is the column counting & symbol extraction IbmStorePublics() did. */
+
+int     OldColumns(char* ptr, char** ppSym)
+{
+  int     ctr;
+  char *  pEnd;
+
+  for (pEnd = ptr, ctr = 0; pEnd && *pEnd; pEnd = strpbrk(pEnd, pszWS)) {
+    pEnd += strspn(pEnd, pszWS);
+    if (!*pEnd)
+      break;
+    ctr++;
+  }
+
+  if (ctr == 2) {
+    pEnd = OldTrim(ptr, &ptr);
+    if (strlen(pEnd) == 3)
+      ctr--;
+  }
+
+  *ppSym = OldTrim(ptr, 0);
+
+  return ctr;
+}
+
+/*****************************************************************************/
+
+int     NewColumns(char* ptr, char** ppSym)
+{
+  int     ctr;
+  COLSPAN aCol[3];
+
+  ctr = ScanColumns(ptr, aCol, 3);
+  if (ctr == 2 && aCol[0].cb == 3) {
+    aCol[0] = aCol[1];
+    ctr--;
+  }
+
+  aCol[0].ptr[aCol[0].cb] = 0;
+  *ppSym = aCol[0].ptr;
+
+  return ctr;
+}
+
+/*****************************************************************************/
+
+int     main(void)
+{
+  int     ctr;
+  int     pass;
+  int     lth;
+  int     chk[2] = {0, 0};
+  char *  pText;
+  char *  pWork;
+  char *  pSym;
+  char *  apLine[BENCH_LINES];
+  clock_t start;
+  clock_t elapsed[2];
+
+  /* Create lines that look like the remainder of a publics entry. */
+  pText = malloc(BENCH_LINES * 128);
+  pWork = malloc(BENCH_LINES * 128);
+  for (ctr = 0, lth = 0; ctr < BENCH_LINES; ctr++) {
+    apLine[ctr] = pWork + lth;
+    lth += sprintf(pText + lth, "%s_ZN%dnsComponent%dMethod%dEv%s",
+                   (ctr % 7) ? "       " : "  Imp  ",
+                   ctr % 50 + 14, ctr, ctr % 13,
+                   (ctr % 3) ? "" : " \t ") + 1;
+  }
+
+  for (pass = 0; pass < 2; pass++) {
+    start = clock();
+    for (ctr = 0; ctr < BENCH_PASSES; ctr++) {
+      int   ndx;
+
+      memcpy(pWork, pText, lth);
+      for (ndx = 0; ndx < BENCH_LINES; ndx++) {
+        if (pass)
+          chk[1] += NewColumns(apLine[ndx], &pSym) + strlen(pSym);
+        else
+          chk[0] += OldColumns(apLine[ndx], &pSym) + strlen(pSym);
+      }
+    }
+    elapsed[pass] = clock() - start;
+  }
+
+  printf("lines= %d  vector width= %d\n", BENCH_LINES * BENCH_PASSES,
+#if SCAN_SIMD
+         SCAN_WIDTH);
+#else
+         1);
+#endif
+  printf("Trim:         %8ld ms\n", (long)(elapsed[0] * 1000 / CLOCKS_PER_SEC));
+  printf("ScanColumns:  %8ld ms\n", (long)(elapsed[1] * 1000 / CLOCKS_PER_SEC));
+  printf("results %s\n", (chk[0] == chk[1]) ? "match" : "DIFFER");
+
+  return (chk[0] != chk[1]);
+}
+
+#endif /* SCAN_BENCH */
+
+/*****************************************************************************/
+
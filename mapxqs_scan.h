@@ -0,0 +1,41 @@
+/*****************************************************************************/
+/*  mapxqs_scan.h                                                            */
+/*****************************************************************************/
+
+#ifndef _mapxqs_scan_h
+#define _mapxqs_scan_h
+
+/*****************************************************************************/
+/*  - used by mapxqs.c & mapxqs_scan.c                                       */
+/*  - whitespace is the same set as pszWS:  space, tab, CR, & LF             */
+/*****************************************************************************/
+
+/* one whitespace-delimited column in a line */
+typedef struct _colspan {
+    char *  ptr;
+    int     cb;
+} COLSPAN;
+
+/* Return the first newline in [ptr, pEnd) or pEnd if there isn't one. */
+char *  ScanNewline(char* ptr, char* pEnd);
+
+/* Return the first character in a null-terminated string that isn't
+ * whitespace, or the terminating null if there is no such character.
+ */
+char *  ScanSpace(char* ptr);
+
+/* Return the first whitespace character or null in a string. */
+char *  ScanWord(char* ptr);
+
+/* Locate the columns in a null-terminated line in a single pass.  The
+ * first maxCol are stored in pCol;  the return is the total number found.
+ * Nothing in the line is modified.
+ */
+int     ScanColumns(char* ptr, COLSPAN* pCol, int maxCol);
+
+/*****************************************************************************/
+
+#endif /* _mapxqs_scan_h */
+
+/*****************************************************************************/
+
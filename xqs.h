@@ -35,22 +35,66 @@
 #define XQSEG_MAGIC   ((ULONG)('x' | ('q' << 8) | ('s' << 16) | ('s' << 24)))
 
 /*
- * Data compression is not implemented currently but may be in some future
- * version.  If/When it is, it will operate at the segment level so that
- * some segments may be compressed while others aren't.  If compression is
- * used anywhere in the file, XQFLAG_ZIP will be set in XQFILE.flags.  If a
- * specific segment is compressed, XQFLAG_ZIP will be set in its XQSEG.flags.
+ * Data compression operates at the segment level so that some segments
+ * may be compressed while others aren't.  If compression is used anywhere
+ * in the file, XQFLAG_ZIP will be set in XQFILE.flags.  If a specific
+ * segment is compressed, XQFLAG_ZIP will be set in its XQSEG.flags.
  * XQFLAG_ZIP_MOD will be set in XQFILE.flags if module names are compressed.
+ * See XQZIP & XQZMOD below for the layout;  see xqszip.c for the method.
  */
 
 #define XQFLAG_ZIP        1
 #define XQFLAG_ZIP_MOD    2
 
+/*
+ * If XQFLAG_FRONT is set in XQSEG.flags, the segment's names are front-
+ * coded in blocks of up to 16 names, each starting on a 16-byte boundary.
+ * The first name in a block is stored in full.  Each of the others is
+ * stored as the nbr of leading bytes it shares with the preceding name,
+ * then the rest of the name including its null.  The count is a varint:
+ * 7 bits per byte, low bits first, with the high bit set if another byte
+ * follows.  XQSYM.offsName is the block's offset plus the name's index
+ * within the block;  XQSYM.cbName is the length of the decoded name.
+ * The flag is also set in XQFILE.flags if any segment uses it.
+ */
+
+#define XQFLAG_FRONT      4
+
+/*
+ * If XQFLAG_POOL is set in XQFILE.flags, symbol names aren't stored with
+ * their segments.  Instead, each distinct name is stored once in a pool
+ * that follows the module names (if any) and precedes the first segment.
+ * XQSYM.offsName is still an absolute offset, so readers need not treat
+ * these files differently, except that many XQSYMs may share one name.
+ */
+
+#define XQFLAG_POOL       8
+
+/*
+ * If XQFLAG_PACK is set in XQSEG.flags, the segment's symbols are stored
+ * in a compact encoding rather than as an array of XQSYM (see XQPACK
+ * below).  The flag is also set in XQFILE.flags if any segment uses it.
+ */
+
+#define XQFLAG_PACK       16
+
+/*
+ * If XQFLAG_SEGDIR is set in XQFILE.flags, the XQSEG headers are grouped
+ * in a directory at the beginning of the file rather than preceding each
+ * segment's symbols (see XQSEGDIR below).
+ */
+
+#define XQFLAG_SEGDIR     32
+
 /*
  * XQFILE starts at byte 0 in the file and is the only header whose location
  * is guaranteed to be at a specific offset.  It will always be at least 32
  * bytes but may be larger by some multiple of 16 bytes.
  *
+ * If offsHash isn't zero, it points at the file's name index (see XQHASH).
+ * If offsDir isn't zero, it points at the file's segment directory (see
+ * XQSEGDIR).
+ *
  * Note:  all offsets in all structures are absolute, i.e. they are relative
  *        to the beginning of the file.
  */
@@ -63,15 +107,19 @@ typedef struct _XQFILE {
   USHORT  unused;
   ULONG   firstSeg;
   ULONG   offsMod;
-  ULONG   reserved[3];
+  ULONG   offsHash;
+  ULONG   offsDir;
+  ULONG   reserved[1];
 } XQFILE;
 
 /*
  * XQSEG currently appears immediately before the array of XQSYM structs
  * for a specific segment.  However, its position relative to them is not
- * guaranteed.  Some future version may position them elsewhere (e.g. in
- * a group at the beginning of the file).  It will always be at least 32
+ * guaranteed:  if the file has a segment directory, the headers are
+ * grouped in it instead (see XQSEGDIR).  It will always be at least 32
  * bytes but may be larger by some multiple of 16 bytes.
+ *
+ * If offsIndex isn't zero, it points at the segment's XQINDEX (see below).
  */
 
 typedef struct _XQSEG {
@@ -83,7 +131,8 @@ typedef struct _XQSEG {
   ULONG   cntSym;
   ULONG   offsSym;
   ULONG   offsNext;
-  ULONG   reserved[2];
+  ULONG   offsIndex;
+  ULONG   reserved[1];
 } XQSEG;
 
 /*
@@ -116,5 +165,172 @@ typedef struct _XQSYM {
 #define XQS_SYMSIZE_MOD     16
 #define XQS_SYMSIZE_ALL     sizeof(XQSYM)
 
+/*
+ * If XQFLAG_ZIP is set in XQSEG.flags, XQSEG.offsSym points at an XQZIP
+ * rather than an array of XQSYM.  The segment's symbols are divided into
+ * blocks of XQZIP.cntBlkSym entries (the last may have fewer) which are
+ * compressed separately, so finding a symbol only requires expanding one
+ * block.  XQZIP is followed by an array of XQZBLK, one per block, in
+ * address order.  An expanded block contains an array of XQSYM followed
+ * by their names;  XQSYM.offsName is relative to the start of the block.
+ * XQZBLK.offsData is relative to the start of the XQZIP.  If a block's
+ * cbData equals its cbRaw, the block is stored without compression.
+ */
+
+#define XQZIP_MAGIC   ((ULONG)('x' | ('q' << 8) | ('s' << 16) | ('z' << 24)))
+
+typedef struct _XQZIP {
+  ULONG   magic;
+  USHORT  cbStruct;
+  USHORT  cbXQZBLK;
+  ULONG   cntBlk;
+  ULONG   cntBlkSym;
+} XQZIP;
+
+typedef struct _XQZBLK {
+  ULONG   address;
+  ULONG   offsData;
+  ULONG   cbData;
+  ULONG   cbRaw;
+} XQZBLK;
+
+/*
+ * If XQFLAG_ZIP_MOD is set in XQFILE.flags, XQFILE.offsMod points at an
+ * XQZMOD followed immediately by the compressed module names.  XQSYM.offsMod
+ * still identifies a name as if the expanded names were stored at
+ * XQFILE.offsMod, i.e. its name is at (expanded + offsMod - XQFILE.offsMod).
+ * As with XQZBLK, if cbData equals cbRaw, the names aren't compressed.
+ */
+
+typedef struct _XQZMOD {
+  ULONG   cbData;
+  ULONG   cbRaw;
+} XQZMOD;
+
+/*
+ * If XQFLAG_PACK is set in XQSEG.flags, XQSEG.offsSym points at an XQPACK
+ * followed by an array of XQPBLK.  The segment's symbols are encoded in
+ * blocks of XQPACK.cntBlkSym entries (the last may have fewer).  Each
+ * XQPBLK identifies the first symbol in its block, so the blocks can be
+ * searched like an array of XQSYM.  XQPBLK.offsData is relative to the
+ * start of the XQPACK.  Each symbol is a series of varints (as described
+ * for XQFLAG_FRONT) relative to the preceding symbol:
+ *   - the address minus the preceding address
+ *   - cbName
+ *   - offsName minus the end of the preceding name (offsName + cbName)
+ *   - if XQSEG.cbXQSYM includes module info, offsMod minus the preceding
+ *     offsMod, followed by cbMod if the difference isn't zero
+ * Differences that may be negative are zigzag-encoded, i.e. 0, -1, 1, -2
+ * are stored as 0, 1, 2, 3.  For the first symbol in a block, the
+ * "preceding" symbol has XQPBLK.address & XQPBLK.offsName with all other
+ * fields zero.  XQSEG.cbXQSYM is the size of the XQSYM a symbol decodes
+ * to.  Names are stored normally and may be front-coded.
+ */
+
+#define XQPACK_MAGIC  ((ULONG)('x' | ('q' << 8) | ('s' << 16) | ('p' << 24)))
+
+typedef struct _XQPACK {
+  ULONG   magic;
+  USHORT  cbStruct;
+  USHORT  cbXQPBLK;
+  ULONG   cntBlk;
+  ULONG   cntBlkSym;
+} XQPACK;
+
+typedef struct _XQPBLK {
+  ULONG   address;
+  ULONG   offsData;
+  ULONG   offsName;
+} XQPBLK;
+
+/*
+ * XQINDEX maps each page of a segment's address range to the symbols that
+ * cover it, so an address can be resolved without searching the entire
+ * segment.  Pages are (1 << shift) bytes, normally 4k;  shift is larger
+ * if that's needed to keep the nbr of pages no more than twice the nbr
+ * of symbols.  XQINDEX is followed by cntPage XQIDX entries.  The first
+ * is for the page containing the segment's first symbol (i.e. base is
+ * that symbol's address >> shift), the last is for the page containing
+ * its last symbol.  For each page, first is the index of the last symbol
+ * whose address is at or below the start of the page (or zero if there
+ * isn't one), and last is the index of the last symbol whose address is
+ * below the start of the next page.  The symbol for an address is then
+ * the last of entries [first, last] whose address is at or below it.
+ * Addresses below the first page have no symbol;  those above the last
+ * page belong to the last symbol.  Indexes are positions in the segment's
+ * symbols in address order whether or not they're compressed or packed.
+ */
+
+#define XQINDEX_MAGIC ((ULONG)('x' | ('q' << 8) | ('s' << 16) | ('i' << 24)))
+
+typedef struct _XQINDEX {
+  ULONG   magic;
+  USHORT  cbStruct;
+  USHORT  shift;
+  ULONG   base;
+  ULONG   cntPage;
+} XQINDEX;
+
+typedef struct _XQIDX {
+  ULONG   first;
+  ULONG   last;
+} XQIDX;
+
+/*
+ * XQHASH is a name index that identifies the symbols with a given name
+ * without searching every segment.  It's followed by a table of buckets,
+ * then an array of XQHENT - one per symbol - sorted by the 64-bit FNV-1a
+ * hash of the symbol's name (excluding the null);  see XqhHash() in
+ * xqszip.c.  The table has (1 << bitsBkt) + 1 entries:  the symbols
+ * whose hash has a high ULONG whose top bitsBkt bits equal b are entries
+ * [table[b], table[b + 1]).  The XQHENT array starts at the first
+ * 16-byte boundary after the table (relative to the XQHASH).  Each entry
+ * identifies a symbol by the offset of its XQSEG & its position in the
+ * segment's symbols in address order.  Since different names may have
+ * the same hash, the symbol's name should be compared to the one sought.
+ */
+
+#define XQHASH_MAGIC  ((ULONG)('x' | ('q' << 8) | ('s' << 16) | ('h' << 24)))
+
+typedef struct _XQHASH {
+  ULONG   magic;
+  USHORT  cbStruct;
+  USHORT  cbXQHENT;
+  ULONG   cntEnt;
+  USHORT  bitsBkt;
+  USHORT  unused;
+} XQHASH;
+
+typedef struct _XQHENT {
+  ULONG   hashLo;
+  ULONG   hashHi;
+  ULONG   offsSeg;
+  ULONG   ndx;
+} XQHENT;
+
+/*
+ * XQSEGDIR lets a reader find any segment's header without following the
+ * offsNext chain through the file.  It follows XQFILE (see offsDir) & is
+ * followed by a table of cntSlot USHORTs, one for each seg nbr from
+ * segBase to segBase + cntSlot - 1.  Each is one more than the position
+ * of that segment's XQSEG in the directory, or zero if the segment has
+ * no symbols.  The XQSEGs start at the first 16-byte boundary after the
+ * table (relative to the XQSEGDIR) & are cbXQSEG bytes apart, in the
+ * same order as the chain.  firstSeg & offsNext still link them, so
+ * readers that don't know about the directory can use the chain.
+ */
+
+#define XQSEGDIR_MAGIC ((ULONG)('x' | ('q' << 8) | ('s' << 16) | ('d' << 24)))
+
+typedef struct _XQSEGDIR {
+  ULONG   magic;
+  USHORT  cbStruct;
+  USHORT  cbXQSEG;
+  ULONG   cntSeg;
+  USHORT  segBase;
+  USHORT  unused;
+  ULONG   cntSlot;
+} XQSEGDIR;
+
 /*****************************************************************************/
 
@@ -0,0 +1,762 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is MapXQS.
+ *
+ * The Initial Developer of the Original Code is
+ * Richard L. Walsh
+ * Portions created by the Initial Developer are Copyright (C) 2010-2011
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ *
+ * ***** END LICENSE BLOCK ***** */
+/*****************************************************************************/
+/*  xqsload.c - v1.04a
+ *
+ *  XQSLoad measures the throughput & latency of xqssrv.exe.  It reads
+ *  an .xqs file itself to pick a sample of addresses (or names), then
+ *  each of its threads opens the server's pipe & sends batches of
+ *  randomly chosen samples, timing each request.  With -c, it also
+ *  confirms that every reply matches what xqsread.c finds locally.
+ *  With -s, it doesn't use the server:  it looks up every sample using
+ *  both xqs_lookup() & xqs_seeklookup() (see xqsseek.c) & reports any
+ *  differences.
+ *
+ *  Requests whose replies are partial (see XQSRVHDR.cntDone) aren't
+ *  resent;  only the items that were answered are counted.
+ *
+ */
+/*****************************************************************************/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <process.h>
+
+#define INCL_DOS
+#define INCL_DOSERRORS
+#include <os2.h>
+
+#include "xqs.h"
+#include "xqsread.h"
+#include "xqssrv.h"
+
+/*****************************************************************************/
+
+#define CNT_THREADS       4
+#define MAX_THREADS       64
+#define CNT_REQUESTS      1000
+#define CNT_BATCH         100
+#define MAX_BATCH         (XQSRV_CBMSG / sizeof(XQSRVADDR))
+#define CNT_SAMPLE        4096
+#define CB_SEEKBUF        0x10000
+#define CB_THREADSTACK    0x40000
+
+/* an address or name to send & (with -c) what the server should return */
+
+typedef struct _sample {
+    USHORT  seg;
+    ULONG   offset;
+    char *  pszName;
+} SAMPLE;
+
+/* the results for one thread;  aLat holds the time taken by each
+ * request in timer ticks
+ */
+
+typedef struct _loadwork {
+    int     tid;
+    int     ndx;
+    ULONG   seed;
+    ULONG   cntReq;
+    ULONG   cntItem;
+    ULONG   cntPartial;
+    ULONG   cntErr;
+    ULONG * aLat;
+    char *  pReq;
+    char *  pRep;
+} LOADWORK;
+
+/*****************************************************************************/
+
+int     ParseArgs(int argc, char* argv[]);
+int     GetSamples(void);
+void    LoadThread(void* pv);
+ULONG   BuildRequest(LOADWORK* pw, ULONG* aNdx);
+int     CheckReply(LOADWORK* pw, XQSREAD* pxr, ULONG* aNdx);
+int     CheckSeek(void);
+ULONG   Random(LOADWORK* pw);
+void    Report(ULONG ticks);
+int     LatencySorter(const void *key, const void *element);
+
+/*****************************************************************************/
+
+int     cntThreads = CNT_THREADS;
+ULONG   cntRequests = CNT_REQUESTS;
+ULONG   cntBatch = CNT_BATCH;
+int     fNames = 0;
+int     fCheck = 0;
+int     fSeek = 0;
+ULONG   ulFreq = 1;
+ULONG   cntSample = 0;
+char    szPipe[CCHMAXPATH] = XQSRV_PIPE;
+char    szFile[CCHMAXPATH] = "";
+XQSREAD xrFile;
+SAMPLE  aSample[CNT_SAMPLE];
+LOADWORK  aWork[MAX_THREADS];
+
+char *  pszHelp =
+        "\n"
+        " XQSLoad v1.04a - (C)2010-2011  R L Walsh\n"
+        " Measures the throughput & latency of xqssrv.exe.\n"
+        "\n"
+        " Usage:  xqsload [-options] file.xqs\n"
+        "   -p  specify the pipe name           (default: " XQSRV_PIPE ")\n"
+        "   -t  nbr of threads (connections)    (default: -t4  max: -t64)\n"
+        "   -n  nbr of requests per thread      (default: -n1000)\n"
+        "   -b  nbr of items per request        (default: -b100)\n"
+        "   -q  send names rather than addresses (requires mapxqs -a)\n"
+        "   -c  confirm that every reply is correct\n"
+        "   -s  compare xqs_seeklookup() to xqs_lookup() without the server\n"
+        "\n";
+
+/*****************************************************************************/
+
+int     main(int argc, char* argv[])
+{
+  int       rtn = 1;
+  int       ctr;
+  LOADWORK* pw;
+  QWORD     qwStart;
+  QWORD     qwEnd;
+
+  if (!ParseArgs(argc, argv))
+    return 1;
+
+  if (xqs_open(&xrFile, szFile) != XQSR_OK) {
+    fprintf(stderr, "unable to read '%s' or it isn't a valid XQS file\n",
+            szFile);
+    return 1;
+  }
+
+do {
+  if (!GetSamples())
+    break;
+
+  if (fSeek) {
+    rtn = (CheckSeek() ? 0 : 1);
+    break;
+  }
+
+  DosTmrQueryFreq(&ulFreq);
+
+  for (ctr = 0; ctr < cntThreads; ctr++) {
+    pw = &aWork[ctr];
+    pw->ndx  = ctr;
+    pw->seed = ctr * 7919 + 1;
+    pw->aLat = (ULONG*)calloc(cntRequests, sizeof(ULONG));
+    pw->pReq = (char*)malloc(XQSRV_CBMSG);
+    pw->pRep = (char*)malloc(XQSRV_CBMSG);
+    if (!pw->aLat || !pw->pReq || !pw->pRep) {
+      fprintf(stderr, "malloc for thread %d failed\n", ctr);
+      break;
+    }
+  }
+  if (ctr < cntThreads)
+    break;
+
+  /* Start the threads, then wait for all of them. */
+  DosTmrQueryTime(&qwStart);
+
+  for (ctr = 0; ctr < cntThreads; ctr++) {
+    pw = &aWork[ctr];
+    pw->tid = _beginthread(LoadThread, 0, CB_THREADSTACK, pw);
+    if (pw->tid == -1) {
+      pw->tid = 0;
+      LoadThread(pw);
+    }
+  }
+
+  for (ctr = 0; ctr < cntThreads; ctr++) {
+    if (aWork[ctr].tid) {
+      TID   tid = aWork[ctr].tid;
+      DosWaitThread(&tid, DCWW_WAIT);
+    }
+  }
+
+  DosTmrQueryTime(&qwEnd);
+
+  Report(qwEnd.ulLo - qwStart.ulLo);
+  rtn = 0;
+  for (ctr = 0; ctr < cntThreads; ctr++) {
+    if (aWork[ctr].cntErr)
+      rtn = 1;
+  }
+
+} while (0);
+
+  for (ctr = 0; ctr < cntThreads; ctr++) {
+    pw = &aWork[ctr];
+    if (pw->aLat)
+      free(pw->aLat);
+    if (pw->pReq)
+      free(pw->pReq);
+    if (pw->pRep)
+      free(pw->pRep);
+  }
+
+  for (ctr = 0; ctr < (int)cntSample; ctr++) {
+    if (aSample[ctr].pszName)
+      free(aSample[ctr].pszName);
+  }
+
+  xqs_close(&xrFile);
+
+  return rtn;
+}
+
+/*****************************************************************************/
+
+int     ParseArgs(int argc, char* argv[])
+{
+  int     ctr;
+  int     needPipe = 0;
+  char *  ptr;
+
+  if (argc < 2) {
+    fprintf(stderr, pszHelp);
+    return 0;
+  }
+
+  for (ctr = 1; ctr < argc; ctr++) {
+
+    if (*argv[ctr] == '-' || *argv[ctr] == '/') {
+      ptr = argv[ctr];
+
+      while (*(++ptr)) {
+        switch(*ptr) {
+          case 'p':
+          case 'P':
+            needPipe = 1;
+            break;
+
+          case 'q':
+          case 'Q':
+            fNames = 1;
+            break;
+
+          case 'c':
+          case 'C':
+            fCheck = 1;
+            break;
+
+          case 's':
+          case 'S':
+            fSeek = 1;
+            break;
+
+          /* the value immediately follows the option */
+          case 't':
+          case 'T':
+            cntThreads = strtoul(ptr + 1, &ptr, 10);
+            ptr--;
+            if (cntThreads < 1 || cntThreads > MAX_THREADS) {
+              fprintf(stderr, "the nbr of threads must be 1 - %d\n",
+                      MAX_THREADS);
+              return 0;
+            }
+            break;
+
+          case 'n':
+          case 'N':
+            cntRequests = strtoul(ptr + 1, &ptr, 10);
+            ptr--;
+            if (!cntRequests)
+              cntRequests = 1;
+            break;
+
+          case 'b':
+          case 'B':
+            cntBatch = strtoul(ptr + 1, &ptr, 10);
+            ptr--;
+            if (!cntBatch)
+              cntBatch = 1;
+            if (cntBatch > MAX_BATCH)
+              cntBatch = MAX_BATCH;
+            break;
+
+          case 'h':
+          case 'H':
+          case '?':
+            fprintf(stderr, pszHelp);
+            return 0;
+
+          default:
+            fprintf(stderr, "Invalid option '%c' ignored - continuing...\n", *ptr);
+            break;
+
+        } /* switch */
+      } /* while */
+
+      continue;
+    } /* if */
+
+    if (needPipe) {
+      strncpy(szPipe, argv[ctr], sizeof(szPipe) - 1);
+      needPipe = 0;
+    } else
+    if (!*szFile) {
+      /* the server has its own current directory */
+      if (DosQueryPathInfo(argv[ctr], FIL_QUERYFULLNAME,
+                           szFile, sizeof(szFile))) {
+        fprintf(stderr, "invalid filename or path - '%s'\n", argv[ctr]);
+        return 0;
+      }
+    } else {
+      fprintf(stderr, "Extra argument '%s'\n", argv[ctr]);
+      return 0;
+    }
+  } /* for */
+
+  if (needPipe || !*szFile) {
+    fprintf(stderr, "Missing argument for %s\n",
+            (needPipe ? "pipe name" : "xqs file"));
+    return 0;
+  }
+
+  if (fSeek && fNames) {
+    fprintf(stderr, "Option '-s' can't be combined with '-q'\n");
+    return 0;
+  }
+
+  return 1;
+}
+
+/*****************************************************************************/
+/* Pick symbols from every segment in proportion to its size.  Addresses
+ * are the symbol's address plus a small displacement.
+ */
+
+int     GetSamples(void)
+{
+  ULONG     ctr;
+  ULONG     ndxSeg;
+  ULONG     cntSym;
+  ULONG     cntTotal = 0;
+  USHORT    seg;
+  LOADWORK  lw;
+  XQSRESULT res;
+
+  for (ndxSeg = 0; xqs_getseg(&xrFile, ndxSeg, &seg, &cntSym) == XQSR_OK;
+       ndxSeg++)
+    cntTotal += cntSym;
+
+  if (!cntTotal) {
+    fprintf(stderr, "'%s' has no symbols\n", szFile);
+    return 0;
+  }
+
+  memset(&lw, 0, sizeof(lw));
+  lw.seed = 1;
+  for (ndxSeg = 0; xqs_getseg(&xrFile, ndxSeg, &seg, &cntSym) == XQSR_OK;
+       ndxSeg++) {
+    ULONG   cnt = (ULONG)(((unsigned long long)cntSym * CNT_SAMPLE) / cntTotal);
+
+    if (!cnt && cntSym)
+      cnt = 1;
+
+    for (ctr = 0; ctr < cnt && cntSample < CNT_SAMPLE; ctr++) {
+      if (xqs_getsym(&xrFile, seg, Random(&lw) % cntSym, &res) != XQSR_OK) {
+        fprintf(stderr, "invalid symbol in segment %04hX\n", seg);
+        return 0;
+      }
+
+      aSample[cntSample].seg = seg;
+      aSample[cntSample].offset = res.address + (fNames ? 0 : Random(&lw) % 64);
+      if (fNames) {
+        aSample[cntSample].pszName = strdup(res.pszName);
+        if (!aSample[cntSample].pszName) {
+          fprintf(stderr, "strdup for samples failed\n");
+          return 0;
+        }
+      }
+      cntSample++;
+    }
+  }
+
+  if (fNames && !xrFile.pFile->offsHash) {
+    fprintf(stderr, "'%s' has no name index - recreate it using 'mapxqs -a'\n",
+            szFile);
+    return 0;
+  }
+
+  return 1;
+}
+
+/*****************************************************************************/
+/* Connect to the server & send cntRequests requests, timing each one.
+ * If the server's instances are all busy, wait for one.
+ */
+
+void    LoadThread(void* pv)
+{
+  APIRET    rc;
+  ULONG     ctr;
+  ULONG     ulAction;
+  ULONG     cbReq;
+  ULONG     cbRep;
+  HPIPE     hp = 0;
+  LOADWORK* pw = (LOADWORK*)pv;
+  XQSRVHDR* pHdr = (XQSRVHDR*)pw->pRep;
+  QWORD     qwStart;
+  QWORD     qwEnd;
+  XQSREAD   xr;
+  ULONG     aNdx[MAX_BATCH];
+
+  /* Each thread needs its own XQSREAD but they can share the file. */
+  memset(&xr, 0, sizeof(xr));
+  if (fCheck &&
+      xqs_openmem(&xr, xrFile.pData, xrFile.cbData) != XQSR_OK) {
+    fprintf(stderr, "thread %d: xqs_openmem failed\n", pw->ndx);
+    pw->cntErr++;
+    return;
+  }
+
+do {
+  while ((rc = DosOpen(szPipe, &hp, &ulAction, 0, FILE_NORMAL,
+                       OPEN_ACTION_OPEN_IF_EXISTS | OPEN_ACTION_FAIL_IF_NEW,
+                       OPEN_ACCESS_READWRITE | OPEN_SHARE_DENYNONE |
+                       OPEN_FLAGS_NOINHERIT, 0)) == ERROR_PIPE_BUSY) {
+    if (DosWaitNPipe(szPipe, 10000))
+      break;
+  }
+  if (rc) {
+    fprintf(stderr, "thread %d: unable to open '%s' - rc= %ld\n",
+            pw->ndx, szPipe, rc);
+    pw->cntErr++;
+    break;
+  }
+  DosSetNPHState(hp, NP_WAIT | NP_READMODE_MESSAGE);
+
+  for (ctr = 0; ctr < cntRequests; ctr++) {
+    cbReq = BuildRequest(pw, aNdx);
+
+    DosTmrQueryTime(&qwStart);
+    rc = DosTransactNPipe(hp, pw->pReq, cbReq, pw->pRep, XQSRV_CBMSG, &cbRep);
+    DosTmrQueryTime(&qwEnd);
+    pw->aLat[ctr] = qwEnd.ulLo - qwStart.ulLo;
+
+    if (rc) {
+      fprintf(stderr, "thread %d: DosTransactNPipe failed - rc= %ld\n",
+              pw->ndx, rc);
+      pw->cntErr++;
+      break;
+    }
+
+    pw->cntReq++;
+    if (cbRep < sizeof(XQSRVHDR) || pHdr->magic != XQSRV_MAGIC ||
+        pHdr->cbMsg != cbRep || pHdr->status != XQSR_OK) {
+      fprintf(stderr, "thread %d: request failed - status= %d\n",
+              pw->ndx, (cbRep < sizeof(XQSRVHDR) ? -1 : pHdr->status));
+      pw->cntErr++;
+      continue;
+    }
+
+    pw->cntItem += pHdr->cntDone;
+    if (pHdr->cntDone < ((XQSRVHDR*)pw->pReq)->cntItem)
+      pw->cntPartial++;
+
+    if (fCheck && !CheckReply(pw, &xr, aNdx))
+      pw->cntErr++;
+  }
+
+  DosClose(hp);
+
+} while (0);
+
+  if (fCheck)
+    xqs_close(&xr);
+
+  return;
+}
+
+/*****************************************************************************/
+/* Fill pw->pReq with randomly chosen samples & note which ones in aNdx. */
+
+ULONG   BuildRequest(LOADWORK* pw, ULONG* aNdx)
+{
+  ULONG       ctr;
+  ULONG       cb;
+  ULONG       cbName;
+  XQSRVHDR *  pHdr = (XQSRVHDR*)pw->pReq;
+  XQSRVADDR * pa;
+  SAMPLE *    ps;
+
+  memset(pHdr, 0, sizeof(XQSRVHDR));
+  pHdr->magic = XQSRV_MAGIC;
+  pHdr->type  = fNames ? XQSRV_NAME : XQSRV_ADDR;
+
+  cb = sizeof(XQSRVHDR);
+  strcpy(&pw->pReq[cb], szFile);
+  cb += strlen(szFile) + 1;
+  while (cb & 3)
+    pw->pReq[cb++] = 0;
+
+  for (ctr = 0; ctr < cntBatch; ctr++) {
+    aNdx[ctr] = Random(pw) % cntSample;
+    ps = &aSample[aNdx[ctr]];
+
+    if (fNames) {
+      cbName = strlen(ps->pszName) + 1;
+      if (cbName > XQSRV_CBMSG - cb)
+        break;
+      memcpy(&pw->pReq[cb], ps->pszName, cbName);
+      cb += cbName;
+    }
+    else {
+      if (sizeof(XQSRVADDR) > XQSRV_CBMSG - cb)
+        break;
+      pa = (XQSRVADDR*)&pw->pReq[cb];
+      pa->seg    = ps->seg;
+      pa->unused = 0;
+      pa->offset = ps->offset;
+      cb += sizeof(XQSRVADDR);
+    }
+  }
+
+  pHdr->cntItem = (USHORT)ctr;
+  pHdr->cbMsg = cb;
+  return cb;
+}
+
+/*****************************************************************************/
+/* Confirm each item in a reply using the local copy of the file.  An
+ * address must produce exactly what xqs_lookup() does;  a name must
+ * produce symbols with that name.
+ */
+
+int     CheckReply(LOADWORK* pw, XQSREAD* pxr, ULONG* aNdx)
+{
+  ULONG       ctr;
+  ULONG       cb;
+  char *      ptr = pw->pRep + sizeof(XQSRVHDR);
+  char *      pEnd = pw->pRep + ((XQSRVHDR*)pw->pRep)->cbMsg;
+  char *      pszName;
+  char *      pszMod;
+  XQSRVITEM * pi;
+  SAMPLE *    ps;
+  XQSRESULT   res;
+
+  for (ctr = 0; ctr < ((XQSRVHDR*)pw->pRep)->cntItem; ctr++) {
+    pi = (XQSRVITEM*)ptr;
+    if (ptr + sizeof(XQSRVITEM) > pEnd)
+      break;
+    cb = (sizeof(XQSRVITEM) + pi->cbName + pi->cbMod + 3) & ~3;
+    if (cb > (ULONG)(pEnd - ptr) ||
+        pi->ndx >= ((XQSRVHDR*)pw->pReq)->cntItem)
+      break;
+
+    pszName = pi->cbName ? (char*)&pi[1] : "";
+    pszMod  = pi->cbMod ? (char*)&pi[1] + pi->cbName : "";
+    ps = &aSample[aNdx[pi->ndx]];
+
+    if (fNames) {
+      if ((pi->status != XQSR_OK && pi->status != XQSRV_MORE) ||
+          strcmp(pszName, ps->pszName))
+        break;
+    }
+    else {
+      if (xqs_lookup(pxr, ps->seg, ps->offset, &res) != pi->status)
+        break;
+      if (pi->status == XQSR_OK &&
+          (pi->seg != res.seg || pi->address != res.address ||
+           pi->displacement != res.displacement ||
+           strncmp(pszName, res.pszName, XQSRV_MAXNAME - 1) ||
+           strncmp(pszMod, res.pszMod ? res.pszMod : "", XQSRV_MAXNAME - 1)))
+        break;
+    }
+
+    ptr += cb;
+  }
+
+  if (ctr < ((XQSRVHDR*)pw->pRep)->cntItem || ptr != pEnd) {
+    fprintf(stderr, "thread %d: reply item %ld is incorrect\n",
+            pw->ndx, ctr);
+    return 0;
+  }
+
+  return 1;
+}
+
+/*****************************************************************************/
+/* Look up each sample & the address just below its symbol using both
+ * xqs_lookup() & xqs_seeklookup(), which reads the file through its own
+ * handle.  The results must be identical except that xqs_seeklookup()
+ * may omit a compressed module name that doesn't fit in its buffer.
+ */
+
+int     CheckSeek(void)
+{
+  APIRET    rc;
+  int       rcMem;
+  int       rcSeek;
+  ULONG     ctr;
+  ULONG     ulAction;
+  ULONG     offset;
+  ULONG     cntDone = 0;
+  ULONG     cntErr = 0;
+  HFILE     hFile;
+  char *    pBuf;
+  SAMPLE *  ps;
+  XQSRESULT resMem;
+  XQSRESULT resSeek;
+
+  pBuf = (char*)malloc(CB_SEEKBUF);
+  if (!pBuf) {
+    fprintf(stderr, "malloc for seek buffer failed\n");
+    return 0;
+  }
+
+  rc = DosOpen(szFile, &hFile, &ulAction, 0, FILE_NORMAL,
+               OPEN_ACTION_OPEN_IF_EXISTS | OPEN_ACTION_FAIL_IF_NEW,
+               OPEN_ACCESS_READONLY | OPEN_SHARE_DENYWRITE |
+               OPEN_FLAGS_NOINHERIT, 0);
+  if (rc) {
+    fprintf(stderr, "unable to open '%s' - rc= %ld\n", szFile, rc);
+    free(pBuf);
+    return 0;
+  }
+
+  for (ctr = 0; ctr < cntSample * 2; ctr++) {
+    ps = &aSample[ctr / 2];
+
+    /* the 2nd pass for a sample uses the address below its symbol */
+    offset = ps->offset;
+    if (ctr & 1) {
+      if (xqs_lookup(&xrFile, ps->seg, offset, &resMem) != XQSR_OK ||
+          !resMem.address)
+        continue;
+      offset = resMem.address - 1;
+    }
+
+    rcMem  = xqs_lookup(&xrFile, ps->seg, offset, &resMem);
+    rcSeek = xqs_seeklookup(hFile, ps->seg, offset, pBuf, CB_SEEKBUF,
+                            &resSeek);
+    cntDone++;
+
+    if (rcMem != rcSeek ||
+        (rcMem == XQSR_OK &&
+         (resMem.seg != resSeek.seg || resMem.address != resSeek.address ||
+          resMem.displacement != resSeek.displacement ||
+          resMem.ndx != resSeek.ndx ||
+          strcmp(resMem.pszName, resSeek.pszName) ||
+          (resSeek.pszMod ?
+             (!resMem.pszMod || strcmp(resMem.pszMod, resSeek.pszMod)) :
+             (resMem.pszMod &&
+              !(xrFile.pFile->flags & XQFLAG_ZIP_MOD)))))) {
+      if (cntErr++ < 10)
+        fprintf(stderr, "lookups differ for %04hX:%08lX - rc= %d / %d\n",
+                ps->seg, offset, rcMem, rcSeek);
+    }
+  }
+
+  DosClose(hFile);
+  free(pBuf);
+
+  printf(" seek check:  lookups= %ld  differences= %ld\n",
+         cntDone, cntErr);
+
+  return (cntErr == 0);
+}
+
+/*****************************************************************************/
+/* Each thread has its own generator so they needn't share any state. */
+
+ULONG   Random(LOADWORK* pw)
+{
+  pw->seed = pw->seed * 1103515245 + 12345;
+  return (pw->seed >> 8) & 0xFFFFFF;
+}
+
+/*****************************************************************************/
+/* Print the totals & the distribution of request times. */
+
+void    Report(ULONG ticks)
+{
+  int     ctr;
+  ULONG   cnt = 0;
+  ULONG   cntReq = 0;
+  ULONG   cntItem = 0;
+  ULONG   cntPartial = 0;
+  ULONG   cntErr = 0;
+  double  secs = (double)ticks / ulFreq;
+  double  usec = 1000000.0 / ulFreq;
+  double  total = 0;
+  ULONG * aLat;
+
+  for (ctr = 0; ctr < cntThreads; ctr++) {
+    cntReq     += aWork[ctr].cntReq;
+    cntItem    += aWork[ctr].cntItem;
+    cntPartial += aWork[ctr].cntPartial;
+    cntErr     += aWork[ctr].cntErr;
+  }
+
+  printf(" requests= %ld  items= %ld  partial= %ld  errors= %ld  seconds= %.3f\n",
+         cntReq, cntItem, cntPartial, cntErr, secs);
+  if (!cntReq || secs <= 0)
+    return;
+
+  printf(" requests/sec= %.0f  items/sec= %.0f\n",
+         cntReq / secs, cntItem / secs);
+
+  /* Combine every thread's times & sort them to get the percentiles. */
+  aLat = (ULONG*)malloc(cntReq * sizeof(ULONG));
+  if (!aLat)
+    return;
+
+  for (ctr = 0; ctr < cntThreads; ctr++) {
+    memcpy(&aLat[cnt], aWork[ctr].aLat, aWork[ctr].cntReq * sizeof(ULONG));
+    cnt += aWork[ctr].cntReq;
+  }
+  for (ctr = 0; ctr < (int)cnt; ctr++)
+    total += aLat[ctr];
+
+  qsort(aLat, cnt, sizeof(ULONG), LatencySorter);
+
+  printf(" latency (usec):  min= %.0f  avg= %.0f  p50= %.0f  p90= %.0f"
+         "  p99= %.0f  max= %.0f\n",
+         aLat[0] * usec, total / cnt * usec, aLat[cnt / 2] * usec,
+         aLat[(cnt * 9) / 10] * usec, aLat[(cnt * 99) / 100] * usec,
+         aLat[cnt - 1] * usec);
+
+  free(aLat);
+  return;
+}
+
+/*****************************************************************************/
+
+int     LatencySorter(const void *key, const void *element)
+{
+  ULONG   l1 = *(ULONG*)key;
+  ULONG   l2 = *(ULONG*)element;
+
+  if (l1 != l2)
+    return (l1 < l2) ? -1 : 1;
+
+  return 0;
+}
+
+/*****************************************************************************/
+
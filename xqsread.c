@@ -0,0 +1,1032 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is MapXQS.
+ *
+ * The Initial Developer of the Original Code is
+ * Richard L. Walsh
+ * Portions created by the Initial Developer are Copyright (C) 2010-2011
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ *
+ * ***** END LICENSE BLOCK ***** */
+/*****************************************************************************/
+/*  xqsread.c - v1.04a
+ *
+ *  This is a reader for .xqs files that other programs can use to turn
+ *  seg:offset addresses into symbols.  xqs_open() reads the entire file
+ *  into memory;  xqs_openmem() uses a file that's already in memory
+ *  (e.g. a resource or shared memory) in place, without copying it.
+ *  Either way, every header is validated once when the file is opened,
+ *  so lookups only have to check the offsets of individual symbols.
+ *
+ *  If the file has a segment directory, segments are found through its
+ *  table rather than by searching;  otherwise, the XQSEG chain is used.
+ *
+ *  xqs_lookup() does a binary search of the segment's symbols, using
+ *  its address index (if any) to narrow the search to one page.  For
+ *  compressed segments, it searches the XQZBLK array, expands one block
+ *  into a buffer allocated when the file was opened, then searches the
+ *  block.  The most recently expanded block is kept, so lookups of
+ *  nearby addresses don't expand it again.  For packed segments, it
+ *  searches the XQPBLK array, then decodes that block's symbols.
+ *
+ *  xqs_findname() finds symbols by name using the file's XQHASH, if any.
+ *
+ *  xqs_merge() resolves many offsets in a segment at once:  given them
+ *  in ascending order, it walks the symbols (or blocks) a single time,
+ *  which is faster than separate lookups when there are lots of them.
+ *
+ *  Since XQSEG.cbXQSYM is used as the stride, segments written by later
+ *  versions with larger XQSYMs can still be read.
+ *
+ */
+/*****************************************************************************/
+
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <io.h>
+
+#include <os2.h>
+
+#include "xqs.h"
+#include "xqszip.h"
+#include "xqsread.h"
+
+/*****************************************************************************/
+
+static int      XqsrCheckDir(XQSREAD* pxr, ULONG* pOffs);
+static int      XqsrCheckSeg(XQSREAD* pxr, XQSEG* pSeg);
+static int      XqsrCheckIndex(XQSREAD* pxr, XQSEG* pSeg);
+static XQSEG *  XqsrFindSeg(XQSREAD* pxr, USHORT seg);
+static ULONG    XqsrUpper(const char* pArr, ULONG cbEntry,
+                          ULONG lo, ULONG hi, ULONG offset);
+static int      XqsrFind(XQSREAD* pxr, XQSEG* pSeg, ULONG offset,
+                         ULONG* pNdx);
+static int      XqsrExpand(XQSREAD* pxr, XQSEG* pSeg, ULONG ndxBlk);
+static int      XqsrGetSym(XQSREAD* pxr, XQSEG* pSeg, ULONG ndx,
+                           XQSYM* pSym, const char** ppNames,
+                           ULONG* pcbNames);
+static int      XqsrResult(XQSREAD* pxr, XQSEG* pSeg, ULONG ndx,
+                           XQSRESULT* pRes);
+static const char * XqsrString(const char* pBase, ULONG cbBase, ULONG offs);
+
+/*****************************************************************************/
+/*  Open & close                                                             */
+/*****************************************************************************/
+/* Read the entire file into a null-terminated buffer that's freed
+ * by xqs_close().
+ */
+
+int     xqs_open(XQSREAD* pxr, const char* pszFile)
+{
+  int     hIn;
+  int     rc;
+  long    cb;
+  char *  pData;
+
+  memset(pxr, 0, sizeof(XQSREAD));
+
+  hIn = open(pszFile, O_RDONLY | O_BINARY, 0);
+  if (hIn < 0)
+    return XQSR_IO;
+
+  cb = lseek(hIn, 0, SEEK_END);
+  if (cb < 0 || lseek(hIn, 0, SEEK_SET) != 0) {
+    close(hIn);
+    return XQSR_IO;
+  }
+
+  pData = (char*)malloc(cb + 1);
+  if (!pData) {
+    close(hIn);
+    return XQSR_MEMORY;
+  }
+
+  rc = read(hIn, pData, cb);
+  close(hIn);
+  if (rc != cb) {
+    free(pData);
+    return XQSR_IO;
+  }
+  pData[cb] = 0;
+
+  rc = xqs_openmem(pxr, pData, cb);
+  if (rc != XQSR_OK) {
+    free(pData);
+    return rc;
+  }
+
+  pxr->fOwner = 1;
+  return XQSR_OK;
+}
+
+/*****************************************************************************/
+/* Validate the file's headers & allocate everything lookups will need.
+ * Segments must follow one another in the file, so a corrupt chain
+ * can't loop.
+ */
+
+int     xqs_openmem(XQSREAD* pxr, const char* pData, ULONG cbData)
+{
+  int     rc = XQSR_INVALID;
+  ULONG   ctr;
+  ULONG   offs;
+  ULONG   offsDir = 0;
+  ULONG   prev = 0;
+  XQSEG * pSeg;
+  XQZMOD* pzm;
+
+  memset(pxr, 0, sizeof(XQSREAD));
+  pxr->pData  = (char*)pData;
+  pxr->cbData = cbData;
+  pxr->pFile  = (XQFILE*)pData;
+
+do {
+  if (cbData < sizeof(XQFILE) || pxr->pFile->magic != XQFILE_MAGIC ||
+      pxr->pFile->cbStruct < sizeof(XQFILE) ||
+      pxr->pFile->cbStruct > cbData)
+    break;
+
+  /* Count the segments, then collect them.  If there's a directory,
+   * it has the count & the headers are in it;  otherwise, they're
+   * chained.  A file without any symbols has a firstSeg that points
+   * at the end of the file.
+   */
+  if (pxr->pFile->flags & XQFLAG_SEGDIR) {
+    if (XqsrCheckDir(pxr, &offsDir) != XQSR_OK)
+      break;
+  }
+  else {
+    for (offs = pxr->pFile->firstSeg; offs && offs != cbData;
+         prev = offs, offs = pSeg->offsNext) {
+      if (offs < pxr->pFile->cbStruct || offs <= prev ||
+          offs > cbData - sizeof(XQSEG))
+        break;
+      pSeg = (XQSEG*)(pxr->pData + offs);
+      if (pSeg->magic != XQSEG_MAGIC || pSeg->cbStruct < sizeof(XQSEG))
+        break;
+      pxr->cntSeg++;
+    }
+    if (offs && offs != cbData)
+      break;
+  }
+
+  rc = XQSR_MEMORY;
+  pxr->apSeg = (XQSEG**)malloc((pxr->cntSeg + 1) * sizeof(XQSEG*));
+  if (!pxr->apSeg)
+    break;
+
+  rc = XQSR_INVALID;
+  offs = pxr->pFile->firstSeg;
+  for (ctr = 0; ctr < pxr->cntSeg; ctr++) {
+    if (pxr->pDir)
+      offs = offsDir + ctr * pxr->pDir->cbXQSEG;
+    pSeg = (XQSEG*)(pxr->pData + offs);
+    pxr->apSeg[ctr] = pSeg;
+    if (pSeg->magic != XQSEG_MAGIC || pSeg->cbStruct < sizeof(XQSEG) ||
+        XqsrCheckSeg(pxr, pSeg) != XQSR_OK)
+      break;
+    offs = pSeg->offsNext;
+  }
+  if (ctr < pxr->cntSeg)
+    break;
+
+  /* Every slot in the directory's table must identify a header
+   * for that seg.
+   */
+  if (pxr->pDir) {
+    for (ctr = 0; ctr < pxr->pDir->cntSlot; ctr++) {
+      if (pxr->aSlot[ctr] &&
+          (pxr->aSlot[ctr] > pxr->cntSeg ||
+           pxr->apSeg[pxr->aSlot[ctr] - 1]->seg != pxr->pDir->segBase + ctr))
+        break;
+    }
+    if (ctr < pxr->pDir->cntSlot)
+      break;
+  }
+
+  /* Module names are used in place unless they're compressed. */
+  if (pxr->pFile->offsMod) {
+    offs = pxr->pFile->offsMod;
+    if (offs >= cbData)
+      break;
+
+    if (pxr->pFile->flags & XQFLAG_ZIP_MOD) {
+      pzm = (XQZMOD*)(pxr->pData + offs);
+      if (offs > cbData - sizeof(XQZMOD) ||
+          pzm->cbData > cbData - offs - sizeof(XQZMOD) ||
+          pzm->cbRaw < pzm->cbData)
+        break;
+
+      rc = XQSR_MEMORY;
+      pxr->pMods = (char*)malloc(pzm->cbRaw + 1);
+      if (!pxr->pMods)
+        break;
+
+      rc = XQSR_INVALID;
+      if (pzm->cbData == pzm->cbRaw)
+        memcpy(pxr->pMods, (char*)&pzm[1], pzm->cbRaw);
+      else
+      if (XqzUnpack((char*)&pzm[1], pzm->cbData,
+                    pxr->pMods, pzm->cbRaw) != (long)pzm->cbRaw)
+        break;
+
+      pxr->pMods[pzm->cbRaw] = 0;
+      pxr->offsMods = offs;
+      pxr->cbMods = pzm->cbRaw;
+    }
+    else {
+      pxr->pMods = pxr->pData;
+      pxr->offsMods = 0;
+      pxr->cbMods = cbData;
+    }
+  }
+
+  /* The name index's entries start on a 16-byte boundary after
+   * its bucket table.
+   */
+  if (pxr->pFile->offsHash) {
+    offs = pxr->pFile->offsHash;
+    pxr->pHash = (XQHASH*)(pxr->pData + offs);
+    if (offs > cbData - sizeof(XQHASH) ||
+        pxr->pHash->magic != XQHASH_MAGIC ||
+        pxr->pHash->cbStruct < sizeof(XQHASH) ||
+        pxr->pHash->cbXQHENT < sizeof(XQHENT) || pxr->pHash->bitsBkt > 24)
+      break;
+
+    pxr->offsEnt = (pxr->pHash->cbStruct +
+                    ((1UL << pxr->pHash->bitsBkt) + 1) * sizeof(ULONG) +
+                    0x0F) & ~0x0F;
+    if (pxr->offsEnt > cbData - offs ||
+        pxr->pHash->cntEnt > (cbData - offs - pxr->offsEnt) /
+                             pxr->pHash->cbXQHENT)
+      break;
+  }
+
+  /* Allocate the buffers for a decoded name & an expanded block. */
+  rc = XQSR_MEMORY;
+  pxr->pName = (char*)malloc(XQSR_CBNAME);
+  if (!pxr->pName)
+    break;
+
+  if (pxr->cbBlk) {
+    pxr->pBlk = (char*)malloc(pxr->cbBlk + 1);
+    if (!pxr->pBlk)
+      break;
+  }
+
+  rc = XQSR_OK;
+
+} while (0);
+
+  if (rc != XQSR_OK)
+    xqs_close(pxr);
+
+  return rc;
+}
+
+/*****************************************************************************/
+
+void    xqs_close(XQSREAD* pxr)
+{
+  if (pxr->pMods && pxr->pMods != pxr->pData)
+    free(pxr->pMods);
+  if (pxr->pBlk)
+    free(pxr->pBlk);
+  if (pxr->pName)
+    free(pxr->pName);
+  if (pxr->apSeg)
+    free(pxr->apSeg);
+  if (pxr->fOwner && pxr->pData)
+    free(pxr->pData);
+
+  memset(pxr, 0, sizeof(XQSREAD));
+  return;
+}
+
+/*****************************************************************************/
+/* Confirm that the segment directory, its table, & its headers are within
+ * the file, then return the offset of the first header.
+ */
+
+static int  XqsrCheckDir(XQSREAD* pxr, ULONG* pOffs)
+{
+  ULONG     offs = pxr->pFile->offsDir;
+  ULONG     cbAvail;
+  XQSEGDIR* pDir = (XQSEGDIR*)(pxr->pData + offs);
+
+  if (!offs || offs > pxr->cbData - sizeof(XQSEGDIR))
+    return XQSR_INVALID;
+  cbAvail = pxr->cbData - offs;
+
+  if (pDir->magic != XQSEGDIR_MAGIC || pDir->cbStruct < sizeof(XQSEGDIR) ||
+      pDir->cbStruct > cbAvail || pDir->cbXQSEG < sizeof(XQSEG) ||
+      pDir->cntSlot > (cbAvail - pDir->cbStruct) / sizeof(USHORT))
+    return XQSR_INVALID;
+
+  /* The headers start on a 16-byte boundary after the table. */
+  *pOffs = (pDir->cbStruct + pDir->cntSlot * sizeof(USHORT) + 0x0F) & ~0x0F;
+  if (*pOffs > cbAvail || pDir->cntSeg > (cbAvail - *pOffs) / pDir->cbXQSEG)
+    return XQSR_INVALID;
+
+  *pOffs += offs;
+  pxr->pDir   = pDir;
+  pxr->aSlot  = (USHORT*)((char*)pDir + pDir->cbStruct);
+  pxr->cntSeg = pDir->cntSeg;
+  return XQSR_OK;
+}
+
+/*****************************************************************************/
+/* Confirm that a segment's symbols, blocks, & index are within the file.
+ * For compressed segments, note the largest expanded block.
+ */
+
+static int  XqsrCheckSeg(XQSREAD* pxr, XQSEG* pSeg)
+{
+  ULONG   ctr;
+  ULONG   cntBlk;
+  ULONG   cbAvail;
+  XQZIP * pz;
+  XQZBLK* pb;
+  XQPACK* pp;
+  XQPBLK* pk;
+
+  if (pSeg->cbXQSYM < XQS_SYMSIZE_NOMOD || pSeg->offsSym > pxr->cbData)
+    return XQSR_INVALID;
+  cbAvail = pxr->cbData - pSeg->offsSym;
+
+  if (pSeg->flags & XQFLAG_ZIP) {
+    pz = (XQZIP*)(pxr->pData + pSeg->offsSym);
+    if (cbAvail < sizeof(XQZIP) ||
+        pz->magic != XQZIP_MAGIC || pz->cbStruct < sizeof(XQZIP) ||
+        pz->cbStruct > cbAvail ||
+        pz->cbXQZBLK < sizeof(XQZBLK) || !pz->cntBlkSym ||
+        pz->cntBlk > (cbAvail - pz->cbStruct) / pz->cbXQZBLK)
+      return XQSR_INVALID;
+
+    cntBlk = (pSeg->cntSym + pz->cntBlkSym - 1) / pz->cntBlkSym;
+    if (pSeg->cntSym > cntBlk * pz->cntBlkSym || cntBlk > pz->cntBlk)
+      return XQSR_INVALID;
+
+    /* Each block must hold its symbols & be stored within the file. */
+    pb = (XQZBLK*)((char*)pz + pz->cbStruct);
+    for (ctr = 0; ctr < cntBlk; ctr++) {
+      if (pb->offsData > cbAvail || pb->cbData > cbAvail - pb->offsData ||
+          pb->cbRaw < pb->cbData ||
+          pb->cbRaw / pSeg->cbXQSYM < ((ctr + 1 < cntBlk) ? pz->cntBlkSym :
+                                       pSeg->cntSym - ctr * pz->cntBlkSym))
+        return XQSR_INVALID;
+      if (pb->cbRaw > pxr->cbBlk)
+        pxr->cbBlk = pb->cbRaw;
+      pb = (XQZBLK*)((char*)pb + pz->cbXQZBLK);
+    }
+  }
+  else
+  if (pSeg->flags & XQFLAG_PACK) {
+    pp = (XQPACK*)(pxr->pData + pSeg->offsSym);
+    if (cbAvail < sizeof(XQPACK) ||
+        pp->magic != XQPACK_MAGIC || pp->cbStruct < sizeof(XQPACK) ||
+        pp->cbStruct > cbAvail ||
+        pp->cbXQPBLK < sizeof(XQPBLK) || !pp->cntBlkSym ||
+        pp->cntBlk > (cbAvail - pp->cbStruct) / pp->cbXQPBLK)
+      return XQSR_INVALID;
+
+    cntBlk = (pSeg->cntSym + pp->cntBlkSym - 1) / pp->cntBlkSym;
+    if (pSeg->cntSym > cntBlk * pp->cntBlkSym || cntBlk > pp->cntBlk)
+      return XQSR_INVALID;
+
+    pk = (XQPBLK*)((char*)pp + pp->cbStruct);
+    for (ctr = 0; ctr < cntBlk; ctr++) {
+      if (pk->offsData > cbAvail)
+        return XQSR_INVALID;
+      pk = (XQPBLK*)((char*)pk + pp->cbXQPBLK);
+    }
+  }
+  else {
+    if (pSeg->cntSym > cbAvail / pSeg->cbXQSYM)
+      return XQSR_INVALID;
+  }
+
+  if (pSeg->offsIndex)
+    return XqsrCheckIndex(pxr, pSeg);
+
+  return XQSR_OK;
+}
+
+/*****************************************************************************/
+/* Confirm that an address index & its entries are within the file.
+ * Entries are checked against the segment's symbol count when used.
+ */
+
+static int  XqsrCheckIndex(XQSREAD* pxr, XQSEG* pSeg)
+{
+  ULONG     cbAvail;
+  XQINDEX*  pi = (XQINDEX*)(pxr->pData + pSeg->offsIndex);
+
+  if (pSeg->offsIndex > pxr->cbData - sizeof(XQINDEX))
+    return XQSR_INVALID;
+  cbAvail = pxr->cbData - pSeg->offsIndex;
+
+  if (pi->magic != XQINDEX_MAGIC || pi->cbStruct < sizeof(XQINDEX) ||
+      pi->cbStruct > cbAvail || pi->shift > 31 ||
+      pi->cntPage > (cbAvail - pi->cbStruct) / sizeof(XQIDX))
+    return XQSR_INVALID;
+
+  return XQSR_OK;
+}
+
+/*****************************************************************************/
+/*  Lookups                                                                  */
+/*****************************************************************************/
+
+int     xqs_getseg(XQSREAD* pxr, ULONG ndx, USHORT* pSeg, ULONG* pcntSym)
+{
+  if (ndx >= pxr->cntSeg)
+    return XQSR_NOSEG;
+
+  *pSeg    = pxr->apSeg[ndx]->seg;
+  *pcntSym = pxr->apSeg[ndx]->cntSym;
+  return XQSR_OK;
+}
+
+/*****************************************************************************/
+
+int     xqs_lookup(XQSREAD* pxr, USHORT seg, ULONG offset, XQSRESULT* pRes)
+{
+  int     rc;
+  ULONG   ndx;
+  XQSEG * pSeg;
+
+  memset(pRes, 0, sizeof(XQSRESULT));
+
+  pSeg = XqsrFindSeg(pxr, seg);
+  if (!pSeg)
+    return XQSR_NOSEG;
+
+  rc = XqsrFind(pxr, pSeg, offset, &ndx);
+  if (rc != XQSR_OK)
+    return rc;
+
+  rc = XqsrResult(pxr, pSeg, ndx, pRes);
+  if (rc != XQSR_OK)
+    return rc;
+
+  pRes->displacement = offset - pRes->address;
+  return XQSR_OK;
+}
+
+/*****************************************************************************/
+
+int     xqs_getsym(XQSREAD* pxr, USHORT seg, ULONG ndx, XQSRESULT* pRes)
+{
+  XQSEG * pSeg;
+
+  memset(pRes, 0, sizeof(XQSRESULT));
+
+  pSeg = XqsrFindSeg(pxr, seg);
+  if (!pSeg)
+    return XQSR_NOSEG;
+
+  return XqsrResult(pxr, pSeg, ndx, pRes);
+}
+
+/*****************************************************************************/
+/* Return the next symbol whose name hashes to the same bucket & value
+ * as pszName & whose name matches.  *pNext is one more than the position
+ * of the next entry to check, or zero to start at the bucket's first.
+ */
+
+int     xqs_findname(XQSREAD* pxr, const char* pszName, ULONG* pNext,
+                     XQSRESULT* pRes)
+{
+  int     rc;
+  ULONG   ctr;
+  ULONG   bkt;
+  ULONG   ndx;
+  ULONG   hashLo;
+  ULONG   hashHi;
+  ULONG * aBkt;
+  XQHENT* xqe;
+  XQSEG * pSeg;
+  unsigned long long  hash;
+
+  memset(pRes, 0, sizeof(XQSRESULT));
+  if (!pxr->pHash)
+    return XQSR_NOHASH;
+
+  hash = XqhHash(pszName, strlen(pszName));
+  hashLo = (ULONG)(hash & 0xFFFFFFFFUL);
+  hashHi = (ULONG)(hash >> 32);
+  bkt = pxr->pHash->bitsBkt ? hashHi >> (32 - pxr->pHash->bitsBkt) : 0;
+  aBkt = (ULONG*)((char*)pxr->pHash + pxr->pHash->cbStruct);
+  if (aBkt[bkt] > aBkt[bkt + 1] || aBkt[bkt + 1] > pxr->pHash->cntEnt)
+    return XQSR_INVALID;
+
+  ndx = (*pNext > aBkt[bkt]) ? *pNext - 1 : aBkt[bkt];
+  for (; ndx < aBkt[bkt + 1]; ndx++) {
+    xqe = (XQHENT*)((char*)pxr->pHash + pxr->offsEnt +
+                    ndx * pxr->pHash->cbXQHENT);
+    if (xqe->hashLo != hashLo || xqe->hashHi != hashHi)
+      continue;
+
+    /* The entry has to identify one of the segments found by
+     * xqs_openmem(), which have already been validated.
+     */
+    for (ctr = 0; ctr < pxr->cntSeg; ctr++) {
+      if (pxr->apSeg[ctr] == (XQSEG*)(pxr->pData + xqe->offsSeg))
+        break;
+    }
+    if (ctr == pxr->cntSeg)
+      return XQSR_INVALID;
+    pSeg = pxr->apSeg[ctr];
+
+    rc = XqsrResult(pxr, pSeg, xqe->ndx, pRes);
+    if (rc != XQSR_OK)
+      return (rc == XQSR_NOSYM) ? XQSR_INVALID : rc;
+
+    if (!strcmp(pRes->pszName, pszName)) {
+      *pNext = ndx + 2;
+      return XQSR_OK;
+    }
+  }
+
+  memset(pRes, 0, sizeof(XQSRESULT));
+  *pNext = ndx + 1;
+  return XQSR_NOSYM;
+}
+
+/*****************************************************************************/
+/* Resolve a list of offsets in one pass over the segment's symbols.  If
+ * an offset is lower than the one before it, the pass starts over, so
+ * unsorted offsets give correct (if slower) results.  Compressed blocks
+ * are only expanded if an offset falls within them;  packed blocks are
+ * decoded at most once unless the pass starts over.
+ */
+
+int     xqs_merge(XQSREAD* pxr, USHORT seg, const ULONG* aOffs, ULONG cnt,
+                  ULONG* aNdx)
+{
+  int     rc;
+  int     fMod;
+  ULONG   ctr;
+  ULONG   ndx = 0;
+  ULONG   blk = 0;
+  ULONG   cur = XQSR_NONE;
+  ULONG   cntBlk;
+  ULONG   cntBlkSym;
+  ULONG   cntInBlk = 0;
+  ULONG   cbBlk;
+  const char *  pBlks;
+  const char *  ptr = 0;
+  const char *  pNext;
+  const char *  pEnd = pxr->pData + pxr->cbData;
+  XQSEG * pSeg;
+  XQZIP * pz;
+  XQPACK* pp = 0;
+  XQPBLK* pk;
+  XQPSYM  xqp;
+  XQPSYM  next;
+
+  pSeg = XqsrFindSeg(pxr, seg);
+  if (!pSeg)
+    return XQSR_NOSEG;
+
+  fMod = (pSeg->cbXQSYM >= XQS_SYMSIZE_MOD);
+
+  /* For an array of XQSYM, ndx is the nbr of symbols at or below
+   * the current offset.
+   */
+  if (!(pSeg->flags & (XQFLAG_ZIP | XQFLAG_PACK))) {
+    pBlks = pxr->pData + pSeg->offsSym;
+    for (ctr = 0; ctr < cnt; ctr++) {
+      if (ctr && aOffs[ctr] < aOffs[ctr - 1])
+        ndx = 0;
+      while (ndx < pSeg->cntSym &&
+             ((XQSYM*)(pBlks + ndx * pSeg->cbXQSYM))->address <= aOffs[ctr])
+        ndx++;
+      aNdx[ctr] = ndx ? ndx - 1 : XQSR_NONE;
+    }
+    return XQSR_OK;
+  }
+
+  /* Otherwise, blk is the nbr of blocks that start at or below the
+   * current offset & ndx is the nbr of symbols within the current block
+   * (cur) that are.
+   */
+  if (pSeg->flags & XQFLAG_ZIP) {
+    pz = (XQZIP*)(pxr->pData + pSeg->offsSym);
+    pBlks = (char*)pz + pz->cbStruct;
+    cbBlk = pz->cbXQZBLK;
+    cntBlkSym = pz->cntBlkSym;
+  }
+  else {
+    pp = (XQPACK*)(pxr->pData + pSeg->offsSym);
+    pBlks = (char*)pp + pp->cbStruct;
+    cbBlk = pp->cbXQPBLK;
+    cntBlkSym = pp->cntBlkSym;
+  }
+  cntBlk = (pSeg->cntSym + cntBlkSym - 1) / cntBlkSym;
+
+  for (ctr = 0; ctr < cnt; ctr++) {
+    if (ctr && aOffs[ctr] < aOffs[ctr - 1]) {
+      blk = 0;
+      cur = XQSR_NONE;
+    }
+
+    while (blk < cntBlk && *(ULONG*)(pBlks + blk * cbBlk) <= aOffs[ctr])
+      blk++;
+    if (!blk) {
+      aNdx[ctr] = XQSR_NONE;
+      continue;
+    }
+
+    /* Start on a new block. */
+    if (cur != blk - 1) {
+      cur = blk - 1;
+      ndx = 0;
+      cntInBlk = pSeg->cntSym - cur * cntBlkSym;
+      if (cntInBlk > cntBlkSym)
+        cntInBlk = cntBlkSym;
+
+      if (pSeg->flags & XQFLAG_ZIP) {
+        rc = XqsrExpand(pxr, pSeg, cur);
+        if (rc != XQSR_OK)
+          return rc;
+      }
+      else {
+        pk = (XQPBLK*)(pBlks + cur * cbBlk);
+        memset(&xqp, 0, sizeof(xqp));
+        xqp.address  = pk->address;
+        xqp.offsName = pk->offsName;
+        ptr = (char*)pp + pk->offsData;
+      }
+    }
+
+    /* Advance within the block.  A packed symbol is only consumed
+     * once it's known to be at or below the offset.
+     */
+    if (pSeg->flags & XQFLAG_ZIP) {
+      while (ndx < cntInBlk &&
+             ((XQSYM*)(pxr->pBlk + ndx * pSeg->cbXQSYM))->address <=
+             aOffs[ctr])
+        ndx++;
+    }
+    else {
+      while (ndx < cntInBlk) {
+        next = xqp;
+        pNext = ptr;
+        if (!XqpGetSym(&pNext, pEnd, &next, fMod))
+          return XQSR_INVALID;
+        if (next.address > aOffs[ctr])
+          break;
+        xqp = next;
+        ptr = pNext;
+        ndx++;
+      }
+    }
+
+    if (!ndx)
+      return XQSR_INVALID;
+    aNdx[ctr] = cur * cntBlkSym + ndx - 1;
+  }
+
+  return XQSR_OK;
+}
+
+/*****************************************************************************/
+/* Use the directory's table if there is one (its slots were validated
+ * by xqs_openmem()).  Otherwise, files have a handful of segments, so a
+ * linear search is fine.
+ */
+
+static XQSEG *  XqsrFindSeg(XQSREAD* pxr, USHORT seg)
+{
+  ULONG   ctr;
+
+  if (pxr->pDir) {
+    ctr = (ULONG)seg - pxr->pDir->segBase;
+    if (seg < pxr->pDir->segBase || ctr >= pxr->pDir->cntSlot ||
+        !pxr->aSlot[ctr])
+      return 0;
+    return pxr->apSeg[pxr->aSlot[ctr] - 1];
+  }
+
+  for (ctr = 0; ctr < pxr->cntSeg; ctr++) {
+    if (pxr->apSeg[ctr]->seg == seg)
+      return pxr->apSeg[ctr];
+  }
+
+  return 0;
+}
+
+/*****************************************************************************/
+/* Return the position of the first entry in [lo, hi) whose address is
+ * above offset, or hi if there isn't one.  XQSYM, XQZBLK, & XQPBLK all
+ * start with their address, so this works for any of them.
+ */
+
+static ULONG    XqsrUpper(const char* pArr, ULONG cbEntry,
+                          ULONG lo, ULONG hi, ULONG offset)
+{
+  ULONG   mid;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (*(ULONG*)(pArr + mid * cbEntry) <= offset)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
+/*****************************************************************************/
+/* Find the index of the last symbol at or below offset. */
+
+static int  XqsrFind(XQSREAD* pxr, XQSEG* pSeg, ULONG offset, ULONG* pNdx)
+{
+  int     rc;
+  ULONG   lo;
+  ULONG   hi;
+  ULONG   page;
+  ULONG   cntBlk;
+  ULONG   blk;
+  ULONG   ctr;
+  const char *  ptr;
+  XQZIP * pz;
+  XQPACK* pp;
+  XQPBLK* pk;
+  XQIDX * pIdx;
+  XQINDEX*  pi;
+  XQPSYM  xqp;
+
+  if (!pSeg->cntSym)
+    return XQSR_NOSYM;
+
+  /* For a compressed segment, find the block, expand it, then search
+   * the block's symbols.
+   */
+  if (pSeg->flags & XQFLAG_ZIP) {
+    pz = (XQZIP*)(pxr->pData + pSeg->offsSym);
+    cntBlk = (pSeg->cntSym + pz->cntBlkSym - 1) / pz->cntBlkSym;
+    blk = XqsrUpper((char*)pz + pz->cbStruct, pz->cbXQZBLK,
+                    0, cntBlk, offset);
+    if (!blk)
+      return XQSR_NOSYM;
+    blk--;
+
+    rc = XqsrExpand(pxr, pSeg, blk);
+    if (rc != XQSR_OK)
+      return rc;
+
+    hi = pSeg->cntSym - blk * pz->cntBlkSym;
+    if (hi > pz->cntBlkSym)
+      hi = pz->cntBlkSym;
+    lo = XqsrUpper(pxr->pBlk, pSeg->cbXQSYM, 0, hi, offset);
+    if (!lo)
+      return XQSR_INVALID;
+
+    *pNdx = blk * pz->cntBlkSym + lo - 1;
+    return XQSR_OK;
+  }
+
+  /* For a packed segment, find the block, then decode its symbols
+   * until one is above offset.
+   */
+  if (pSeg->flags & XQFLAG_PACK) {
+    pp = (XQPACK*)(pxr->pData + pSeg->offsSym);
+    cntBlk = (pSeg->cntSym + pp->cntBlkSym - 1) / pp->cntBlkSym;
+    blk = XqsrUpper((char*)pp + pp->cbStruct, pp->cbXQPBLK,
+                    0, cntBlk, offset);
+    if (!blk)
+      return XQSR_NOSYM;
+    blk--;
+
+    pk = (XQPBLK*)((char*)pp + pp->cbStruct + blk * pp->cbXQPBLK);
+    memset(&xqp, 0, sizeof(xqp));
+    xqp.address  = pk->address;
+    xqp.offsName = pk->offsName;
+    ptr = (char*)pp + pk->offsData;
+
+    hi = pSeg->cntSym - blk * pp->cntBlkSym;
+    if (hi > pp->cntBlkSym)
+      hi = pp->cntBlkSym;
+    for (ctr = 0; ctr < hi; ctr++) {
+      if (!XqpGetSym(&ptr, pxr->pData + pxr->cbData, &xqp,
+                     pSeg->cbXQSYM >= XQS_SYMSIZE_MOD))
+        return XQSR_INVALID;
+      if (xqp.address > offset)
+        break;
+    }
+    if (!ctr)
+      return XQSR_INVALID;
+
+    *pNdx = blk * pp->cntBlkSym + ctr - 1;
+    return XQSR_OK;
+  }
+
+  /* For an array of XQSYM, use the index (if any) to limit
+   * the search to the symbols that cover offset's page.
+   */
+  lo = 0;
+  hi = pSeg->cntSym;
+  if (pSeg->offsIndex) {
+    pi = (XQINDEX*)(pxr->pData + pSeg->offsIndex);
+    page = offset >> pi->shift;
+    if (page < pi->base)
+      return XQSR_NOSYM;
+
+    if (page - pi->base >= pi->cntPage)
+      lo = hi - 1;
+    else {
+      pIdx = (XQIDX*)((char*)pi + pi->cbStruct) + (page - pi->base);
+      if (pIdx->first > pIdx->last || pIdx->last >= hi)
+        return XQSR_INVALID;
+      lo = pIdx->first;
+      hi = pIdx->last + 1;
+    }
+  }
+
+  ctr = XqsrUpper(pxr->pData + pSeg->offsSym, pSeg->cbXQSYM,
+                  lo, hi, offset);
+  if (ctr == lo) {
+    if (lo)
+      return XQSR_INVALID;
+    return XQSR_NOSYM;
+  }
+
+  *pNdx = ctr - 1;
+  return XQSR_OK;
+}
+
+/*****************************************************************************/
+/* Expand a compressed block into pBlk unless it's already there. */
+
+static int  XqsrExpand(XQSREAD* pxr, XQSEG* pSeg, ULONG ndxBlk)
+{
+  XQZIP * pz;
+  XQZBLK* pb;
+
+  if (pxr->pBlkSeg == pSeg && pxr->ndxBlk == ndxBlk)
+    return XQSR_OK;
+
+  pz = (XQZIP*)(pxr->pData + pSeg->offsSym);
+  pb = (XQZBLK*)((char*)pz + pz->cbStruct + ndxBlk * pz->cbXQZBLK);
+
+  pxr->pBlkSeg = 0;
+  if (pb->cbData == pb->cbRaw)
+    memcpy(pxr->pBlk, (char*)pz + pb->offsData, pb->cbRaw);
+  else
+  if (XqzUnpack((char*)pz + pb->offsData, pb->cbData,
+                pxr->pBlk, pb->cbRaw) != (long)pb->cbRaw)
+    return XQSR_INVALID;
+
+  pxr->pBlk[pb->cbRaw] = 0;
+  pxr->pBlkSeg  = pSeg;
+  pxr->ndxBlk   = ndxBlk;
+  pxr->cbBlkRaw = pb->cbRaw;
+  return XQSR_OK;
+}
+
+/*****************************************************************************/
+/* Get the ndx'th symbol in a segment & identify the data its offsName
+ * is relative to.
+ */
+
+static int  XqsrGetSym(XQSREAD* pxr, XQSEG* pSeg, ULONG ndx,
+                       XQSYM* pSym, const char** ppNames, ULONG* pcbNames)
+{
+  int     rc;
+  ULONG   cbSym;
+  ULONG   ctr;
+  const char *  ptr;
+  XQZIP * pz;
+  XQPACK* pp;
+  XQPBLK* pk;
+  XQPSYM  xqp;
+
+  memset(pSym, 0, sizeof(XQSYM));
+  if (ndx >= pSeg->cntSym)
+    return XQSR_NOSYM;
+
+  cbSym = (pSeg->cbXQSYM < sizeof(XQSYM)) ? pSeg->cbXQSYM : sizeof(XQSYM);
+  *ppNames  = pxr->pData;
+  *pcbNames = pxr->cbData;
+
+  if (pSeg->flags & XQFLAG_ZIP) {
+    pz = (XQZIP*)(pxr->pData + pSeg->offsSym);
+    rc = XqsrExpand(pxr, pSeg, ndx / pz->cntBlkSym);
+    if (rc != XQSR_OK)
+      return rc;
+
+    memcpy(pSym, pxr->pBlk + (ndx % pz->cntBlkSym) * pSeg->cbXQSYM, cbSym);
+    *ppNames  = pxr->pBlk;
+    *pcbNames = pxr->cbBlkRaw;
+  }
+  else
+  if (pSeg->flags & XQFLAG_PACK) {
+    pp = (XQPACK*)(pxr->pData + pSeg->offsSym);
+    pk = (XQPBLK*)((char*)pp + pp->cbStruct +
+                   (ndx / pp->cntBlkSym) * pp->cbXQPBLK);
+    memset(&xqp, 0, sizeof(xqp));
+    xqp.address  = pk->address;
+    xqp.offsName = pk->offsName;
+    ptr = (char*)pp + pk->offsData;
+    for (ctr = ndx % pp->cntBlkSym + 1; ctr; ctr--) {
+      if (!XqpGetSym(&ptr, pxr->pData + pxr->cbData, &xqp,
+                     pSeg->cbXQSYM >= XQS_SYMSIZE_MOD))
+        return XQSR_INVALID;
+    }
+
+    pSym->address  = xqp.address;
+    pSym->offsName = xqp.offsName;
+    pSym->cbName   = (USHORT)xqp.cbName;
+    pSym->cbMod    = (USHORT)xqp.cbMod;
+    pSym->offsMod  = xqp.offsMod;
+  }
+  else
+    memcpy(pSym, pxr->pData + pSeg->offsSym + ndx * pSeg->cbXQSYM, cbSym);
+
+  return XQSR_OK;
+}
+
+/*****************************************************************************/
+/* Fill in a result for the ndx'th symbol in a segment, decoding its name
+ * if it's front-coded.
+ */
+
+static int  XqsrResult(XQSREAD* pxr, XQSEG* pSeg, ULONG ndx,
+                       XQSRESULT* pRes)
+{
+  int     rc;
+  ULONG   cbNames;
+  ULONG   offs;
+  const char *  pNames;
+  XQSYM   xqs;
+
+  rc = XqsrGetSym(pxr, pSeg, ndx, &xqs, &pNames, &cbNames);
+  if (rc != XQSR_OK)
+    return rc;
+
+  if (!xqs.offsName || xqs.offsName >= cbNames)
+    return XQSR_INVALID;
+
+  if (pSeg->flags & XQFLAG_FRONT) {
+    offs = xqs.offsName & ~0x0F;
+    if (XqfGetName(pNames + offs, cbNames - offs, xqs.offsName & 0x0F,
+                   pxr->pName, XQSR_CBNAME) <= 0)
+      return XQSR_INVALID;
+    pRes->pszName = pxr->pName;
+  }
+  else {
+    pRes->pszName = XqsrString(pNames, cbNames, xqs.offsName);
+    if (!pRes->pszName)
+      return XQSR_INVALID;
+  }
+
+  /* A symbol without module info has a zero offsMod. */
+  if (pSeg->cbXQSYM >= XQS_SYMSIZE_MOD && pxr->pMods && xqs.offsMod) {
+    if (xqs.offsMod < pxr->offsMods)
+      return XQSR_INVALID;
+    pRes->pszMod = XqsrString(pxr->pMods, pxr->cbMods,
+                              xqs.offsMod - pxr->offsMods);
+    if (!pRes->pszMod)
+      return XQSR_INVALID;
+  }
+
+  pRes->seg     = pSeg->seg;
+  pRes->address = xqs.address;
+  pRes->ndx     = ndx;
+  return XQSR_OK;
+}
+
+/*****************************************************************************/
+/* Return a pointer to the string at offs if it's null-terminated
+ * within [pBase, pBase + cbBase).
+ */
+
+static const char * XqsrString(const char* pBase, ULONG cbBase, ULONG offs)
+{
+  if (offs >= cbBase || !memchr(pBase + offs, 0, cbBase - offs))
+    return 0;
+
+  return pBase + offs;
+}
+
+/*****************************************************************************/
+
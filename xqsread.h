@@ -0,0 +1,119 @@
+/*****************************************************************************/
+/*  xqsread.h                                                                */
+/*****************************************************************************/
+
+#ifndef _xqsread_h
+#define _xqsread_h
+
+/*****************************************************************************/
+/*  - a reader for .xqs files that can be used by any program                */
+/*  - os2.h & xqs.h must be included first                                   */
+/*  - all headers are validated when the file is opened;  every offset       */
+/*    used by a lookup is checked against the size of the file               */
+/*  - after xqs_open(), lookups never allocate memory;  names are returned   */
+/*    in place unless they have to be decoded, so a handle must only be      */
+/*    used by one thread at a time                                           */
+/*****************************************************************************/
+
+/* return codes */
+#define XQSR_OK         0
+#define XQSR_IO         1       /* the file couldn't be opened or read */
+#define XQSR_MEMORY     2       /* memory couldn't be allocated */
+#define XQSR_INVALID    3       /* the file or a structure in it is invalid */
+#define XQSR_NOSEG      4       /* the file has no symbols for the segment */
+#define XQSR_NOSYM      5       /* no symbol is at or below the offset */
+#define XQSR_NOHASH     6       /* the file has no name index */
+
+/* The index xqs_merge() returns for an offset that has no symbol. */
+#define XQSR_NONE       0xFFFFFFFFUL
+
+/* The longest name that can be decoded (XQSYM.cbName is a USHORT). */
+#define XQSR_CBNAME     0x10000
+
+/* An open file.  The fields are for the reader's use only. */
+typedef struct _XQSREAD {
+    char *      pData;
+    ULONG       cbData;
+    int         fOwner;
+    XQFILE *    pFile;
+    ULONG       cntSeg;
+    XQSEG **    apSeg;
+    char *      pMods;
+    ULONG       offsMods;
+    ULONG       cbMods;
+    char *      pBlk;
+    ULONG       cbBlk;
+    XQSEG *     pBlkSeg;
+    ULONG       ndxBlk;
+    ULONG       cbBlkRaw;
+    char *      pName;
+    XQHASH *    pHash;
+    ULONG       offsEnt;
+    XQSEGDIR *  pDir;
+    USHORT *    aSlot;
+} XQSREAD;
+
+/* A symbol.  pszName & pszMod remain valid until the next call that uses
+ * the same handle.  pszMod is null if the file has no module info.
+ */
+typedef struct _XQSRESULT {
+    USHORT      seg;
+    ULONG       address;
+    ULONG       displacement;
+    ULONG       ndx;
+    const char* pszName;
+    const char* pszMod;
+} XQSRESULT;
+
+/* Read an entire .xqs file into memory & validate it. */
+int     xqs_open(XQSREAD* pxr, const char* pszFile);
+
+/* Validate an .xqs file that's already in memory;  it's used in place
+ * and must not be freed until xqs_close() is called.
+ */
+int     xqs_openmem(XQSREAD* pxr, const char* pData, ULONG cbData);
+
+/* Free everything allocated by xqs_open() or xqs_openmem(). */
+void    xqs_close(XQSREAD* pxr);
+
+/* Get the seg nbr & symbol count of the ndx'th segment in the file. */
+int     xqs_getseg(XQSREAD* pxr, ULONG ndx, USHORT* pSeg, ULONG* pcntSym);
+
+/* Find the symbol nearest to & not above seg:offset. */
+int     xqs_lookup(XQSREAD* pxr, USHORT seg, ULONG offset, XQSRESULT* pRes);
+
+/* Get the ndx'th symbol (in address order) in a segment. */
+int     xqs_getsym(XQSREAD* pxr, USHORT seg, ULONG ndx, XQSRESULT* pRes);
+
+/* Find the symbols named pszName using the file's name index.  *pNext
+ * must be zero for the first call;  each call returns the next match,
+ * until XQSR_NOSYM is returned.
+ */
+int     xqs_findname(XQSREAD* pxr, const char* pszName, ULONG* pNext,
+                     XQSRESULT* pRes);
+
+/* Find the symbol indexes for cnt offsets in a segment in one pass;
+ * the offsets should be sorted.  Use xqs_getsym() to get the symbols.
+ */
+int     xqs_merge(XQSREAD* pxr, USHORT seg, const ULONG* aOffs, ULONG cnt,
+                  ULONG* aNdx);
+
+/* Find the symbol nearest to & not above seg:offset in an open file,
+ * reading only what's needed (see xqsseek.c).  It never allocates memory,
+ * so it can be used in exception handlers.  pBuf holds everything that
+ * isn't a header;  pszName & pszMod point into it.  4k is usually enough,
+ * but a compressed segment needs room for one block both expanded &
+ * compressed, so 64k is safer.  If module names are compressed & won't
+ * fit, pszMod is null.  Returns XQSR_MEMORY if pBuf is too small.
+ * hFile's file pointer is moved & isn't restored, so the handle should be
+ * the caller's own, not one another thread may be reading or writing.
+ */
+int     xqs_seeklookup(HFILE hFile, USHORT seg, ULONG offset,
+                       char* pBuf, ULONG cbBuf, XQSRESULT* pRes);
+
+/*****************************************************************************/
+
+#endif /* _xqsread_h */
+
+/*****************************************************************************/
+
@@ -0,0 +1,794 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is MapXQS.
+ *
+ * The Initial Developer of the Original Code is
+ * Richard L. Walsh
+ * Portions created by the Initial Developer are Copyright (C) 2010-2011
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ *
+ * ***** END LICENSE BLOCK ***** */
+/*****************************************************************************/
+/*  xqsseek.c - v1.04a
+ *
+ *  xqs_seeklookup() resolves a single address by reading only the parts
+ *  of an .xqs file it needs.  It's meant for exception handlers & other
+ *  places where xqs_open() isn't an option because the heap may be
+ *  corrupt or the file is too large to read.  It never allocates memory:
+ *  headers are read into local variables, everything else goes into a
+ *  buffer supplied by the caller, and the names it returns are in that
+ *  buffer.  The only APIs it calls are DosQueryFileInfo(), DosSetFilePtr(),
+ *  & DosRead(), plus the decoders in xqszip.c.  Because it seeks on the
+ *  caller's handle & leaves the file pointer wherever the last read put
+ *  it, the handle must be private to the caller:  it can't be shared with
+ *  another thread, and code that was reading it must reposition it.
+ *
+ *  If the file has a segment directory, the segment's header is located
+ *  through the directory's table;  otherwise, it follows the XQSEG chain
+ *  from XQFILE.firstSeg to the segment.  It then does a binary search
+ *  that reads only the address of each entry it probes.  Once the range
+ *  that's left is small, it's read all at once & searched in
+ *  memory.  An address index limits the search to one page.  For
+ *  compressed segments, the XQZBLK array is searched this way, then one
+ *  block is read & expanded;  for packed segments, the XQPBLK array is
+ *  searched, then one block's symbols are read & decoded.  A lookup
+ *  typically takes 6 to 12 small reads.
+ *
+ *  Every offset is checked against the size of the file, and the segment
+ *  chain must move forward through the file, so a corrupt file produces
+ *  XQSR_INVALID rather than a bad read or a loop.
+ *
+ *  'xqsload -s file.xqs' compares its results to xqs_lookup()'s.
+ *
+ */
+/*****************************************************************************/
+
+#include <string.h>
+
+#define INCL_DOS
+#include <os2.h>
+
+#include "xqs.h"
+#include "xqszip.h"
+#include "xqsread.h"
+
+/*****************************************************************************/
+
+/* The most that's read at once while searching an array;  a range this
+ * size or smaller is read whole rather than probed.
+ */
+#define CB_BULK         1024
+
+/* The initial read for a front-coded block of names;  it's quadrupled
+ * until the name is found or the buffer is full.
+ */
+#define CB_FRONT        512
+
+/* The file & the unused part of the caller's buffer. */
+typedef struct _XQSSEEK {
+    HFILE       hFile;
+    ULONG       cbFile;
+    char *      pBuf;
+    ULONG       cbBuf;
+} XQSSEEK;
+
+/*****************************************************************************/
+
+static int      XqskRead(XQSSEEK* pxk, ULONG offs, void* pDst, ULONG cb);
+static int      XqskFindSeg(XQSSEEK* pxk, XQFILE* pxqf, USHORT seg,
+                            XQSEG* pSeg);
+static int      XqskDirSeg(XQSSEEK* pxk, XQFILE* pxqf, USHORT seg,
+                           XQSEG* pSeg);
+static int      XqskUpper(XQSSEEK* pxk, ULONG offsArr, ULONG cbEntry,
+                          ULONG lo, ULONG hi, ULONG offset, ULONG* pNdx);
+static int      XqskFindSym(XQSSEEK* pxk, XQSEG* pSeg, ULONG offset,
+                            XQSYM* pSym, ULONG* pNdx);
+static int      XqskFindZip(XQSSEEK* pxk, XQSEG* pSeg, ULONG offset,
+                            XQSYM* pSym, ULONG* pNdx,
+                            const char** ppNames, ULONG* pcbNames);
+static int      XqskFindPack(XQSSEEK* pxk, XQSEG* pSeg, ULONG offset,
+                             XQSYM* pSym, ULONG* pNdx);
+static int      XqskName(XQSSEEK* pxk, XQSEG* pSeg, XQSYM* pSym,
+                         const char* pNames, ULONG cbNames,
+                         const char** ppszName);
+static int      XqskMod(XQSSEEK* pxk, XQFILE* pxqf, XQSYM* pSym,
+                        const char** ppszMod);
+static char *   XqskTake(XQSSEEK* pxk, ULONG cb);
+
+/*****************************************************************************/
+/*  Lookup                                                                   */
+/*****************************************************************************/
+
+int     xqs_seeklookup(HFILE hFile, USHORT seg, ULONG offset,
+                       char* pBuf, ULONG cbBuf, XQSRESULT* pRes)
+{
+  int         rc;
+  ULONG       ndx;
+  ULONG       cbNames = 0;
+  const char *  pNames = 0;
+  XQSSEEK     xk;
+  XQFILE      xqf;
+  XQSEG       xqseg;
+  XQSYM       xqs;
+  FILESTATUS3 fs3;
+
+  memset(pRes, 0, sizeof(XQSRESULT));
+
+  if (DosQueryFileInfo(hFile, FIL_STANDARD, &fs3, sizeof(fs3)))
+    return XQSR_IO;
+
+  xk.hFile  = hFile;
+  xk.cbFile = fs3.cbFile;
+  xk.pBuf   = pBuf;
+  xk.cbBuf  = cbBuf;
+
+  memset(&xqf, 0, sizeof(xqf));
+  rc = XqskRead(&xk, 0, &xqf, sizeof(xqf));
+  if (rc != XQSR_OK)
+    return rc;
+  if (xqf.magic != XQFILE_MAGIC || xqf.cbStruct < sizeof(XQFILE) ||
+      xqf.cbStruct > xk.cbFile)
+    return XQSR_INVALID;
+
+  rc = XqskFindSeg(&xk, &xqf, seg, &xqseg);
+  if (rc != XQSR_OK)
+    return rc;
+
+  if (!xqseg.cntSym)
+    return XQSR_NOSYM;
+
+  if (xqseg.flags & XQFLAG_ZIP)
+    rc = XqskFindZip(&xk, &xqseg, offset, &xqs, &ndx, &pNames, &cbNames);
+  else
+  if (xqseg.flags & XQFLAG_PACK)
+    rc = XqskFindPack(&xk, &xqseg, offset, &xqs, &ndx);
+  else
+    rc = XqskFindSym(&xk, &xqseg, offset, &xqs, &ndx);
+  if (rc != XQSR_OK)
+    return rc;
+
+  rc = XqskName(&xk, &xqseg, &xqs, pNames, cbNames, &pRes->pszName);
+  if (rc != XQSR_OK)
+    return rc;
+
+  /* A symbol without module info has a zero offsMod. */
+  if (xqseg.cbXQSYM >= XQS_SYMSIZE_MOD && xqf.offsMod && xqs.offsMod) {
+    rc = XqskMod(&xk, &xqf, &xqs, &pRes->pszMod);
+    if (rc != XQSR_OK) {
+      pRes->pszName = 0;
+      return rc;
+    }
+  }
+
+  pRes->seg          = xqseg.seg;
+  pRes->address      = xqs.address;
+  pRes->displacement = offset - xqs.address;
+  pRes->ndx          = ndx;
+  return XQSR_OK;
+}
+
+/*****************************************************************************/
+/* Read cb bytes at offs.  Reading past the end of the file means an
+ * offset in the file is wrong.
+ */
+
+static int  XqskRead(XQSSEEK* pxk, ULONG offs, void* pDst, ULONG cb)
+{
+  ULONG   ul;
+
+  if (offs > pxk->cbFile || cb > pxk->cbFile - offs)
+    return XQSR_INVALID;
+
+  if (DosSetFilePtr(pxk->hFile, (LONG)offs, FILE_BEGIN, &ul) ||
+      ul != offs ||
+      DosRead(pxk->hFile, pDst, cb, &ul))
+    return XQSR_IO;
+
+  if (ul != cb)
+    return XQSR_INVALID;
+
+  return XQSR_OK;
+}
+
+/*****************************************************************************/
+/* Find seg using the directory or by following the segment chain, then
+ * confirm that its symbols are within the file.  Only the fields needed
+ * to reach the symbols are checked here;  the rest are checked as
+ * they're read.
+ */
+
+static int  XqskFindSeg(XQSSEEK* pxk, XQFILE* pxqf, USHORT seg,
+                        XQSEG* pSeg)
+{
+  int     rc;
+  ULONG   offs;
+  ULONG   prev = 0;
+
+  if (pxqf->flags & XQFLAG_SEGDIR) {
+    rc = XqskDirSeg(pxk, pxqf, seg, pSeg);
+    if (rc != XQSR_OK)
+      return rc;
+  }
+  else {
+    for (offs = pxqf->firstSeg; offs && offs != pxk->cbFile;
+         prev = offs, offs = pSeg->offsNext) {
+      if (offs < pxqf->cbStruct || offs <= prev ||
+          offs > pxk->cbFile - sizeof(XQSEG))
+        return XQSR_INVALID;
+
+      rc = XqskRead(pxk, offs, pSeg, sizeof(XQSEG));
+      if (rc != XQSR_OK)
+        return rc;
+      if (pSeg->magic != XQSEG_MAGIC || pSeg->cbStruct < sizeof(XQSEG))
+        return XQSR_INVALID;
+
+      if (pSeg->seg == seg)
+        break;
+    }
+    if (!offs || offs == pxk->cbFile)
+      return XQSR_NOSEG;
+  }
+
+  if (pSeg->cbXQSYM < XQS_SYMSIZE_NOMOD || pSeg->offsSym > pxk->cbFile)
+    return XQSR_INVALID;
+
+  if (!(pSeg->flags & (XQFLAG_ZIP | XQFLAG_PACK)) &&
+      pSeg->cntSym > (pxk->cbFile - pSeg->offsSym) / pSeg->cbXQSYM)
+    return XQSR_INVALID;
+
+  return XQSR_OK;
+}
+
+/*****************************************************************************/
+/* Read the directory, then seg's slot in its table, then the header the
+ * slot identifies:  three reads regardless of the number of segments.
+ */
+
+static int  XqskDirSeg(XQSSEEK* pxk, XQFILE* pxqf, USHORT seg,
+                       XQSEG* pSeg)
+{
+  int       rc;
+  ULONG     offs = pxqf->offsDir;
+  ULONG     cbAvail;
+  ULONG     cbTbl;
+  USHORT    slot;
+  XQSEGDIR  xqd;
+
+  if (!offs || offs > pxk->cbFile - sizeof(XQSEGDIR))
+    return XQSR_INVALID;
+  cbAvail = pxk->cbFile - offs;
+
+  rc = XqskRead(pxk, offs, &xqd, sizeof(XQSEGDIR));
+  if (rc != XQSR_OK)
+    return rc;
+  if (xqd.magic != XQSEGDIR_MAGIC || xqd.cbStruct < sizeof(XQSEGDIR) ||
+      xqd.cbStruct > cbAvail || xqd.cbXQSEG < sizeof(XQSEG) ||
+      xqd.cntSlot > (cbAvail - xqd.cbStruct) / sizeof(USHORT))
+    return XQSR_INVALID;
+
+  if (seg < xqd.segBase || (ULONG)(seg - xqd.segBase) >= xqd.cntSlot)
+    return XQSR_NOSEG;
+
+  rc = XqskRead(pxk, offs + xqd.cbStruct +
+                (seg - xqd.segBase) * sizeof(USHORT), &slot, sizeof(USHORT));
+  if (rc != XQSR_OK)
+    return rc;
+  if (!slot)
+    return XQSR_NOSEG;
+  if (slot > xqd.cntSeg)
+    return XQSR_INVALID;
+
+  /* The headers start on a 16-byte boundary after the table. */
+  cbTbl = (xqd.cbStruct + xqd.cntSlot * sizeof(USHORT) + 0x0F) & ~0x0F;
+  if (cbTbl > cbAvail || slot > (cbAvail - cbTbl) / xqd.cbXQSEG)
+    return XQSR_INVALID;
+  offs += cbTbl + (slot - 1) * xqd.cbXQSEG;
+
+  rc = XqskRead(pxk, offs, pSeg, sizeof(XQSEG));
+  if (rc != XQSR_OK)
+    return rc;
+  if (pSeg->magic != XQSEG_MAGIC || pSeg->cbStruct < sizeof(XQSEG) ||
+      pSeg->seg != seg)
+    return XQSR_INVALID;
+
+  return XQSR_OK;
+}
+
+/*****************************************************************************/
+/* Return the position of the first entry in [lo, hi) whose address is
+ * above offset, or hi if there isn't one.  The entries start at offsArr
+ * in the file & each begins with its address.  The array must already
+ * be known to be within the file.
+ */
+
+static int  XqskUpper(XQSSEEK* pxk, ULONG offsArr, ULONG cbEntry,
+                      ULONG lo, ULONG hi, ULONG offset, ULONG* pNdx)
+{
+  int     rc;
+  ULONG   mid;
+  ULONG   cntBulk;
+  ULONG   base;
+  ULONG   address;
+
+  cntBulk = ((pxk->cbBuf < CB_BULK) ? pxk->cbBuf : CB_BULK) / cbEntry;
+
+  while (hi - lo > cntBulk) {
+    mid = lo + (hi - lo) / 2;
+    rc = XqskRead(pxk, offsArr + mid * cbEntry, &address, sizeof(ULONG));
+    if (rc != XQSR_OK)
+      return rc;
+    if (address <= offset)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  /* The rest fits in the buffer, which isn't used yet. */
+  if (lo < hi) {
+    rc = XqskRead(pxk, offsArr + lo * cbEntry, pxk->pBuf, (hi - lo) * cbEntry);
+    if (rc != XQSR_OK)
+      return rc;
+
+    base = lo;
+    while (lo < hi) {
+      mid = lo + (hi - lo) / 2;
+      if (*(ULONG*)(pxk->pBuf + (mid - base) * cbEntry) <= offset)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  }
+
+  *pNdx = lo;
+  return XQSR_OK;
+}
+
+/*****************************************************************************/
+/* Find the last symbol at or below offset in an array of XQSYM, using
+ * the address index (if any) to limit the search to offset's page.
+ */
+
+static int  XqskFindSym(XQSSEEK* pxk, XQSEG* pSeg, ULONG offset,
+                        XQSYM* pSym, ULONG* pNdx)
+{
+  int     rc;
+  ULONG   lo = 0;
+  ULONG   hi = pSeg->cntSym;
+  ULONG   ndx;
+  ULONG   page;
+  ULONG   cbSym;
+  XQINDEX xqi;
+  XQIDX   xqx;
+
+  if (pSeg->offsIndex) {
+    rc = XqskRead(pxk, pSeg->offsIndex, &xqi, sizeof(xqi));
+    if (rc != XQSR_OK)
+      return rc;
+    if (xqi.magic != XQINDEX_MAGIC || xqi.cbStruct < sizeof(XQINDEX) ||
+        xqi.shift > 31)
+      return XQSR_INVALID;
+
+    page = offset >> xqi.shift;
+    if (page < xqi.base)
+      return XQSR_NOSYM;
+
+    if (page - xqi.base >= xqi.cntPage)
+      lo = hi - 1;
+    else {
+      if (xqi.cbStruct > pxk->cbFile - pSeg->offsIndex ||
+          page - xqi.base > (pxk->cbFile - pSeg->offsIndex - xqi.cbStruct) /
+                            sizeof(XQIDX))
+        return XQSR_INVALID;
+
+      rc = XqskRead(pxk, pSeg->offsIndex + xqi.cbStruct +
+                    (page - xqi.base) * sizeof(XQIDX), &xqx, sizeof(xqx));
+      if (rc != XQSR_OK)
+        return rc;
+      if (xqx.first > xqx.last || xqx.last >= hi)
+        return XQSR_INVALID;
+      lo = xqx.first;
+      hi = xqx.last + 1;
+    }
+  }
+
+  rc = XqskUpper(pxk, pSeg->offsSym, pSeg->cbXQSYM, lo, hi, offset, &ndx);
+  if (rc != XQSR_OK)
+    return rc;
+
+  if (ndx == lo)
+    return (lo ? XQSR_INVALID : XQSR_NOSYM);
+  ndx--;
+
+  cbSym = (pSeg->cbXQSYM < sizeof(XQSYM)) ? pSeg->cbXQSYM : sizeof(XQSYM);
+  memset(pSym, 0, sizeof(XQSYM));
+  rc = XqskRead(pxk, pSeg->offsSym + ndx * pSeg->cbXQSYM, pSym, cbSym);
+  if (rc != XQSR_OK)
+    return rc;
+
+  *pNdx = ndx;
+  return XQSR_OK;
+}
+
+/*****************************************************************************/
+/* Find the block containing offset in a compressed segment, expand it
+ * into the buffer, then search it.  The block stays in the buffer since
+ * the symbol's offsName is relative to it.
+ */
+
+static int  XqskFindZip(XQSSEEK* pxk, XQSEG* pSeg, ULONG offset,
+                        XQSYM* pSym, ULONG* pNdx,
+                        const char** ppNames, ULONG* pcbNames)
+{
+  int     rc;
+  ULONG   cbAvail = pxk->cbFile - pSeg->offsSym;
+  ULONG   cntBlk;
+  ULONG   cntInBlk;
+  ULONG   blk;
+  ULONG   lo;
+  ULONG   hi;
+  ULONG   mid;
+  ULONG   cbSym;
+  char *  pRaw;
+  XQZIP   xqz;
+  XQZBLK  xqb;
+
+  rc = XqskRead(pxk, pSeg->offsSym, &xqz, sizeof(xqz));
+  if (rc != XQSR_OK)
+    return rc;
+  if (xqz.magic != XQZIP_MAGIC || xqz.cbStruct < sizeof(XQZIP) ||
+      xqz.cbStruct > cbAvail ||
+      xqz.cbXQZBLK < sizeof(XQZBLK) || !xqz.cntBlkSym ||
+      xqz.cntBlk > (cbAvail - xqz.cbStruct) / xqz.cbXQZBLK)
+    return XQSR_INVALID;
+
+  cntBlk = (pSeg->cntSym + xqz.cntBlkSym - 1) / xqz.cntBlkSym;
+  if (pSeg->cntSym > cntBlk * xqz.cntBlkSym || cntBlk > xqz.cntBlk)
+    return XQSR_INVALID;
+
+  rc = XqskUpper(pxk, pSeg->offsSym + xqz.cbStruct, xqz.cbXQZBLK,
+                 0, cntBlk, offset, &blk);
+  if (rc != XQSR_OK)
+    return rc;
+  if (!blk)
+    return XQSR_NOSYM;
+  blk--;
+
+  rc = XqskRead(pxk, pSeg->offsSym + xqz.cbStruct + blk * xqz.cbXQZBLK,
+                &xqb, sizeof(xqb));
+  if (rc != XQSR_OK)
+    return rc;
+
+  cntInBlk = pSeg->cntSym - blk * xqz.cntBlkSym;
+  if (cntInBlk > xqz.cntBlkSym)
+    cntInBlk = xqz.cntBlkSym;
+  if (xqb.offsData > cbAvail || xqb.cbData > cbAvail - xqb.offsData ||
+      xqb.cbRaw < xqb.cbData || xqb.cbRaw / pSeg->cbXQSYM < cntInBlk)
+    return XQSR_INVALID;
+
+  /* The compressed data is read into the end of the buffer &
+   * expanded into the beginning.
+   */
+  if (xqb.cbRaw > pxk->cbBuf ||
+      (xqb.cbData != xqb.cbRaw && xqb.cbData > pxk->cbBuf - xqb.cbRaw))
+    return XQSR_MEMORY;
+
+  if (xqb.cbData == xqb.cbRaw)
+    rc = XqskRead(pxk, pSeg->offsSym + xqb.offsData, pxk->pBuf, xqb.cbRaw);
+  else {
+    rc = XqskRead(pxk, pSeg->offsSym + xqb.offsData,
+                  pxk->pBuf + pxk->cbBuf - xqb.cbData, xqb.cbData);
+    if (rc == XQSR_OK &&
+        XqzUnpack(pxk->pBuf + pxk->cbBuf - xqb.cbData, xqb.cbData,
+                  pxk->pBuf, xqb.cbRaw) != (long)xqb.cbRaw)
+      rc = XQSR_INVALID;
+  }
+  if (rc != XQSR_OK)
+    return rc;
+
+  pRaw = XqskTake(pxk, xqb.cbRaw);
+
+  lo = 0;
+  hi = cntInBlk;
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (*(ULONG*)(pRaw + mid * pSeg->cbXQSYM) <= offset)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (!lo)
+    return XQSR_INVALID;
+
+  cbSym = (pSeg->cbXQSYM < sizeof(XQSYM)) ? pSeg->cbXQSYM : sizeof(XQSYM);
+  memset(pSym, 0, sizeof(XQSYM));
+  memcpy(pSym, pRaw + (lo - 1) * pSeg->cbXQSYM, cbSym);
+
+  *pNdx     = blk * xqz.cntBlkSym + lo - 1;
+  *ppNames  = pRaw;
+  *pcbNames = xqb.cbRaw;
+  return XQSR_OK;
+}
+
+/*****************************************************************************/
+/* Find the block containing offset in a packed segment, read as much of
+ * it as its symbols could need, then decode them until one is above
+ * offset.
+ */
+
+static int  XqskFindPack(XQSSEEK* pxk, XQSEG* pSeg, ULONG offset,
+                         XQSYM* pSym, ULONG* pNdx)
+{
+  int     rc;
+  ULONG   cbAvail = pxk->cbFile - pSeg->offsSym;
+  ULONG   cntBlk;
+  ULONG   cntInBlk;
+  ULONG   blk;
+  ULONG   ctr;
+  ULONG   cb;
+  ULONG   cbMax;
+  const char *  ptr;
+  XQPACK  xqp;
+  XQPBLK  xqk;
+  XQPSYM  sym;
+  XQPSYM  prev;
+
+  rc = XqskRead(pxk, pSeg->offsSym, &xqp, sizeof(xqp));
+  if (rc != XQSR_OK)
+    return rc;
+  if (xqp.magic != XQPACK_MAGIC || xqp.cbStruct < sizeof(XQPACK) ||
+      xqp.cbStruct > cbAvail ||
+      xqp.cbXQPBLK < sizeof(XQPBLK) || !xqp.cntBlkSym ||
+      xqp.cntBlk > (cbAvail - xqp.cbStruct) / xqp.cbXQPBLK)
+    return XQSR_INVALID;
+
+  cntBlk = (pSeg->cntSym + xqp.cntBlkSym - 1) / xqp.cntBlkSym;
+  if (pSeg->cntSym > cntBlk * xqp.cntBlkSym || cntBlk > xqp.cntBlk)
+    return XQSR_INVALID;
+
+  rc = XqskUpper(pxk, pSeg->offsSym + xqp.cbStruct, xqp.cbXQPBLK,
+                 0, cntBlk, offset, &blk);
+  if (rc != XQSR_OK)
+    return rc;
+  if (!blk)
+    return XQSR_NOSYM;
+  blk--;
+
+  rc = XqskRead(pxk, pSeg->offsSym + xqp.cbStruct + blk * xqp.cbXQPBLK,
+                &xqk, sizeof(xqk));
+  if (rc != XQSR_OK)
+    return rc;
+  if (xqk.offsData > cbAvail)
+    return XQSR_INVALID;
+
+  cntInBlk = pSeg->cntSym - blk * xqp.cntBlkSym;
+  if (cntInBlk > xqp.cntBlkSym)
+    cntInBlk = xqp.cntBlkSym;
+
+  /* Symbols are never longer than XQP_MAXSYM, so that's the most the
+   * block can need.  If the buffer is smaller, decoding may fail.
+   */
+  cbMax = cbAvail - xqk.offsData;
+  if (cntInBlk < cbMax / XQP_MAXSYM)
+    cbMax = cntInBlk * XQP_MAXSYM;
+  cb = (cbMax < pxk->cbBuf) ? cbMax : pxk->cbBuf;
+
+  rc = XqskRead(pxk, pSeg->offsSym + xqk.offsData, pxk->pBuf, cb);
+  if (rc != XQSR_OK)
+    return rc;
+
+  memset(&sym, 0, sizeof(sym));
+  sym.address  = xqk.address;
+  sym.offsName = xqk.offsName;
+  ptr = pxk->pBuf;
+  for (ctr = 0; ctr < cntInBlk; ctr++) {
+    prev = sym;
+    if (!XqpGetSym(&ptr, pxk->pBuf + cb, &sym,
+                   pSeg->cbXQSYM >= XQS_SYMSIZE_MOD))
+      return (cb < cbMax ? XQSR_MEMORY : XQSR_INVALID);
+    if (sym.address > offset)
+      break;
+  }
+  if (!ctr)
+    return XQSR_INVALID;
+  if (ctr == cntInBlk)
+    prev = sym;
+
+  memset(pSym, 0, sizeof(XQSYM));
+  pSym->address  = prev.address;
+  pSym->offsName = prev.offsName;
+  pSym->cbName   = (USHORT)prev.cbName;
+  pSym->cbMod    = (USHORT)prev.cbMod;
+  pSym->offsMod  = prev.offsMod;
+
+  *pNdx = blk * xqp.cntBlkSym + ctr - 1;
+  return XQSR_OK;
+}
+
+/*****************************************************************************/
+/* Put the symbol's name in the buffer.  pNames is the expanded block for
+ * compressed segments;  otherwise, it's null & the name is in the file.
+ * Front-coded names are decoded into the start of the buffer from a
+ * block of names read into the end of it.
+ */
+
+static int  XqskName(XQSSEEK* pxk, XQSEG* pSeg, XQSYM* pSym,
+                     const char* pNames, ULONG cbNames,
+                     const char** ppszName)
+{
+  int     rc;
+  long    cbOut;
+  ULONG   offs;
+  ULONG   cb;
+  ULONG   cbAvail;
+  ULONG   cbRoom;
+  char *  ptr;
+
+  if (!pNames)
+    cbNames = pxk->cbFile;
+  if (!pSym->offsName || pSym->offsName >= cbNames)
+    return XQSR_INVALID;
+
+  if (pSeg->flags & XQFLAG_FRONT) {
+    offs = pSym->offsName & ~0x0F;
+
+    if (pNames) {
+      cbOut = XqfGetName(pNames + offs, cbNames - offs, pSym->offsName & 0x0F,
+                         pxk->pBuf, pxk->cbBuf);
+      if (cbOut <= 0)
+        return (pxk->cbBuf < pSym->cbName ? XQSR_MEMORY : XQSR_INVALID);
+    }
+    else {
+      if (pxk->cbBuf <= pSym->cbName)
+        return XQSR_MEMORY;
+      cbAvail = pxk->cbFile - offs;
+      cbRoom  = pxk->cbBuf - pSym->cbName;
+
+      for (cb = CB_FRONT; ; cb *= 4) {
+        if (cb > cbAvail)
+          cb = cbAvail;
+        if (cb > cbRoom)
+          cb = cbRoom;
+
+        ptr = pxk->pBuf + pxk->cbBuf - cb;
+        rc = XqskRead(pxk, offs, ptr, cb);
+        if (rc != XQSR_OK)
+          return rc;
+
+        cbOut = XqfGetName(ptr, cb, pSym->offsName & 0x0F,
+                           pxk->pBuf, pxk->cbBuf - cb);
+        if (cbOut > 0)
+          break;
+        if (cb == cbAvail)
+          return XQSR_INVALID;
+        if (cb == cbRoom)
+          return XQSR_MEMORY;
+      }
+    }
+
+    *ppszName = XqskTake(pxk, (ULONG)cbOut);
+    return XQSR_OK;
+  }
+
+  if (pNames) {
+    if (!memchr(pNames + pSym->offsName, 0, cbNames - pSym->offsName))
+      return XQSR_INVALID;
+    *ppszName = pNames + pSym->offsName;
+    return XQSR_OK;
+  }
+
+  /* cbName includes the null, which must be there. */
+  cb = pSym->cbName;
+  if (!cb)
+    return XQSR_INVALID;
+  if (cb > pxk->cbBuf)
+    return XQSR_MEMORY;
+
+  rc = XqskRead(pxk, pSym->offsName, pxk->pBuf, cb);
+  if (rc != XQSR_OK)
+    return rc;
+  if (!memchr(pxk->pBuf, 0, cb))
+    return XQSR_INVALID;
+
+  *ppszName = XqskTake(pxk, cb);
+  return XQSR_OK;
+}
+
+/*****************************************************************************/
+/* Put the symbol's module name in the buffer.  Compressed module names
+ * have to be expanded all at once;  if they won't fit, the symbol is
+ * returned without its module.
+ */
+
+static int  XqskMod(XQSSEEK* pxk, XQFILE* pxqf, XQSYM* pSym,
+                    const char** ppszMod)
+{
+  int     rc;
+  ULONG   offs;
+  ULONG   cb;
+  XQZMOD  xqm;
+
+  if (pxqf->flags & XQFLAG_ZIP_MOD) {
+    rc = XqskRead(pxk, pxqf->offsMod, &xqm, sizeof(xqm));
+    if (rc != XQSR_OK)
+      return rc;
+    if (xqm.cbData > pxk->cbFile - pxqf->offsMod - sizeof(XQZMOD) ||
+        xqm.cbRaw < xqm.cbData)
+      return XQSR_INVALID;
+
+    if (pSym->offsMod < pxqf->offsMod)
+      return XQSR_INVALID;
+    offs = pSym->offsMod - pxqf->offsMod;
+    if (offs >= xqm.cbRaw)
+      return XQSR_INVALID;
+
+    if (xqm.cbRaw > pxk->cbBuf ||
+        (xqm.cbData != xqm.cbRaw && xqm.cbData > pxk->cbBuf - xqm.cbRaw))
+      return XQSR_OK;
+
+    if (xqm.cbData == xqm.cbRaw)
+      rc = XqskRead(pxk, pxqf->offsMod + sizeof(XQZMOD), pxk->pBuf, xqm.cbRaw);
+    else {
+      rc = XqskRead(pxk, pxqf->offsMod + sizeof(XQZMOD),
+                    pxk->pBuf + pxk->cbBuf - xqm.cbData, xqm.cbData);
+      if (rc == XQSR_OK &&
+          XqzUnpack(pxk->pBuf + pxk->cbBuf - xqm.cbData, xqm.cbData,
+                    pxk->pBuf, xqm.cbRaw) != (long)xqm.cbRaw)
+        rc = XQSR_INVALID;
+    }
+    if (rc != XQSR_OK)
+      return rc;
+
+    if (!memchr(pxk->pBuf + offs, 0, xqm.cbRaw - offs))
+      return XQSR_INVALID;
+
+    *ppszMod = XqskTake(pxk, xqm.cbRaw) + offs;
+    return XQSR_OK;
+  }
+
+  /* cbMod includes the null, which must be there. */
+  cb = pSym->cbMod;
+  if (!cb)
+    return XQSR_INVALID;
+  if (cb > pxk->cbBuf)
+    return XQSR_MEMORY;
+
+  rc = XqskRead(pxk, pSym->offsMod, pxk->pBuf, cb);
+  if (rc != XQSR_OK)
+    return rc;
+  if (!memchr(pxk->pBuf, 0, cb))
+    return XQSR_INVALID;
+
+  *ppszMod = XqskTake(pxk, cb);
+  return XQSR_OK;
+}
+
+/*****************************************************************************/
+/* Keep the first cb bytes of the buffer;  the caller has already
+ * confirmed they're available.
+ */
+
+static char *   XqskTake(XQSSEEK* pxk, ULONG cb)
+{
+  char *  ptr = pxk->pBuf;
+
+  pxk->pBuf  += cb;
+  pxk->cbBuf -= cb;
+  return ptr;
+}
+
+/*****************************************************************************/
+
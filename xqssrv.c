@@ -0,0 +1,745 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is MapXQS.
+ *
+ * The Initial Developer of the Original Code is
+ * Richard L. Walsh
+ * Portions created by the Initial Developer are Copyright (C) 2010-2011
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ *
+ * ***** END LICENSE BLOCK ***** */
+/*****************************************************************************/
+/*  xqssrv.c - v1.04a
+ *
+ *  XQSSrv is a symbol server.  It keeps recently used .xqs files in memory
+ *  & resolves addresses & names sent to it through a named pipe (see
+ *  xqssrv.h for the protocol), so programs that symbolize lots of traps
+ *  needn't read an entire .xqs file for each one.  xqsload.c is a client
+ *  that measures its throughput & latency.
+ *
+ *  Each thread services one instance of the pipe.  Files are cached by
+ *  their fully-qualified name;  if a file's size or timestamp changes,
+ *  it's read again.  When the cache is full, the least recently used file
+ *  that isn't in use is discarded.  An XQSREAD can only be used by one
+ *  thread at a time, so each file has its own mutex.
+ *
+ *  Note:  OS/2 has no mmap(), so files are read into memory by xqs_open().
+ *  This is done without the cache locked:  a placeholder is listed while
+ *  the file is read, & threads that want the same file wait on its mutex,
+ *  so requests for other files aren't held up.
+ *
+ */
+/*****************************************************************************/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <process.h>
+
+#define INCL_DOS
+#define INCL_DOSERRORS
+#include <os2.h>
+
+#include "xqs.h"
+#include "xqsread.h"
+#include "xqssrv.h"
+
+/*****************************************************************************/
+
+#define CNT_THREADS       4
+#define MAX_THREADS       32
+#define CNT_FILES         16
+#define CB_FILES          64          /* in MB */
+#define CB_PIPEBUF        0x8000
+#define CB_THREADSTACK    0x40000
+
+/* A cached file.  Files that are in use (cntUsers) are never discarded;
+ * if one becomes stale while in use, it's removed from the list & freed
+ * by the last user.  While a file is being read, fLoading is set & the
+ * thread reading it owns hmtx;  if the read fails, rcLoad says why.
+ */
+
+typedef struct _xqscache {
+    struct _xqscache *  pPrev;
+    struct _xqscache *  pNext;
+    ULONG   cntUsers;
+    int     fStale;
+    int     fLoading;
+    int     rcLoad;
+    HMTX    hmtx;
+    FDATE   fdate;
+    FTIME   ftime;
+    ULONG   cbFile;
+    XQSREAD xr;
+    char    szPath[CCHMAXPATH];
+} XQSCACHE;
+
+/* one pipe instance & the thread that services it */
+
+typedef struct _pipework {
+    int     tid;
+    int     ndx;
+    HPIPE   hp;
+    char *  pReq;
+    char *  pRep;
+} PIPEWORK;
+
+/*****************************************************************************/
+
+int     ParseArgs(int argc, char* argv[]);
+void    PipeThread(void* pv);
+ULONG   HandleRequest(char* pReq, ULONG cbReq, char* pRep);
+ULONG   PutItem(char* pRep, ULONG cbRep, ULONG ndx, int rc,
+                XQSRESULT* pRes);
+XQSCACHE* GetFile(char* pszFile, USHORT* pStatus);
+void    ReleaseFile(XQSCACHE* pc);
+void    TrimCache(void);
+void    LinkFile(XQSCACHE* pc);
+void    UnlinkFile(XQSCACHE* pc);
+void    FreeFile(XQSCACHE* pc);
+
+/*****************************************************************************/
+
+int     cntThreads = CNT_THREADS;
+int     fVerbose = 0;
+ULONG   cntFilesMax = CNT_FILES;
+ULONG   cbFilesMax = CB_FILES * 1024 * 1024;
+char    szPipe[CCHMAXPATH] = XQSRV_PIPE;
+
+/* the cache, from most to least recently used;  hmtxCache protects
+ * the list, the counts, & every entry's cntUsers, fStale, & fLoading
+ */
+HMTX        hmtxCache = 0;
+XQSCACHE *  pMRU = 0;
+XQSCACHE *  pLRU = 0;
+ULONG       cntFiles = 0;
+ULONG       cbFiles = 0;
+
+PIPEWORK    aWork[MAX_THREADS];
+
+char *  pszHelp =
+        "\n"
+        " XQSSrv v1.04a - (C)2010-2011  R L Walsh\n"
+        " Resolves addresses & names using .xqs files kept in memory.\n"
+        "\n"
+        " Usage:  xqssrv [-options]\n"
+        "   -p  specify the pipe name           (default: " XQSRV_PIPE ")\n"
+        "   -t  nbr of threads (pipe instances) (default: -t4  max: -t32)\n"
+        "   -n  max nbr of files to keep        (default: -n16)\n"
+        "   -m  max size of files to keep in MB (default: -m64)\n"
+        "   -v  report files as they're read & discarded\n"
+        "\n";
+
+/*****************************************************************************/
+
+int     main(int argc, char* argv[])
+{
+  int     ctr;
+  int     cnt = 0;
+
+  if (!ParseArgs(argc, argv))
+    return 1;
+
+  if (DosCreateMutexSem(0, &hmtxCache, 0, FALSE)) {
+    fprintf(stderr, "unable to create cache semaphore\n");
+    return 1;
+  }
+
+  printf(" XQSSrv v1.04a - listening on '%s' using %d threads\n",
+         szPipe, cntThreads);
+  fflush(stdout);
+
+  for (ctr = 0; ctr < cntThreads; ctr++) {
+    aWork[ctr].ndx = ctr;
+    aWork[ctr].tid = _beginthread(PipeThread, 0, CB_THREADSTACK, &aWork[ctr]);
+    if (aWork[ctr].tid == -1) {
+      fprintf(stderr, "unable to start thread %d\n", ctr);
+      aWork[ctr].tid = 0;
+    }
+    else
+      cnt++;
+  }
+
+  /* The threads only end if their pipe fails. */
+  for (ctr = 0; ctr < cntThreads; ctr++) {
+    if (aWork[ctr].tid) {
+      TID   tid = aWork[ctr].tid;
+      DosWaitThread(&tid, DCWW_WAIT);
+    }
+  }
+
+  DosCloseMutexSem(hmtxCache);
+
+  return (cnt ? 0 : 1);
+}
+
+/*****************************************************************************/
+
+int     ParseArgs(int argc, char* argv[])
+{
+  int     ctr;
+  int     needPipe = 0;
+  char *  ptr;
+
+  for (ctr = 1; ctr < argc; ctr++) {
+
+    if (*argv[ctr] == '-' || *argv[ctr] == '/') {
+      ptr = argv[ctr];
+
+      while (*(++ptr)) {
+        switch(*ptr) {
+          case 'p':
+          case 'P':
+            needPipe = 1;
+            break;
+
+          /* the value immediately follows the option */
+          case 't':
+          case 'T':
+            cntThreads = strtoul(ptr + 1, &ptr, 10);
+            ptr--;
+            if (cntThreads < 1 || cntThreads > MAX_THREADS) {
+              fprintf(stderr, "the nbr of threads must be 1 - %d\n",
+                      MAX_THREADS);
+              return 0;
+            }
+            break;
+
+          case 'n':
+          case 'N':
+            cntFilesMax = strtoul(ptr + 1, &ptr, 10);
+            ptr--;
+            if (!cntFilesMax)
+              cntFilesMax = 1;
+            break;
+
+          case 'm':
+          case 'M':
+            cbFilesMax = strtoul(ptr + 1, &ptr, 10) * 1024 * 1024;
+            ptr--;
+            break;
+
+          case 'v':
+          case 'V':
+            fVerbose = 1;
+            break;
+
+          case 'h':
+          case 'H':
+          case '?':
+            fprintf(stderr, pszHelp);
+            return 0;
+
+          default:
+            fprintf(stderr, "Invalid option '%c' ignored - continuing...\n", *ptr);
+            break;
+
+        } /* switch */
+      } /* while */
+
+      continue;
+    } /* if */
+
+    if (needPipe) {
+      strncpy(szPipe, argv[ctr], sizeof(szPipe) - 1);
+      needPipe = 0;
+    } else {
+      fprintf(stderr, "Extra argument '%s'\n", argv[ctr]);
+      return 0;
+    }
+  } /* for */
+
+  if (needPipe) {
+    fprintf(stderr, "Missing argument for pipe name\n");
+    return 0;
+  }
+
+  if (strnicmp(szPipe, "\\PIPE\\", 6)) {
+    fprintf(stderr, "pipe names must start with '\\PIPE\\'\n");
+    return 0;
+  }
+
+  return 1;
+}
+
+/*****************************************************************************/
+/*  Requests                                                                 */
+/*****************************************************************************/
+/* Create an instance of the pipe, then answer requests from each client
+ * that connects to it until the client closes it.
+ */
+
+void    PipeThread(void* pv)
+{
+  APIRET    rc;
+  ULONG     cb;
+  ULONG     cbRep;
+  PIPEWORK* pw = (PIPEWORK*)pv;
+
+do {
+  pw->pReq = (char*)malloc(XQSRV_CBMSG);
+  pw->pRep = (char*)malloc(XQSRV_CBMSG);
+  if (!pw->pReq || !pw->pRep) {
+    fprintf(stderr, "thread %d: malloc for pipe buffers failed\n", pw->ndx);
+    break;
+  }
+
+  rc = DosCreateNPipe(szPipe, &pw->hp, NP_ACCESS_DUPLEX | NP_NOINHERIT,
+                      NP_WAIT | NP_TYPE_MESSAGE | NP_READMODE_MESSAGE |
+                      cntThreads, CB_PIPEBUF, CB_PIPEBUF, 0);
+  if (rc) {
+    fprintf(stderr, "thread %d: DosCreateNPipe failed - rc= %ld\n",
+            pw->ndx, rc);
+    break;
+  }
+
+  while (1) {
+    rc = DosConnectNPipe(pw->hp);
+    if (rc) {
+      fprintf(stderr, "thread %d: DosConnectNPipe failed - rc= %ld\n",
+              pw->ndx, rc);
+      break;
+    }
+
+    /* A read error (e.g. a message that's too large) or a zero-byte
+     * read (the client closed the pipe) ends the connection.
+     */
+    while (!DosRead(pw->hp, pw->pReq, XQSRV_CBMSG, &cb) && cb) {
+      cbRep = HandleRequest(pw->pReq, cb, pw->pRep);
+      if (DosWrite(pw->hp, pw->pRep, cbRep, &cb) || cb != cbRep)
+        break;
+    }
+
+    DosDisConnectNPipe(pw->hp);
+  }
+
+  DosClose(pw->hp);
+
+} while (0);
+
+  if (pw->pReq)
+    free(pw->pReq);
+  if (pw->pRep)
+    free(pw->pRep);
+
+  return;
+}
+
+/*****************************************************************************/
+/* Validate a request, then answer as many of its items as will fit in
+ * the reply.  Returns the size of the reply.
+ */
+
+ULONG   HandleRequest(char* pReq, ULONG cbReq, char* pRep)
+{
+  int       rc;
+  ULONG     ctr;
+  ULONG     next;
+  ULONG     cbRep = sizeof(XQSRVHDR);
+  ULONG     cbSave;
+  ULONG     cbLast;
+  ULONG     cntSave;
+  ULONG     cbNew;
+  ULONG     cntItem = 0;
+  char *    pItems;
+  char *    ptr;
+  XQSRVHDR* pIn = (XQSRVHDR*)pReq;
+  XQSRVHDR* pOut = (XQSRVHDR*)pRep;
+  XQSRVADDR*  pa;
+  XQSCACHE* pc;
+  XQSRESULT res;
+
+  memset(pOut, 0, sizeof(XQSRVHDR));
+  pOut->magic  = XQSRV_MAGIC;
+  pOut->status = XQSRV_BADREQ;
+
+do {
+  if (cbReq < sizeof(XQSRVHDR) || pIn->magic != XQSRV_MAGIC ||
+      pIn->cbMsg != cbReq ||
+      (pIn->type != XQSRV_ADDR && pIn->type != XQSRV_NAME))
+    break;
+  pOut->type = pIn->type;
+
+  /* The file's name is followed by padding, then the items. */
+  ptr = (char*)memchr(&pReq[sizeof(XQSRVHDR)], 0, cbReq - sizeof(XQSRVHDR));
+  if (!ptr)
+    break;
+  pItems = pReq + ((ptr + 1 - pReq + 3) & ~3);
+  if (pItems > pReq + cbReq)
+    break;
+
+  if (pIn->type == XQSRV_ADDR) {
+    if (pIn->cntItem > (pReq + cbReq - pItems) / sizeof(XQSRVADDR))
+      break;
+  }
+  else {
+    for (ptr = pItems, ctr = 0; ctr < pIn->cntItem; ctr++) {
+      ptr = (char*)memchr(ptr, 0, pReq + cbReq - ptr);
+      if (!ptr)
+        break;
+      ptr++;
+    }
+    if (ctr < pIn->cntItem)
+      break;
+  }
+
+  pc = GetFile(&pReq[sizeof(XQSRVHDR)], &pOut->status);
+  if (!pc)
+    break;
+
+  DosRequestMutexSem(pc->hmtx, SEM_INDEFINITE_WAIT);
+
+  pa = (XQSRVADDR*)pItems;
+  ptr = pItems;
+  for (ctr = 0; ctr < pIn->cntItem; ctr++) {
+
+    if (pIn->type == XQSRV_ADDR) {
+      rc = xqs_lookup(&pc->xr, pa[ctr].seg, pa[ctr].offset, &res);
+      cbNew = PutItem(pRep, cbRep, ctr, rc, &res);
+      if (!cbNew)
+        break;
+      cbRep = cbNew;
+      cntItem++;
+    }
+    else {
+      /* A name produces an item for each match, or one item that says
+       * why there weren't any.  An error after a match gets its own item
+       * so the client can tell the list is incomplete.  If they don't
+       * all fit, none are kept.
+       */
+      cbSave = cbRep;
+      cntSave = cntItem;
+      cbLast = cbRep;
+      cbNew = cbRep;
+      next = 0;
+      do {
+        rc = xqs_findname(&pc->xr, ptr, &next, &res);
+        if (rc == XQSR_NOSYM && cntItem > cntSave)
+          break;
+        cbNew = PutItem(pRep, cbRep, ctr, rc, &res);
+        if (!cbNew)
+          break;
+        cbLast = cbRep;
+        cbRep = cbNew;
+        cntItem++;
+      } while (rc == XQSR_OK);
+
+      /* If the first name has more matches than a reply can hold,
+       * resending it wouldn't help, so keep what fit & flag the last one.
+       */
+      if (!cbNew && !ctr && cntItem) {
+        ((XQSRVITEM*)(pRep + cbLast))->status = XQSRV_MORE;
+        ctr++;
+        break;
+      }
+
+      if (!cbNew) {
+        cbRep = cbSave;
+        cntItem = cntSave;
+        break;
+      }
+      ptr = strchr(ptr, 0) + 1;
+    }
+  }
+  pOut->cntDone = (USHORT)ctr;
+
+  DosReleaseMutexSem(pc->hmtx);
+  ReleaseFile(pc);
+
+  pOut->status = XQSR_OK;
+
+} while (0);
+
+  pOut->cntItem = (USHORT)cntItem;
+  pOut->cbMsg = cbRep;
+  return cbRep;
+}
+
+/*****************************************************************************/
+/* Add an item to the reply.  Returns the new size of the reply, or zero
+ * if the item won't fit.
+ */
+
+ULONG   PutItem(char* pRep, ULONG cbRep, ULONG ndx, int rc,
+                XQSRESULT* pRes)
+{
+  ULONG       cb;
+  ULONG       cbName = 0;
+  ULONG       cbMod = 0;
+  XQSRVITEM * pi;
+
+  if (pRes->pszName) {
+    cbName = strlen(pRes->pszName) + 1;
+    if (cbName > XQSRV_MAXNAME)
+      cbName = XQSRV_MAXNAME;
+  }
+  if (pRes->pszMod) {
+    cbMod = strlen(pRes->pszMod) + 1;
+    if (cbMod > XQSRV_MAXNAME)
+      cbMod = XQSRV_MAXNAME;
+  }
+
+  cb = (sizeof(XQSRVITEM) + cbName + cbMod + 3) & ~3;
+  if (cb > XQSRV_CBMSG - cbRep)
+    return 0;
+
+  pi = (XQSRVITEM*)(pRep + cbRep);
+  memset(pi, 0, cb);
+  pi->ndx          = (USHORT)ndx;
+  pi->status       = (USHORT)rc;
+  pi->seg          = pRes->seg;
+  pi->address      = pRes->address;
+  pi->displacement = pRes->displacement;
+  pi->cbName       = (USHORT)cbName;
+  pi->cbMod        = (USHORT)cbMod;
+
+  /* the buffer was zeroed, so a truncated name is still terminated */
+  if (cbName)
+    memcpy(&pi[1], pRes->pszName, cbName - 1);
+  if (cbMod)
+    memcpy((char*)&pi[1] + cbName, pRes->pszMod, cbMod - 1);
+
+  return cbRep + cb;
+}
+
+/*****************************************************************************/
+/*  Cache                                                                    */
+/*****************************************************************************/
+/* Return a file from the cache, reading it if it isn't there or if it's
+ * changed.  The caller must call ReleaseFile() when done with it.
+ */
+
+XQSCACHE* GetFile(char* pszFile, USHORT* pStatus)
+{
+  int         rc;
+  XQSCACHE *  pc;
+  FILESTATUS3 fs;
+  char        szPath[CCHMAXPATH];
+
+  if (DosQueryPathInfo(pszFile, FIL_QUERYFULLNAME, szPath, sizeof(szPath)) ||
+      DosQueryPathInfo(szPath, FIL_STANDARD, &fs, sizeof(fs))) {
+    *pStatus = XQSR_IO;
+    return 0;
+  }
+
+  DosRequestMutexSem(hmtxCache, SEM_INDEFINITE_WAIT);
+
+  for (pc = pMRU; pc; pc = pc->pNext) {
+    if (!stricmp(pc->szPath, szPath))
+      break;
+  }
+
+  if (pc && (pc->cbFile != fs.cbFile ||
+             memcmp(&pc->fdate, &fs.fdateLastWrite, sizeof(FDATE)) ||
+             memcmp(&pc->ftime, &fs.ftimeLastWrite, sizeof(FTIME)))) {
+    UnlinkFile(pc);
+    pc->fStale = 1;
+    if (!pc->cntUsers)
+      FreeFile(pc);
+    pc = 0;
+  }
+
+  /* A listed file becomes the most recently used.  If another thread is
+   * still reading it, wait for the file's mutex, then use its result.
+   */
+  if (pc) {
+    UnlinkFile(pc);
+    LinkFile(pc);
+    pc->cntUsers++;
+
+    if (pc->fLoading) {
+      DosReleaseMutexSem(hmtxCache);
+      DosRequestMutexSem(pc->hmtx, SEM_INDEFINITE_WAIT);
+      DosReleaseMutexSem(pc->hmtx);
+
+      if (pc->rcLoad != XQSR_OK) {
+        *pStatus = (USHORT)pc->rcLoad;
+        ReleaseFile(pc);
+        return 0;
+      }
+      return pc;
+    }
+
+    TrimCache();
+    DosReleaseMutexSem(hmtxCache);
+    return pc;
+  }
+
+  /* Otherwise, list a placeholder whose mutex this thread owns, then
+   * read the file without the cache locked.
+   */
+  pc = (XQSCACHE*)calloc(1, sizeof(XQSCACHE));
+  if (!pc || DosCreateMutexSem(0, &pc->hmtx, 0, TRUE)) {
+    if (pc)
+      free(pc);
+    DosReleaseMutexSem(hmtxCache);
+    *pStatus = XQSR_MEMORY;
+    return 0;
+  }
+
+  strcpy(pc->szPath, szPath);
+  pc->fdate    = fs.fdateLastWrite;
+  pc->ftime    = fs.ftimeLastWrite;
+  pc->cbFile   = fs.cbFile;
+  pc->fLoading = 1;
+  pc->cntUsers = 1;
+  LinkFile(pc);
+
+  DosReleaseMutexSem(hmtxCache);
+
+  rc = xqs_open(&pc->xr, szPath);
+
+  DosRequestMutexSem(hmtxCache, SEM_INDEFINITE_WAIT);
+
+  pc->fLoading = 0;
+  pc->rcLoad = rc;
+
+  /* A file that couldn't be read is dropped;  it's freed by whichever
+   * thread is the last to stop waiting for it.
+   */
+  if (rc != XQSR_OK) {
+    if (!pc->fStale) {
+      UnlinkFile(pc);
+      pc->fStale = 1;
+    }
+    DosReleaseMutexSem(pc->hmtx);
+    pc->cntUsers--;
+    if (!pc->cntUsers)
+      FreeFile(pc);
+    DosReleaseMutexSem(hmtxCache);
+    *pStatus = (USHORT)rc;
+    return 0;
+  }
+
+  cntFiles++;
+  cbFiles += pc->xr.cbData;
+
+  if (fVerbose)
+    printf(" read '%s' - files= %ld  bytes= %ld\n",
+           szPath, cntFiles, cbFiles);
+
+  DosReleaseMutexSem(pc->hmtx);
+  TrimCache();
+
+  DosReleaseMutexSem(hmtxCache);
+
+  return pc;
+}
+
+/*****************************************************************************/
+
+void    ReleaseFile(XQSCACHE* pc)
+{
+  DosRequestMutexSem(hmtxCache, SEM_INDEFINITE_WAIT);
+
+  pc->cntUsers--;
+  if (pc->fStale) {
+    if (!pc->cntUsers)
+      FreeFile(pc);
+  }
+  else
+    TrimCache();
+
+  DosReleaseMutexSem(hmtxCache);
+  return;
+}
+
+/*****************************************************************************/
+/* Discard the least recently used files until the cache is within its
+ * limits.  Files in use are skipped, as is the most recently used file
+ * so that a single file larger than the limit is still kept.
+ */
+
+void    TrimCache(void)
+{
+  XQSCACHE *  pc;
+  XQSCACHE *  pPrev;
+
+  for (pc = pLRU; pc && pc != pMRU &&
+       (cntFiles > cntFilesMax || cbFiles > cbFilesMax); pc = pPrev) {
+    pPrev = pc->pPrev;
+    if (pc->cntUsers)
+      continue;
+
+    UnlinkFile(pc);
+    FreeFile(pc);
+  }
+
+  return;
+}
+
+/*****************************************************************************/
+/* Put a file at the head of the list (i.e. make it most recently used). */
+
+void    LinkFile(XQSCACHE* pc)
+{
+  pc->pPrev = 0;
+  pc->pNext = pMRU;
+  if (pMRU)
+    pMRU->pPrev = pc;
+  else
+    pLRU = pc;
+  pMRU = pc;
+
+  return;
+}
+
+/*****************************************************************************/
+
+void    UnlinkFile(XQSCACHE* pc)
+{
+  if (pc->pPrev)
+    pc->pPrev->pNext = pc->pNext;
+  else
+    pMRU = pc->pNext;
+
+  if (pc->pNext)
+    pc->pNext->pPrev = pc->pPrev;
+  else
+    pLRU = pc->pPrev;
+
+  pc->pPrev = 0;
+  pc->pNext = 0;
+  return;
+}
+
+/*****************************************************************************/
+/* Free a file that's no longer in the list.  One that couldn't be read
+ * was never counted.
+ */
+
+void    FreeFile(XQSCACHE* pc)
+{
+  if (pc->rcLoad == XQSR_OK) {
+    cntFiles--;
+    cbFiles -= pc->xr.cbData;
+
+    if (fVerbose)
+      printf(" discarded '%s' - files= %ld  bytes= %ld\n",
+             pc->szPath, cntFiles, cbFiles);
+
+    xqs_close(&pc->xr);
+  }
+
+  DosCloseMutexSem(pc->hmtx);
+  free(pc);
+
+  return;
+}
+
+/*****************************************************************************/
+
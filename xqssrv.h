@@ -0,0 +1,86 @@
+/*****************************************************************************/
+/*  xqssrv.h                                                                 */
+/*****************************************************************************/
+
+#ifndef _xqssrv_h
+#define _xqssrv_h
+
+/*****************************************************************************/
+/*  - the protocol used by xqssrv.exe (the symbol server) & its clients      */
+/*  - os2.h must be included first                                           */
+/*  - the server keeps recently used .xqs files open, so clients can         */
+/*    resolve addresses & names without reading the files themselves         */
+/*****************************************************************************/
+/*
+ * Clients open the server's named pipe (XQSRV_PIPE unless the server was
+ * started with -p) in message mode, then send requests & read replies,
+ * normally using DosTransactNPipe().  No message is larger than
+ * XQSRV_CBMSG bytes.  Every message starts with an XQSRVHDR.
+ *
+ * A request's header is followed by the fully-qualified name of the .xqs
+ * file (including its null), padded to a 4-byte boundary, then cntItem
+ * items:  an XQSRVADDR for each address (type XQSRV_ADDR) or a
+ * null-terminated name for each name (type XQSRV_NAME).
+ *
+ * A reply's header is followed by cntItem XQSRVITEMs, each followed by its
+ * symbol & module names (cbName & cbMod bytes including their nulls) padded
+ * to a 4-byte boundary.  Names longer than XQSRV_MAXNAME - 1 bytes are
+ * truncated.  An address produces one item;  a name produces one item per
+ * symbol with that name, or one item whose status is XQSR_NOSYM.  An
+ * error while finding further matches ends the list with an item carrying
+ * that status.  If the reply fills up, cntDone is the nbr of request items
+ * that were answered & the client should send the rest in another request.
+ * If the first name has more matches than fit, the last item's status is
+ * XQSRV_MORE.
+ *
+ * XQSRVHDR.status & XQSRVITEM.status are XQSR_* codes (see xqsread.h) or
+ * one of the codes below.
+ */
+
+#define XQSRV_PIPE      "\\PIPE\\XQSSRV"
+#define XQSRV_CBMSG     0x10000
+#define XQSRV_MAXNAME   0x1000
+
+#define XQSRV_MAGIC   ((ULONG)('x' | ('q' << 8) | ('s' << 16) | ('r' << 24)))
+
+/* request types */
+#define XQSRV_ADDR      1
+#define XQSRV_NAME      2
+
+/* status codes in addition to XQSR_* */
+#define XQSRV_BADREQ    16      /* the request is invalid */
+#define XQSRV_MORE      17      /* a valid symbol, but its name has more */
+                                /* matches than fit in a reply */
+
+typedef struct _XQSRVHDR {
+  ULONG   magic;
+  ULONG   cbMsg;
+  USHORT  type;
+  USHORT  status;
+  USHORT  cntItem;
+  USHORT  cntDone;
+} XQSRVHDR;
+
+typedef struct _XQSRVADDR {
+  USHORT  seg;
+  USHORT  unused;
+  ULONG   offset;
+} XQSRVADDR;
+
+typedef struct _XQSRVITEM {
+  USHORT  ndx;
+  USHORT  status;
+  USHORT  seg;
+  USHORT  unused;
+  ULONG   address;
+  ULONG   displacement;
+  USHORT  cbName;
+  USHORT  cbMod;
+} XQSRVITEM;
+
+/*****************************************************************************/
+
+#endif /* _xqssrv_h */
+
+/*****************************************************************************/
+
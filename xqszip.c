@@ -0,0 +1,429 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is MapXQS.
+ *
+ * The Initial Developer of the Original Code is
+ * Richard L. Walsh
+ * Portions created by the Initial Developer are Copyright (C) 2010-2011
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ *
+ * ***** END LICENSE BLOCK ***** */
+/*****************************************************************************/
+/*  xqszip.c - v1.04a
+ *
+ *  This is the compression used for XQS segments & module names when
+ *  XQFLAG_ZIP or XQFLAG_ZIP_MOD is set.  It's a simple byte-oriented
+ *  LZ77 variant that favors fast, allocation-free expansion over ratio.
+ *  Compressed data is a series of sequences, each consisting of:
+ *
+ *    - a token byte:  the high 4 bits are the nbr of literal bytes,
+ *      the low 4 bits are the length of the match minus 4
+ *    - if the literal count is 15, additional bytes that are added to it;
+ *      each byte of 255 is followed by another
+ *    - the literal bytes
+ *    - a 2-byte little-endian offset back into the expanded data (1-65535)
+ *    - if the match length is 19 (15 + 4), additional bytes as above
+ *
+ *  The last sequence ends after its literals & has no offset or match.
+ *
+ *  This file also has the encoders & decoders for front-coded names
+ *  (XQFLAG_FRONT), packed symbols (XQFLAG_PACK), and the varints they use,
+ *  as well as the hash used by name indexes (XQHASH).
+ */
+/*****************************************************************************/
+
+#include <string.h>
+
+#include "xqszip.h"
+
+#define XQZ_MINMATCH    4
+#define XQZ_MAXOFFS     0xFFFF
+#define XQZ_HASHBITS    12
+#define XQZ_HASH(v)     (((v) * 2654435761UL) >> (32 - XQZ_HASHBITS) & \
+                         ((1 << XQZ_HASHBITS) - 1))
+
+static unsigned long  XqzFetch(const char* ptr);
+static unsigned long  XqzPutLength(char* pDst, unsigned long cb);
+static unsigned long  XqpPutDelta(char* pDst, unsigned long val,
+                                  unsigned long base);
+static int            XqpGetDelta(const char** ppSrc, const char* pEnd,
+                                  unsigned long* pVal, unsigned long base);
+
+/*****************************************************************************/
+/* Get 4 bytes as a little-endian value. */
+
+static unsigned long  XqzFetch(const char* ptr)
+{
+  const unsigned char*  p = (const unsigned char*)ptr;
+
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+/*****************************************************************************/
+/* Store the part of a length that didn't fit in the token. */
+
+static unsigned long  XqzPutLength(char* pDst, unsigned long cb)
+{
+  unsigned long   ctr = 0;
+
+  while (cb >= 255) {
+    pDst[ctr++] = (char)255;
+    cb -= 255;
+  }
+  pDst[ctr++] = (char)cb;
+
+  return ctr;
+}
+
+/*****************************************************************************/
+/* Greedy compression using a table of the most recent position of each
+ * hashed 4-byte string.  Positions are stored +1 so zero means unused.
+ */
+
+unsigned long   XqzPack(const char* pSrc, unsigned long cbSrc,
+                        char* pDst, unsigned long cbDst)
+{
+  unsigned long   ip = 0;
+  unsigned long   anchor = 0;
+  unsigned long   op = 0;
+  unsigned long   ref = 0;
+  unsigned long   cbLit;
+  unsigned long   cbMatch;
+  unsigned long   hash;
+  unsigned long   aHash[1 << XQZ_HASHBITS];
+
+  memset(aHash, 0, sizeof(aHash));
+
+  for (;;) {
+
+    /* Look for a match at the current position. */
+    cbMatch = 0;
+    if (ip + XQZ_MINMATCH <= cbSrc) {
+      hash = XQZ_HASH(XqzFetch(&pSrc[ip]));
+      ref = aHash[hash];
+      aHash[hash] = ip + 1;
+
+      if (ref && ip - --ref <= XQZ_MAXOFFS &&
+          XqzFetch(&pSrc[ref]) == XqzFetch(&pSrc[ip])) {
+        cbMatch = XQZ_MINMATCH;
+        while (ip + cbMatch < cbSrc && pSrc[ref + cbMatch] == pSrc[ip + cbMatch])
+          cbMatch++;
+      }
+      else {
+        ip++;
+        continue;
+      }
+    }
+
+    /* Emit the pending literals, then the match (if any).  The worst
+     * case is the token, 2 length extensions, & the offset.
+     */
+    cbLit = (cbMatch ? ip : cbSrc) - anchor;
+    if (op + cbLit + cbLit / 255 + cbMatch / 255 + 6 >= cbDst)
+      return 0;
+
+    pDst[op++] = (char)(((cbLit < 15 ? cbLit : 15) << 4) |
+                        (cbMatch ? (cbMatch - XQZ_MINMATCH < 15 ?
+                                    cbMatch - XQZ_MINMATCH : 15) : 0));
+    if (cbLit >= 15)
+      op += XqzPutLength(&pDst[op], cbLit - 15);
+    memcpy(&pDst[op], &pSrc[anchor], cbLit);
+    op += cbLit;
+
+    if (!cbMatch)
+      break;
+
+    pDst[op++] = (char)((ip - ref) & 0xFF);
+    pDst[op++] = (char)((ip - ref) >> 8);
+    if (cbMatch - XQZ_MINMATCH >= 15)
+      op += XqzPutLength(&pDst[op], cbMatch - XQZ_MINMATCH - 15);
+
+    ip += cbMatch;
+    anchor = ip;
+  }
+
+  return op;
+}
+
+/*****************************************************************************/
+/* Expansion checks every length & offset against both buffers. */
+
+long            XqzUnpack(const char* pSrc, unsigned long cbSrc,
+                          char* pDst, unsigned long cbDst)
+{
+  const unsigned char*  ip = (const unsigned char*)pSrc;
+  const unsigned char*  pEnd = ip + cbSrc;
+  unsigned long   op = 0;
+  unsigned long   cb;
+  unsigned long   offs;
+  unsigned int    token;
+
+  while (ip < pEnd) {
+    token = *ip++;
+
+    /* Copy the literals. */
+    cb = token >> 4;
+    if (cb == 15) {
+      do {
+        if (ip >= pEnd)
+          return -1;
+        cb += *ip;
+      } while (*ip++ == 255);
+    }
+    if (cb > (unsigned long)(pEnd - ip) || cb > cbDst - op)
+      return -1;
+    memcpy(&pDst[op], ip, cb);
+    ip += cb;
+    op += cb;
+
+    /* The last sequence has no match. */
+    if (ip == pEnd)
+      break;
+
+    if (pEnd - ip < 2)
+      return -1;
+    offs = ip[0] | (ip[1] << 8);
+    ip += 2;
+    if (!offs || offs > op)
+      return -1;
+
+    cb = (token & 0x0F) + XQZ_MINMATCH;
+    if (cb == 15 + XQZ_MINMATCH) {
+      do {
+        if (ip >= pEnd)
+          return -1;
+        cb += *ip;
+      } while (*ip++ == 255);
+    }
+    if (cb > cbDst - op)
+      return -1;
+
+    /* The match may overlap the bytes being produced. */
+    for (; cb; cb--, op++)
+      pDst[op] = pDst[op - offs];
+  }
+
+  return (long)op;
+}
+
+/*****************************************************************************/
+/*  Front coding                                                             */
+/*****************************************************************************/
+/* The first name in a block is stored in full;  the rest are stored as
+ * the nbr of leading bytes shared with the preceding name, followed by
+ * the remaining bytes & the null.
+ */
+
+unsigned long   XqfPutName(char* pDst, const char* pPrev, const char* pName)
+{
+  unsigned long   cbShared = 0;
+  unsigned long   cb;
+
+  if (pPrev) {
+    while (pPrev[cbShared] && pPrev[cbShared] == pName[cbShared])
+      cbShared++;
+    cb = XqvPut(pDst, cbShared);
+  }
+  else
+    cb = 0;
+
+  pName += cbShared;
+  do {
+    pDst[cb++] = *pName;
+  } while (*pName++);
+
+  return cb;
+}
+
+/*****************************************************************************/
+/* Decode names from the start of the block until the ndx'th is reached.
+ * Each shared prefix must be no longer than the preceding name.
+ */
+
+long            XqfGetName(const char* pBlk, unsigned long cbBlk,
+                           unsigned long ndx, char* pOut, unsigned long cbOut)
+{
+  const char *    ptr = pBlk;
+  const char *    pEnd = pBlk + cbBlk;
+  unsigned long   cbPrev = 0;
+  unsigned long   cb;
+  unsigned long   ctr;
+
+  if (ndx >= XQF_RESTART)
+    return -1;
+
+  for (ctr = 0; ; ctr++) {
+    cb = 0;
+    if (ctr && (!XqvGet(&ptr, pEnd, &cb) || cb >= cbPrev))
+      return -1;
+
+    do {
+      if (ptr >= pEnd || cb >= cbOut)
+        return -1;
+      pOut[cb] = *ptr++;
+    } while (pOut[cb++]);
+
+    if (ctr == ndx)
+      return (long)cb;
+    cbPrev = cb;
+  }
+}
+
+/*****************************************************************************/
+/*  Packed symbols                                                           */
+/*****************************************************************************/
+/* Each symbol is stored as varints:  the address delta, cbName, the
+ * offset of the name relative to the end of the preceding one, and, if
+ * there's module info, the change in offsMod followed by cbMod if the
+ * module changed.  Signed deltas are zigzag-encoded.
+ */
+
+unsigned long   XqpPutSym(char* pDst, const XQPSYM* pPrev,
+                          const XQPSYM* pSym, int fMod)
+{
+  unsigned long   cb;
+
+  cb  = XqvPut(pDst, pSym->address - pPrev->address);
+  cb += XqvPut(&pDst[cb], pSym->cbName);
+  cb += XqpPutDelta(&pDst[cb], pSym->offsName,
+                    pPrev->offsName + pPrev->cbName);
+
+  if (fMod) {
+    cb += XqpPutDelta(&pDst[cb], pSym->offsMod, pPrev->offsMod);
+    if (pSym->offsMod != pPrev->offsMod)
+      cb += XqvPut(&pDst[cb], pSym->cbMod);
+  }
+
+  return cb;
+}
+
+/*****************************************************************************/
+
+int             XqpGetSym(const char** ppSrc, const char* pEnd,
+                          XQPSYM* pSym, int fMod)
+{
+  unsigned long   val;
+
+  if (!XqvGet(ppSrc, pEnd, &val))
+    return 0;
+  pSym->address = (pSym->address + val) & 0xFFFFFFFFUL;
+
+  val = pSym->offsName + pSym->cbName;
+  if (!XqvGet(ppSrc, pEnd, &pSym->cbName) ||
+      !XqpGetDelta(ppSrc, pEnd, &pSym->offsName, val))
+    return 0;
+
+  if (fMod) {
+    val = pSym->offsMod;
+    if (!XqpGetDelta(ppSrc, pEnd, &pSym->offsMod, val))
+      return 0;
+    if (pSym->offsMod != val && !XqvGet(ppSrc, pEnd, &pSym->cbMod))
+      return 0;
+  }
+
+  return 1;
+}
+
+/*****************************************************************************/
+/* Zigzag-encode the difference between two 32-bit values. */
+
+static unsigned long  XqpPutDelta(char* pDst, unsigned long val,
+                                  unsigned long base)
+{
+  val &= 0xFFFFFFFFUL;
+  base &= 0xFFFFFFFFUL;
+
+  if (val >= base)
+    return XqvPut(pDst, (val - base) << 1);
+
+  return XqvPut(pDst, ((base - val) << 1) - 1);
+}
+
+/*****************************************************************************/
+
+static int            XqpGetDelta(const char** ppSrc, const char* pEnd,
+                                  unsigned long* pVal, unsigned long base)
+{
+  unsigned long   val;
+
+  if (!XqvGet(ppSrc, pEnd, &val))
+    return 0;
+
+  if (val & 1)
+    *pVal = (base - (val >> 1) - 1) & 0xFFFFFFFFUL;
+  else
+    *pVal = (base + (val >> 1)) & 0xFFFFFFFFUL;
+
+  return 1;
+}
+
+/*****************************************************************************/
+/*  Name hashes                                                              */
+/*****************************************************************************/
+
+unsigned long long  XqhHash(const char* pName, unsigned long cb)
+{
+  unsigned long long  hash = 14695981039346656037ULL;
+
+  while (cb--)
+    hash = (hash ^ (unsigned char)*pName++) * 1099511628211ULL;
+
+  return hash;
+}
+
+/*****************************************************************************/
+/*  Varints                                                                  */
+/*****************************************************************************/
+
+unsigned long   XqvPut(char* pDst, unsigned long val)
+{
+  unsigned long   cb = 0;
+
+  while (val >= 0x80) {
+    pDst[cb++] = (char)(val | 0x80);
+    val >>= 7;
+  }
+  pDst[cb++] = (char)val;
+
+  return cb;
+}
+
+/*****************************************************************************/
+
+int             XqvGet(const char** ppSrc, const char* pEnd,
+                       unsigned long* pVal)
+{
+  const unsigned char*  ptr = (const unsigned char*)*ppSrc;
+  unsigned long   val = 0;
+  int             shift;
+
+  for (shift = 0; shift < 35; shift += 7) {
+    if ((const char*)ptr >= pEnd)
+      return 0;
+    val |= (unsigned long)(*ptr & 0x7F) << shift;
+    if (!(*ptr++ & 0x80)) {
+      *ppSrc = (const char*)ptr;
+      *pVal = val;
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/*****************************************************************************/
+
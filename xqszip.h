@@ -0,0 +1,82 @@
+/*****************************************************************************/
+/*  xqszip.h                                                                 */
+/*****************************************************************************/
+
+#ifndef _xqszip_h
+#define _xqszip_h
+
+/*****************************************************************************/
+/*  - used by mapxqs.c to compress segments & module names (XQFLAG_ZIP),     */
+/*    to front-code names (XQFLAG_FRONT), to pack symbols (XQFLAG_PACK),     */
+/*    & to hash names (XQHASH)                                               */
+/*  - has no dependencies, so any .xqs reader can use the decoders           */
+/*****************************************************************************/
+
+/* Compress cbSrc bytes from pSrc into pDst.  Returns the compressed size,
+ * or zero if it would be cbDst bytes or more (i.e. it isn't worth it).
+ */
+unsigned long   XqzPack(const char* pSrc, unsigned long cbSrc,
+                        char* pDst, unsigned long cbDst);
+
+/* Expand cbSrc bytes of compressed data from pSrc into pDst.  Returns the
+ * expanded size, or -1 if the data is invalid or wouldn't fit in cbDst.
+ * Nothing outside of pSrc[0 - cbSrc) and pDst[0 - cbDst) is ever touched.
+ */
+long            XqzUnpack(const char* pSrc, unsigned long cbSrc,
+                          char* pDst, unsigned long cbDst);
+
+/* Front coding of names (XQFLAG_FRONT).  XQF_RESTART is the max nbr of
+ * names in a block.  XqfPutName() stores one name given the preceding
+ * name in its block (or null for the first) & returns the bytes used.
+ * XqfGetName() decodes the ndx'th name in a block & returns its length
+ * including the null, or -1 if the block is invalid or the name won't
+ * fit in cbOut.  Nothing outside of pBlk[0 - cbBlk) is ever read.
+ */
+#define XQF_RESTART     16
+
+unsigned long   XqfPutName(char* pDst, const char* pPrev, const char* pName);
+
+long            XqfGetName(const char* pBlk, unsigned long cbBlk,
+                           unsigned long ndx, char* pOut, unsigned long cbOut);
+
+/* Compact symbol encoding (XQFLAG_PACK).  XQPSYM holds the fields of an
+ * XQSYM.  XqpPutSym() stores pSym relative to pPrev & returns the bytes
+ * used (never more than XQP_MAXSYM).  XqpGetSym() decodes the next symbol
+ * from [*ppSrc, pEnd) into pSym, which must hold the preceding symbol on
+ * entry, & advances *ppSrc past it.  It returns zero if the data is
+ * invalid.  fMod is nonzero if module info is included.
+ */
+#define XQP_MAXSYM      25
+
+typedef struct _XQPSYM {
+  unsigned long   address;
+  unsigned long   offsName;
+  unsigned long   cbName;
+  unsigned long   offsMod;
+  unsigned long   cbMod;
+} XQPSYM;
+
+unsigned long   XqpPutSym(char* pDst, const XQPSYM* pPrev,
+                          const XQPSYM* pSym, int fMod);
+
+int             XqpGetSym(const char** ppSrc, const char* pEnd,
+                          XQPSYM* pSym, int fMod);
+
+/* The 64-bit FNV-1a hash of the first cb bytes of a name (XQHASH). */
+unsigned long long  XqhHash(const char* pName, unsigned long cb);
+
+/* Store a varint (7 bits per byte, low bits first) & return its size. */
+unsigned long   XqvPut(char* pDst, unsigned long val);
+
+/* Read a varint from [*ppSrc, pEnd) & advance *ppSrc past it.  Returns
+ * zero if it's incomplete or longer than 5 bytes.
+ */
+int             XqvGet(const char** ppSrc, const char* pEnd,
+                       unsigned long* pVal);
+
+/*****************************************************************************/
+
+#endif /* _xqszip_h */
+
+/*****************************************************************************/
+